@@ -0,0 +1,31 @@
+#include "alloc.h"
+
+using namespace polojson;
+
+namespace
+{
+
+thread_local AllocationStats* current_stats = nullptr;
+}
+
+void polojson::RecordAllocation(size_t bytes)
+{
+    AllocationStats* stats = current_stats;
+    if (stats != nullptr)
+    {
+        ++stats->count;
+        stats->bytes += bytes;
+    }
+}
+
+polojson::AllocationScope::AllocationScope(AllocationStats* stats) :
+    previous_(current_stats)
+{
+    if (stats != nullptr)
+        current_stats = stats;
+}
+
+polojson::AllocationScope::~AllocationScope()
+{
+    current_stats = previous_;
+}
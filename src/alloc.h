@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace polojson
+{
+
+struct AllocationStats
+{
+    size_t count = 0;
+    size_t bytes = 0;
+};
+
+// Allocation counting is opt-in: a program that wants it expands
+// POLOJSON_COUNTING_NEW once at namespace scope in one of its source files,
+// which replaces the global operator new/delete with versions that report
+// to RecordAllocation. Without it the stats simply stay at zero.
+//
+// Counts go to the stats installed on the calling thread, if any, so
+// concurrent parses on other threads do not mix in.
+void RecordAllocation(size_t bytes);
+
+// Installs stats for the current thread for the lifetime of the scope;
+// scopes nest and the previous stats are restored afterwards. A null stats
+// leaves the current ones in place.
+class AllocationScope
+{
+public:
+    explicit AllocationScope(AllocationStats* stats);
+    ~AllocationScope();
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+private:
+    AllocationStats* previous_;
+};
+}
+
+#ifdef _WIN32
+#include <malloc.h>
+#define POLOJSON_ALIGNED_ALLOC(size, align) _aligned_malloc(size, align)
+#define POLOJSON_ALIGNED_FREE(p) _aligned_free(p)
+#else
+#define POLOJSON_ALIGNED_ALLOC(size, align) \
+    std::aligned_alloc(align, ((size) + (align) - 1) / (align) * (align))
+#define POLOJSON_ALIGNED_FREE(p) std::free(p)
+#endif
+
+// The aligned forms are replaced too: std::pmr::new_delete_resource(), the
+// default for DOM nodes, allocates through them.
+#define POLOJSON_COUNTING_NEW \
+    void* operator new(std::size_t size) \
+    { \
+        polojson::RecordAllocation(size); \
+        if (void* p = std::malloc(size ? size : 1)) \
+            return p; \
+        throw std::bad_alloc(); \
+    } \
+    void* operator new(std::size_t size, std::align_val_t align) \
+    { \
+        polojson::RecordAllocation(size); \
+        size_t alignment = static_cast<size_t>(align); \
+        if (void* p = POLOJSON_ALIGNED_ALLOC(size ? size : 1, alignment)) \
+            return p; \
+        throw std::bad_alloc(); \
+    } \
+    void operator delete(void* p) noexcept { std::free(p); } \
+    void operator delete(void* p, std::size_t) noexcept { std::free(p); } \
+    void operator delete(void* p, std::align_val_t) noexcept \
+    { \
+        POLOJSON_ALIGNED_FREE(p); \
+    } \
+    void operator delete(void* p, std::size_t, std::align_val_t) noexcept \
+    { \
+        POLOJSON_ALIGNED_FREE(p); \
+    }
@@ -0,0 +1,145 @@
+#include <algorithm>
+#include "batch.h"
+
+using namespace polojson;
+
+polojson::BatchParser::BatchParser(size_t threads, const ParseOptions& options) :
+    generation_(0), running_(0), stop_(false), results_(nullptr)
+{
+    threads = std::max<size_t>(threads, 1);
+    for (size_t i = 0; i < threads; ++i)
+        workers_.push_back(std::make_unique<Worker>(options));
+    // worker 0 is the thread calling ParseBatch
+    for (size_t i = 1; i < threads; ++i)
+        threads_.emplace_back(&BatchParser::ThreadMain, this, i);
+}
+
+polojson::BatchParser::~BatchParser()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& t : threads_)
+        t.join();
+}
+
+std::vector<BatchResult> polojson::BatchParser::ParseBatch(
+    std::span<const std::string_view> documents)
+{
+    std::lock_guard<std::mutex> batch_lock(batch_mutex_);
+    std::vector<BatchResult> results(documents.size());
+
+    // contiguous ranges of about the same number of bytes
+    size_t total = 0;
+    for (std::string_view d : documents)
+        total += d.size() + 1;
+    size_t n = workers_.size();
+    size_t index = 0;
+    size_t bytes = 0;
+    for (size_t w = 0; w < n; ++w)
+    {
+        size_t begin = index;
+        size_t target = total / n * (w + 1);
+        while (index < documents.size() && (w + 1 == n || bytes < target))
+            bytes += documents[index++].size() + 1;
+        std::lock_guard<std::mutex> lock(workers_[w]->mutex);
+        workers_[w]->begin = begin;
+        workers_[w]->end = index;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        documents_ = documents;
+        results_ = results.data();
+        error_ = nullptr;
+        running_ = n;
+        ++generation_;
+    }
+    wake_.notify_all();
+    Run(0);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (--running_ != 0)
+        done_.wait(lock, [this] { return running_ == 0; });
+    results_ = nullptr;
+    if (error_)
+        std::rethrow_exception(error_);
+    return results;
+}
+
+// Next document for worker self: the front of its own range, otherwise the
+// back half of the first other range that is not empty.
+bool polojson::BatchParser::Take(size_t self, size_t* index)
+{
+    Worker& own = *workers_[self];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.begin < own.end)
+        {
+            *index = own.begin++;
+            return true;
+        }
+    }
+    size_t n = workers_.size();
+    for (size_t k = 1; k < n; ++k)
+    {
+        Worker& victim = *workers_[(self + k) % n];
+        size_t begin, end;
+        {
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.begin == victim.end)
+                continue;
+            begin = victim.begin + (victim.end - victim.begin) / 2;
+            end = victim.end;
+            victim.end = begin;
+        }
+        std::lock_guard<std::mutex> lock(own.mutex);
+        own.begin = begin + 1;
+        own.end = end;
+        *index = begin;
+        return true;
+    }
+    return false;
+}
+
+void polojson::BatchParser::Run(size_t self)
+{
+    Parser& parser = workers_[self]->parser;
+    size_t index;
+    while (Take(self, &index))
+    {
+        try
+        {
+            BatchResult& result = results_[index];
+            result.value = parser.Parse(documents_[index]);
+            result.error_code = parser.GetErrorCode();
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!error_)
+                error_ = std::current_exception();
+        }
+    }
+}
+
+void polojson::BatchParser::ThreadMain(size_t self)
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+                return;
+            seen = generation_;
+        }
+        Run(self);
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (--running_ == 0)
+            done_.notify_all();
+    }
+}
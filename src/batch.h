@@ -0,0 +1,76 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "parse.h"
+
+namespace polojson
+{
+
+struct BatchResult
+{
+    JsonElem value;
+    ParseErrorCode error_code = ParseErrorCode::kOK;
+};
+
+// Parses batches of independent documents on a pool of threads. Each
+// worker keeps its own Parser, so scratch buffers are reused from batch to
+// batch. Work is split by bytes up front and balanced by stealing: a worker
+// whose range is exhausted takes the back half of the remaining range of
+// another one, so a few huge documents do not leave threads idle.
+class BatchParser
+{
+public:
+    // threads counts the calling thread, which works on every batch too
+    explicit BatchParser(
+        size_t threads = std::thread::hardware_concurrency(),
+        const ParseOptions& options = ParseOptions());
+    ~BatchParser();
+    BatchParser(const BatchParser&) = delete;
+    BatchParser& operator=(const BatchParser&) = delete;
+
+    // results[i] belongs to documents[i]. Concurrent calls on one
+    // BatchParser run one after the other. An exception thrown while
+    // parsing (std::bad_alloc) is rethrown here after the batch.
+    std::vector<BatchResult> ParseBatch(
+        std::span<const std::string_view> documents);
+
+    size_t threads() const { return workers_.size(); }
+
+private:
+    struct Worker
+    {
+        explicit Worker(const ParseOptions& options) :parser(options) {}
+
+        std::mutex mutex; //guards begin and end
+        size_t begin = 0;
+        size_t end = 0;
+        Parser parser;
+    };
+
+    bool Take(size_t self, size_t* index);
+    void Run(size_t self);
+    void ThreadMain(size_t self);
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+
+    std::mutex batch_mutex_; //one batch at a time
+    std::mutex mutex_;       //guards the fields below
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    uint64_t generation_;
+    size_t running_;
+    bool stop_;
+    std::span<const std::string_view> documents_;
+    BatchResult* results_;
+    std::exception_ptr error_;
+};
+}
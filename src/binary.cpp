@@ -0,0 +1,680 @@
+#include <cmath>
+#include <cstring>
+#include "binary.h"
+
+using namespace polojson;
+
+namespace
+{
+
+void PutBigEndian(std::string& out, uint64_t value, size_t count)
+{
+    for (size_t i = count; i > 0; --i)
+        out.push_back(static_cast<char>((value >> ((i - 1) * 8)) & 0xFF));
+}
+
+// true when value is an integer in [0, 2^64)
+bool AsUnsigned(double value, uint64_t* result)
+{
+    if (!(value >= 0.0 && value < 18446744073709551616.0))
+        return false;
+    if (value != std::trunc(value) || std::signbit(value))
+        return false;
+    *result = static_cast<uint64_t>(value);
+    return true;
+}
+
+// true when value is an integer in [-2^63, 0)
+bool AsNegative(double value, int64_t* result)
+{
+    if (!(value < 0.0 && value >= -9223372036854775808.0))
+        return false;
+    if (value != std::trunc(value))
+        return false;
+    *result = static_cast<int64_t>(value);
+    return true;
+}
+
+bool IsLosslessFloat(double value)
+{
+    return static_cast<double>(static_cast<float>(value)) == value;
+}
+
+uint32_t FloatBits(float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+uint64_t DoubleBits(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+void MsgPackNumber(double value, std::string& out)
+{
+    uint64_t u;
+    int64_t n;
+    if (AsUnsigned(value, &u))
+    {
+        if (u < 0x80)
+            out.push_back(static_cast<char>(u));
+        else if (u <= 0xFF)
+        {
+            out.push_back(static_cast<char>(0xCC));
+            PutBigEndian(out, u, 1);
+        }
+        else if (u <= 0xFFFF)
+        {
+            out.push_back(static_cast<char>(0xCD));
+            PutBigEndian(out, u, 2);
+        }
+        else if (u <= 0xFFFFFFFF)
+        {
+            out.push_back(static_cast<char>(0xCE));
+            PutBigEndian(out, u, 4);
+        }
+        else
+        {
+            out.push_back(static_cast<char>(0xCF));
+            PutBigEndian(out, u, 8);
+        }
+    }
+    else if (AsNegative(value, &n))
+    {
+        uint64_t bits = static_cast<uint64_t>(n);
+        if (n >= -32)
+            out.push_back(static_cast<char>(bits & 0xFF));
+        else if (n >= -128)
+        {
+            out.push_back(static_cast<char>(0xD0));
+            PutBigEndian(out, bits, 1);
+        }
+        else if (n >= -32768)
+        {
+            out.push_back(static_cast<char>(0xD1));
+            PutBigEndian(out, bits, 2);
+        }
+        else if (n >= -2147483647LL - 1)
+        {
+            out.push_back(static_cast<char>(0xD2));
+            PutBigEndian(out, bits, 4);
+        }
+        else
+        {
+            out.push_back(static_cast<char>(0xD3));
+            PutBigEndian(out, bits, 8);
+        }
+    }
+    else if (IsLosslessFloat(value))
+    {
+        out.push_back(static_cast<char>(0xCA));
+        PutBigEndian(out, FloatBits(static_cast<float>(value)), 4);
+    }
+    else
+    {
+        out.push_back(static_cast<char>(0xCB));
+        PutBigEndian(out, DoubleBits(value), 8);
+    }
+}
+
+// fix_tag is used for sizes below fix_limit, then the 8/16/32 bit forms
+// starting at tag8 (tag8 == 0 means there is no 8 bit form)
+void MsgPackHead(std::string& out, size_t size, unsigned char fix_tag,
+    size_t fix_limit, unsigned char tag8, unsigned char tag16)
+{
+    if (size < fix_limit)
+        out.push_back(static_cast<char>(fix_tag | size));
+    else if (tag8 != 0 && size <= 0xFF)
+    {
+        out.push_back(static_cast<char>(tag8));
+        PutBigEndian(out, size, 1);
+    }
+    else if (size <= 0xFFFF)
+    {
+        out.push_back(static_cast<char>(tag16));
+        PutBigEndian(out, size, 2);
+    }
+    else
+    {
+        out.push_back(static_cast<char>(tag16 + 1));
+        PutBigEndian(out, size, 4);
+    }
+}
+
+void MsgPackString(std::string_view str, std::string& out)
+{
+    MsgPackHead(out, str.size(), 0xA0, 32, 0xD9, 0xDA);
+    out += str;
+}
+
+void MsgPackEncode(const JsonElem& elem, std::string& out)
+{
+    switch (elem.type())
+    {
+    case JsonType::kNull:
+        out.push_back(static_cast<char>(0xC0));
+        break;
+    case JsonType::kFalse:
+        out.push_back(static_cast<char>(0xC2));
+        break;
+    case JsonType::kTrue:
+        out.push_back(static_cast<char>(0xC3));
+        break;
+    case JsonType::kNumber:
+        MsgPackNumber(elem.ToNumber(), out);
+        break;
+    case JsonType::kString:
+        MsgPackString(elem.ToString(), out);
+        break;
+    case JsonType::kArray:
+        MsgPackHead(out, elem.ToArray().size(), 0x90, 16, 0, 0xDC);
+        for (const auto& e : elem.ToArray())
+            MsgPackEncode(e, out);
+        break;
+    case JsonType::kObject:
+        MsgPackHead(out, elem.ToObject().size(), 0x80, 16, 0, 0xDE);
+        for (const auto& e : elem.ToObject())
+        {
+            MsgPackString(e.first, out);
+            MsgPackEncode(e.second, out);
+        }
+        break;
+    default:
+        throw std::runtime_error("invalid type");
+    }
+}
+
+void CborHead(std::string& out, int major, uint64_t arg)
+{
+    unsigned char m = static_cast<unsigned char>(major << 5);
+    if (arg < 24)
+        out.push_back(static_cast<char>(m | arg));
+    else if (arg <= 0xFF)
+    {
+        out.push_back(static_cast<char>(m | 24));
+        PutBigEndian(out, arg, 1);
+    }
+    else if (arg <= 0xFFFF)
+    {
+        out.push_back(static_cast<char>(m | 25));
+        PutBigEndian(out, arg, 2);
+    }
+    else if (arg <= 0xFFFFFFFF)
+    {
+        out.push_back(static_cast<char>(m | 26));
+        PutBigEndian(out, arg, 4);
+    }
+    else
+    {
+        out.push_back(static_cast<char>(m | 27));
+        PutBigEndian(out, arg, 8);
+    }
+}
+
+void CborNumber(double value, std::string& out)
+{
+    uint64_t u;
+    int64_t n;
+    if (AsUnsigned(value, &u))
+        CborHead(out, 0, u);
+    else if (AsNegative(value, &n))
+        CborHead(out, 1, static_cast<uint64_t>(-(n + 1)));
+    else if (IsLosslessFloat(value))
+    {
+        out.push_back(static_cast<char>(0xFA));
+        PutBigEndian(out, FloatBits(static_cast<float>(value)), 4);
+    }
+    else
+    {
+        out.push_back(static_cast<char>(0xFB));
+        PutBigEndian(out, DoubleBits(value), 8);
+    }
+}
+
+void CborEncode(const JsonElem& elem, std::string& out)
+{
+    switch (elem.type())
+    {
+    case JsonType::kNull:
+        out.push_back(static_cast<char>(0xF6));
+        break;
+    case JsonType::kFalse:
+        out.push_back(static_cast<char>(0xF4));
+        break;
+    case JsonType::kTrue:
+        out.push_back(static_cast<char>(0xF5));
+        break;
+    case JsonType::kNumber:
+        CborNumber(elem.ToNumber(), out);
+        break;
+    case JsonType::kString:
+        CborHead(out, 3, elem.ToString().size());
+        out += elem.ToString();
+        break;
+    case JsonType::kArray:
+        CborHead(out, 4, elem.ToArray().size());
+        for (const auto& e : elem.ToArray())
+            CborEncode(e, out);
+        break;
+    case JsonType::kObject:
+        CborHead(out, 5, elem.ToObject().size());
+        for (const auto& e : elem.ToObject())
+        {
+            CborHead(out, 3, e.first.size());
+            out += e.first;
+            CborEncode(e.second, out);
+        }
+        break;
+    default:
+        throw std::runtime_error("invalid type");
+    }
+}
+
+double HalfToDouble(uint64_t half)
+{
+    int exponent = static_cast<int>((half >> 10) & 0x1F);
+    double mantissa = static_cast<double>(half & 0x3FF);
+    double value;
+    if (exponent == 0)
+        value = std::ldexp(mantissa, -24);
+    else if (exponent != 31)
+        value = std::ldexp(mantissa + 1024, exponent - 25);
+    else
+        value = mantissa == 0 ? HUGE_VAL : NAN;
+    return (half & 0x8000) ? -value : value;
+}
+
+}
+
+void polojson::EncodeMsgPack(const JsonElem& elem, std::string& out)
+{
+    MsgPackEncode(elem, out);
+}
+
+void polojson::EncodeCbor(const JsonElem& elem, std::string& out)
+{
+    CborEncode(elem, out);
+}
+
+ParseErrorCode polojson::BinaryDecoder::GetErrorCode() const
+{
+    return error_code_;
+}
+
+void polojson::BinaryDecoder::SetData(const std::string& data)
+{
+    data_ = reinterpret_cast<const unsigned char*>(data.data());
+    size_ = data.size();
+    pos_ = 0;
+    depth_ = 0;
+    error_code_ = ParseErrorCode::kOK;
+}
+
+JsonElem polojson::BinaryDecoder::Fail(ParseErrorCode code)
+{
+    error_code_ = code;
+    return JsonElem{ nullptr };
+}
+
+JsonElem polojson::BinaryDecoder::Float(double value)
+{
+    if (!std::isfinite(value))
+        return Fail(ParseErrorCode::kInvalidValue);
+    return JsonElem{ value };
+}
+
+bool polojson::BinaryDecoder::ReadBytes(size_t count,
+    const unsigned char** bytes)
+{
+    if (count > size_ - pos_)
+    {
+        error_code_ = ParseErrorCode::kExpectValue;
+        return false;
+    }
+    *bytes = data_ + pos_;
+    pos_ += count;
+    return true;
+}
+
+bool polojson::BinaryDecoder::ReadUint(size_t count, uint64_t* value)
+{
+    const unsigned char* bytes;
+    if (!ReadBytes(count, &bytes))
+        return false;
+    *value = 0;
+    for (size_t i = 0; i < count; ++i)
+        *value = (*value << 8) | bytes[i];
+    return true;
+}
+
+JsonElem polojson::BinaryDecoder::DecodeMsgPack(const std::string& data)
+{
+    SetData(data);
+    JsonElem result = MsgPackValue();
+    if (error_code_ == ParseErrorCode::kOK && pos_ != size_)
+        return Fail(ParseErrorCode::kRootNotSingular);
+    return result;
+}
+
+JsonElem polojson::BinaryDecoder::MsgPackValue()
+{
+    const unsigned char* tag;
+    if (!ReadBytes(1, &tag))
+        return JsonElem{ nullptr };
+
+    unsigned char t = *tag;
+    uint64_t value;
+    if (t < 0x80)
+        return JsonElem{ static_cast<double>(t) };
+    if (t >= 0xE0)
+        return JsonElem{ static_cast<double>(static_cast<int8_t>(t)) };
+    if ((t & 0xF0) == 0x80)
+        return MsgPackMap(t & 0x0F);
+    if ((t & 0xF0) == 0x90)
+        return MsgPackArray(t & 0x0F);
+    if ((t & 0xE0) == 0xA0)
+        return MsgPackString(t & 0x1F);
+
+    switch (t)
+    {
+    case 0xC0:
+        return JsonElem{ nullptr };
+    case 0xC2:
+        return JsonElem{ false };
+    case 0xC3:
+        return JsonElem{ true };
+    case 0xCA:
+    {
+        if (!ReadUint(4, &value))
+            return JsonElem{ nullptr };
+        uint32_t bits = static_cast<uint32_t>(value);
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return Float(f);
+    }
+    case 0xCB:
+    {
+        if (!ReadUint(8, &value))
+            return JsonElem{ nullptr };
+        double d;
+        memcpy(&d, &value, sizeof(d));
+        return Float(d);
+    }
+    case 0xCC: case 0xCD: case 0xCE: case 0xCF:
+        if (!ReadUint(size_t(1) << (t - 0xCC), &value))
+            return JsonElem{ nullptr };
+        return JsonElem{ static_cast<double>(value) };
+    case 0xD0: case 0xD1: case 0xD2: case 0xD3:
+    {
+        size_t count = size_t(1) << (t - 0xD0);
+        if (!ReadUint(count, &value))
+            return JsonElem{ nullptr };
+        // sign extend from count bytes
+        if (count < 8 && (value >> (count * 8 - 1)))
+            value |= ~uint64_t(0) << (count * 8);
+        return JsonElem{ static_cast<double>(static_cast<int64_t>(value)) };
+    }
+    case 0xD9: case 0xDA: case 0xDB:
+        if (!ReadUint(size_t(1) << (t - 0xD9), &value))
+            return JsonElem{ nullptr };
+        return MsgPackString(static_cast<size_t>(value));
+    case 0xDC: case 0xDD:
+        if (!ReadUint(t == 0xDC ? 2 : 4, &value))
+            return JsonElem{ nullptr };
+        return MsgPackArray(static_cast<size_t>(value));
+    case 0xDE: case 0xDF:
+        if (!ReadUint(t == 0xDE ? 2 : 4, &value))
+            return JsonElem{ nullptr };
+        return MsgPackMap(static_cast<size_t>(value));
+    default:
+        // bin, ext and the reserved tag have no JSON equivalent
+        return Fail(ParseErrorCode::kInvalidValue);
+    }
+}
+
+JsonElem polojson::BinaryDecoder::MsgPackString(size_t length)
+{
+    const unsigned char* bytes;
+    if (!ReadBytes(length, &bytes))
+        return JsonElem{ nullptr };
+    return JsonElem{ std::string(reinterpret_cast<const char*>(bytes),
+        length) };
+}
+
+JsonElem polojson::BinaryDecoder::MsgPackArray(size_t count)
+{
+    Nesting nesting(depth_);
+    if (depth_ > kMaxDepth)
+        return Fail(ParseErrorCode::kNestingTooDeep);
+    // every element takes at least one byte
+    if (count > size_ - pos_)
+        return Fail(ParseErrorCode::kExpectValue);
+    array_t array_tmp;
+    array_tmp.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        array_tmp.emplace_back(MsgPackValue());
+        if (error_code_ != ParseErrorCode::kOK)
+            return JsonElem{ nullptr };
+    }
+    return JsonElem{ std::move(array_tmp) };
+}
+
+JsonElem polojson::BinaryDecoder::MsgPackMap(size_t count)
+{
+    Nesting nesting(depth_);
+    if (depth_ > kMaxDepth)
+        return Fail(ParseErrorCode::kNestingTooDeep);
+    if (count > size_ - pos_)
+        return Fail(ParseErrorCode::kExpectValue);
+    object_t object_tmp;
+    object_tmp.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        JsonElem key = MsgPackValue();
+        if (error_code_ != ParseErrorCode::kOK)
+            return JsonElem{ nullptr };
+        if (!key.IsString())
+            return Fail(ParseErrorCode::kMissKey);
+        JsonElem value = MsgPackValue();
+        if (error_code_ != ParseErrorCode::kOK)
+            return JsonElem{ nullptr };
+        object_tmp.emplace(key.ToString(), std::move(value));
+    }
+    return JsonElem{ std::move(object_tmp) };
+}
+
+JsonElem polojson::BinaryDecoder::DecodeCbor(const std::string& data)
+{
+    SetData(data);
+    JsonElem result = CborValue();
+    if (error_code_ == ParseErrorCode::kOK && pos_ != size_)
+        return Fail(ParseErrorCode::kRootNotSingular);
+    return result;
+}
+
+bool polojson::BinaryDecoder::CborHead(int* major, int* info, uint64_t* arg)
+{
+    const unsigned char* head;
+    if (!ReadBytes(1, &head))
+        return false;
+    *major = *head >> 5;
+    *info = *head & 0x1F;
+    if (*info < 24)
+    {
+        *arg = static_cast<uint64_t>(*info);
+        return true;
+    }
+    if (*info <= 27)
+        return ReadUint(size_t(1) << (*info - 24), arg);
+    if (*info == 31 && *major >= 2 && *major <= 5)
+    {
+        // indefinite length, terminated by a 0xFF break
+        *arg = 0;
+        return true;
+    }
+    error_code_ = ParseErrorCode::kInvalidValue;
+    return false;
+}
+
+JsonElem polojson::BinaryDecoder::CborValue()
+{
+    int major, info;
+    uint64_t arg;
+    if (!CborHead(&major, &info, &arg))
+        return JsonElem{ nullptr };
+
+    switch (major)
+    {
+    case 0:
+        return JsonElem{ static_cast<double>(arg) };
+    case 1:
+        return JsonElem{ -1.0 - static_cast<double>(arg) };
+    case 2:
+    case 3:
+        return CborString(major, info, arg);
+    case 4:
+        return CborArray(info, arg);
+    case 5:
+        return CborMap(info, arg);
+    case 6:
+    {
+        // tags carry no meaning for JSON, decode the tagged item
+        Nesting nesting(depth_);
+        if (depth_ > kMaxDepth)
+            return Fail(ParseErrorCode::kNestingTooDeep);
+        return CborValue();
+    }
+    default:
+        break;
+    }
+
+    switch (info)
+    {
+    case 20:
+        return JsonElem{ false };
+    case 21:
+        return JsonElem{ true };
+    case 22:
+    case 23: // undefined
+        return JsonElem{ nullptr };
+    case 25:
+        return Float(HalfToDouble(arg));
+    case 26:
+    {
+        uint32_t bits = static_cast<uint32_t>(arg);
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return Float(f);
+    }
+    case 27:
+    {
+        double d;
+        memcpy(&d, &arg, sizeof(d));
+        return Float(d);
+    }
+    default:
+        return Fail(ParseErrorCode::kInvalidValue);
+    }
+}
+
+JsonElem polojson::BinaryDecoder::CborString(int major, int info,
+    uint64_t length)
+{
+    std::string str_tmp;
+    if (info == 31)
+    {
+        // indefinite: a sequence of definite chunks of the same major type
+        for (;;)
+        {
+            if (pos_ < size_ && data_[pos_] == 0xFF)
+            {
+                pos_++;
+                break;
+            }
+            int chunk_major, chunk_info;
+            uint64_t chunk_length;
+            if (!CborHead(&chunk_major, &chunk_info, &chunk_length))
+                return JsonElem{ nullptr };
+            if (chunk_major != major || chunk_info == 31)
+                return Fail(ParseErrorCode::kInvalidValue);
+            const unsigned char* bytes;
+            if (!ReadBytes(static_cast<size_t>(chunk_length), &bytes))
+                return JsonElem{ nullptr };
+            str_tmp.append(reinterpret_cast<const char*>(bytes),
+                static_cast<size_t>(chunk_length));
+        }
+    }
+    else
+    {
+        const unsigned char* bytes;
+        if (length > size_ - pos_ ||
+            !ReadBytes(static_cast<size_t>(length), &bytes))
+            return Fail(ParseErrorCode::kExpectValue);
+        str_tmp.assign(reinterpret_cast<const char*>(bytes),
+            static_cast<size_t>(length));
+    }
+    return JsonElem{ std::move(str_tmp) };
+}
+
+JsonElem polojson::BinaryDecoder::CborArray(int info, uint64_t count)
+{
+    Nesting nesting(depth_);
+    if (depth_ > kMaxDepth)
+        return Fail(ParseErrorCode::kNestingTooDeep);
+    array_t array_tmp;
+    if (info != 31)
+    {
+        if (count > size_ - pos_)
+            return Fail(ParseErrorCode::kExpectValue);
+        array_tmp.reserve(static_cast<size_t>(count));
+    }
+    for (uint64_t i = 0; info == 31 || i < count; ++i)
+    {
+        if (info == 31 && pos_ < size_ && data_[pos_] == 0xFF)
+        {
+            pos_++;
+            break;
+        }
+        array_tmp.emplace_back(CborValue());
+        if (error_code_ != ParseErrorCode::kOK)
+            return JsonElem{ nullptr };
+    }
+    return JsonElem{ std::move(array_tmp) };
+}
+
+JsonElem polojson::BinaryDecoder::CborMap(int info, uint64_t count)
+{
+    Nesting nesting(depth_);
+    if (depth_ > kMaxDepth)
+        return Fail(ParseErrorCode::kNestingTooDeep);
+    object_t object_tmp;
+    if (info != 31)
+    {
+        if (count > size_ - pos_)
+            return Fail(ParseErrorCode::kExpectValue);
+        object_tmp.reserve(static_cast<size_t>(count));
+    }
+    for (uint64_t i = 0; info == 31 || i < count; ++i)
+    {
+        if (info == 31 && pos_ < size_ && data_[pos_] == 0xFF)
+        {
+            pos_++;
+            break;
+        }
+        JsonElem key = CborValue();
+        if (error_code_ != ParseErrorCode::kOK)
+            return JsonElem{ nullptr };
+        if (!key.IsString())
+            return Fail(ParseErrorCode::kMissKey);
+        JsonElem value = CborValue();
+        if (error_code_ != ParseErrorCode::kOK)
+            return JsonElem{ nullptr };
+        object_tmp.emplace(key.ToString(), std::move(value));
+    }
+    return JsonElem{ std::move(object_tmp) };
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include "util.h"
+
+namespace polojson
+{
+
+// Binary codecs working directly on JsonElem, without going through JSON
+// text. Numbers that hold an integral value are written with the integer
+// encodings of each format, everything else as a float (float32 when it is
+// lossless, float64 otherwise). Encoders append to out, like Stringify.
+void EncodeMsgPack(const JsonElem& elem, std::string& out);
+void EncodeCbor(const JsonElem& elem, std::string& out);
+
+class BinaryDecoder
+{
+public:
+    // the most arrays, maps and CBOR tags an item may sit inside; deeper
+    // input fails with kNestingTooDeep rather than exhausting the stack
+    static const int kMaxDepth = 512;
+
+    BinaryDecoder() :data_(nullptr), size_(0), pos_(0), depth_(0),
+        error_code_(ParseErrorCode::kOK) {}
+
+    // Truncated input reports kExpectValue, unsupported or malformed items
+    // (NaN and infinite floats among them) kInvalidValue and trailing bytes
+    // kRootNotSingular.
+    JsonElem DecodeMsgPack(const std::string& data);
+    JsonElem DecodeCbor(const std::string& data);
+
+    ParseErrorCode GetErrorCode() const;
+
+private:
+    void SetData(const std::string& data);
+    bool ReadBytes(size_t count, const unsigned char** bytes);
+    bool ReadUint(size_t count, uint64_t* value);
+
+    JsonElem MsgPackValue();
+    JsonElem MsgPackString(size_t length);
+    JsonElem MsgPackArray(size_t count);
+    JsonElem MsgPackMap(size_t count);
+
+    bool CborHead(int* major, int* info, uint64_t* arg);
+    JsonElem CborValue();
+    JsonElem CborString(int major, int info, uint64_t length);
+    JsonElem CborArray(int info, uint64_t count);
+    JsonElem CborMap(int info, uint64_t count);
+
+    JsonElem Fail(ParseErrorCode code);
+    // a decoded float; NaN and infinities have no JSON text
+    JsonElem Float(double value);
+
+    // counts one level of nesting for as long as it lives
+    struct Nesting
+    {
+        explicit Nesting(int& depth) :depth_(depth) { ++depth_; }
+        ~Nesting() { --depth_; }
+        int& depth_;
+    };
+
+private:
+    const unsigned char* data_;
+    size_t size_;
+    size_t pos_;
+    int depth_;
+
+    ParseErrorCode error_code_;
+};
+}
@@ -0,0 +1,95 @@
+#include "bind.h"
+
+using namespace polojson;
+
+const std::string& polojson::StructParser::GetErrorPath() const
+{
+    return error_path_;
+}
+
+bool polojson::StructParser::Mismatch()
+{
+    error_code_ = ParseErrorCode::kTypeMismatch;
+    return false;
+}
+
+void polojson::StructParser::PrependPath(const std::string& segment)
+{
+    if (error_path_.empty() || error_path_[0] == '[')
+        error_path_ = segment + error_path_;
+    else
+        error_path_ = segment + "." + error_path_;
+}
+
+bool polojson::StructParser::Read(bool& out)
+{
+    switch (content_[parse_pos_])
+    {
+    case 't':
+        SkipLiteral("true");
+        out = true;
+        break;
+    case 'f':
+        SkipLiteral("false");
+        out = false;
+        break;
+    default:
+        return Mismatch();
+    }
+    return error_code_ == ParseErrorCode::kOK;
+}
+
+bool polojson::StructParser::Read(std::string& out)
+{
+    if (content_[parse_pos_] != '"')
+        return Mismatch();
+    out = ParseStringRaw();
+    return error_code_ == ParseErrorCode::kOK;
+}
+
+bool polojson::StructParser::Read(JsonElem& out)
+{
+    out = ParseValue();
+    return error_code_ == ParseErrorCode::kOK;
+}
+
+bool polojson::StructParser::ReadKey(std::string* key)
+{
+    if (content_[parse_pos_] != '"')
+    {
+        error_code_ = ParseErrorCode::kMissKey;
+        return false;
+    }
+    *key = ParseStringRaw();
+    if (error_code_ != ParseErrorCode::kOK)
+        return false;
+    ParseWhitespace();
+    if (content_[parse_pos_] != ':')
+    {
+        error_code_ = ParseErrorCode::kMissColon;
+        return false;
+    }
+    parse_pos_++;
+    ParseWhitespace();
+    return true;
+}
+
+bool polojson::StructParser::NextMember(bool* done)
+{
+    ParseWhitespace();
+    if (content_[parse_pos_] == ',')
+    {
+        parse_pos_++;
+        ParseWhitespace();
+        *done = false;
+        return true;
+    }
+    if (content_[parse_pos_] == '}')
+    {
+        parse_pos_++;
+        *done = true;
+        return true;
+    }
+    error_code_ = ParseErrorCode::kMissCommaOrCurlyBracket;
+    return false;
+}
@@ -0,0 +1,576 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <bitset>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "parse.h"
+
+// Compile-time struct binding, in both directions.
+//
+//     struct Point { double x; double y; };
+//     POLOJSON_FIELDS(Point, x, y)
+//
+// registers the members of Point (the macro must be used in the namespace
+// of the struct, it is found through argument dependent lookup). A
+// registered struct can be filled straight from JSON text by StructParser,
+// without building a JsonElem tree, and written back by Stringify(value,
+// out) without one either. Members may be bool, arithmetic types,
+// std::string, JsonElem, registered structs, and std::vector,
+// std::optional or string keyed std::map/std::unordered_map of those.
+// std::optional members may be absent, every other member is required;
+// an empty std::optional is written as null. Of duplicate keys the first
+// wins, as with Parser.
+
+namespace polojson
+{
+
+constexpr uint64_t FieldHash(std::string_view name)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (char ch : name)
+    {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+template<typename C, typename M>
+struct Field
+{
+    using member_type = M;
+
+    std::string_view name;
+    // ,"name": as written in front of the value; built by the macro from
+    // the member identifier, which never needs escaping
+    std::string_view key;
+    M C::* member;
+    uint64_t hash; //FieldHash(name), computed at compile time
+};
+
+template<typename C, typename M>
+constexpr Field<C, M> MakeField(std::string_view name, std::string_view key,
+    M C::* member)
+{
+    return Field<C, M>{ name, key, member, FieldHash(name) };
+}
+
+template<typename T, typename = void>
+struct IsBound : std::false_type {};
+
+template<typename T>
+struct IsBound<T, std::void_t<decltype(
+    PolojsonFields(static_cast<const T*>(nullptr)))>> : std::true_type {};
+
+template<typename T>
+struct IsOptional : std::false_type {};
+template<typename T>
+struct IsOptional<std::optional<T>> : std::true_type {};
+
+template<typename T>
+struct IsVector : std::false_type {};
+template<typename T, typename A>
+struct IsVector<std::vector<T, A>> : std::true_type {};
+
+template<typename T>
+struct IsStringMap : std::false_type {};
+template<typename V, typename C, typename A>
+struct IsStringMap<std::map<std::string, V, C, A>> : std::true_type {};
+template<typename V, typename H, typename E, typename A>
+struct IsStringMap<std::unordered_map<std::string, V, H, E, A>> :
+    std::true_type {};
+
+template<typename T>
+constexpr auto FieldsOf()
+{
+    return PolojsonFields(static_cast<const T*>(nullptr));
+}
+
+template<typename Tuple, size_t... I>
+constexpr std::array<uint64_t, sizeof...(I)> FieldHashes(const Tuple& fields,
+    std::index_sequence<I...>)
+{
+    return { { std::get<I>(fields).hash... } };
+}
+
+// An open addressed table from FieldHash(name) to the index of the field,
+// filled at compile time. Names whose hashes collide are told apart by the
+// caller comparing the name of the field found.
+template<size_t N>
+struct FieldTable
+{
+    static constexpr size_t kSize = std::bit_ceil(2 * N);
+
+    std::array<uint64_t, kSize> hashes{};
+    std::array<size_t, kSize> slots{}; //index + 1, 0 for a free slot
+
+    constexpr explicit FieldTable(const std::array<uint64_t, N>& field_hashes)
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            size_t slot = field_hashes[i] & (kSize - 1);
+            while (slots[slot] != 0)
+                slot = (slot + 1) & (kSize - 1);
+            hashes[slot] = field_hashes[i];
+            slots[slot] = i + 1;
+        }
+    }
+
+    // N when no field has the hash
+    size_t Find(uint64_t hash) const
+    {
+        for (size_t slot = hash & (kSize - 1); slots[slot] != 0;
+            slot = (slot + 1) & (kSize - 1))
+        {
+            if (hashes[slot] == hash)
+                return slots[slot] - 1;
+        }
+        return N;
+    }
+};
+
+// Calls f with the index-th field, the index is only known at run time.
+template<typename Tuple, typename F, size_t... I>
+bool VisitField(const Tuple& fields, size_t index, F&& f,
+    std::index_sequence<I...>)
+{
+    bool result = false;
+    (void)((index == I ? (result = f(std::get<I>(fields)), true) : false) || ...);
+    return result;
+}
+
+class StructParser : public Parser
+{
+public:
+    using Parser::Parse;
+
+    // Fills out from content; returns false and sets GetErrorCode() and
+    // GetErrorPath() on the first error. out may be partially written.
+    template<typename T>
+    bool Parse(const std::string& content, T& out);
+
+    // Location of the last error, e.g. "points[2].x"; empty at the root.
+    const std::string& GetErrorPath() const;
+
+private:
+    bool Read(bool& out);
+    bool Read(std::string& out);
+    bool Read(JsonElem& out);
+    template<typename T>
+    bool Read(T& out);
+    template<typename T>
+    bool ReadNumber(T& out);
+    template<typename T>
+    bool ReadOptional(std::optional<T>& out);
+    template<typename V>
+    bool ReadVector(V& out);
+    template<typename M>
+    bool ReadMap(M& out);
+    template<typename T>
+    bool ReadStruct(T& out);
+
+    bool Mismatch();
+    bool ReadKey(std::string* key);
+    bool NextMember(bool* done);
+    void PrependPath(const std::string& segment);
+
+    std::string error_path_;
+};
+
+template<typename T>
+bool StructParser::Parse(const std::string& content, T& out)
+{
+    SetContent(content);
+    error_code_ = ParseErrorCode::kOK;
+    error_path_.clear();
+    ParseWhitespace();
+    if (content_[parse_pos_] == '\0')
+    {
+        error_code_ = ParseErrorCode::kExpectValue;
+        return false;
+    }
+    if (!Read(out))
+        return false;
+    ParseWhitespace();
+    if (parse_pos_ < content_.size())
+    {
+        error_code_ = ParseErrorCode::kRootNotSingular;
+        return false;
+    }
+    return true;
+}
+
+template<typename T>
+bool StructParser::Read(T& out)
+{
+    if constexpr (std::is_arithmetic_v<T>)
+        return ReadNumber(out);
+    else if constexpr (IsOptional<T>::value)
+        return ReadOptional(out);
+    else if constexpr (IsVector<T>::value)
+        return ReadVector(out);
+    else if constexpr (IsStringMap<T>::value)
+        return ReadMap(out);
+    else
+    {
+        static_assert(IsBound<T>::value,
+            "type is not registered with POLOJSON_FIELDS");
+        return ReadStruct(out);
+    }
+}
+
+template<typename T>
+bool StructParser::ReadNumber(T& out)
+{
+    char ch = content_[parse_pos_];
+    if (ch != '-' && !isdigit(static_cast<unsigned char>(ch)))
+        return Mismatch();
+    if constexpr (std::is_integral_v<T>)
+    {
+        // digits alone are converted exactly; with a fraction or exponent
+        // the number goes through a double, which is only trusted below
+        // 2^53 (9007199254740993.0 reads as 2^53)
+        size_t start_pos = parse_pos_;
+        if (!ScanNumber())
+            return false;
+        const char* last = content_.data() + parse_pos_;
+        T integer;
+        auto result = std::from_chars(content_.data() + start_pos, last,
+            integer);
+        if (result.ec == std::errc() && result.ptr == last)
+        {
+            out = integer;
+            return true;
+        }
+        if (result.ec == std::errc::result_out_of_range)
+            return Mismatch();
+        parse_pos_ = start_pos;
+    }
+    double value;
+    if (!ParseNumberRaw(&value))
+        return false;
+    if constexpr (std::is_integral_v<T>)
+    {
+        // max() rounds up to 2^digits as a double, so that bound is exclusive
+        if (value != std::trunc(value) || std::fabs(value) >= 0x1p53 ||
+            value < static_cast<double>(std::numeric_limits<T>::lowest()) ||
+            value >= std::ldexp(1.0, std::numeric_limits<T>::digits))
+            return Mismatch();
+    }
+    out = static_cast<T>(value);
+    return true;
+}
+
+template<typename T>
+bool StructParser::ReadOptional(std::optional<T>& out)
+{
+    if (content_[parse_pos_] == 'n')
+    {
+        SkipLiteral("null");
+        out.reset();
+        return error_code_ == ParseErrorCode::kOK;
+    }
+    if (!out)
+        out.emplace();
+    return Read(*out);
+}
+
+template<typename V>
+bool StructParser::ReadVector(V& out)
+{
+    if (content_[parse_pos_] != '[')
+        return Mismatch();
+    out.clear();
+    parse_pos_++;
+    ParseWhitespace();
+    if (content_[parse_pos_] == ']')
+    {
+        parse_pos_++;
+        return true;
+    }
+    for (;;)
+    {
+        out.emplace_back();
+        if (!Read(out.back()))
+        {
+            PrependPath("[" + std::to_string(out.size() - 1) + "]");
+            return false;
+        }
+        ParseWhitespace();
+        if (content_[parse_pos_] == ',')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else if (content_[parse_pos_] == ']')
+        {
+            parse_pos_++;
+            return true;
+        }
+        else
+        {
+            error_code_ = ParseErrorCode::kMissCommaOrSquareBracket;
+            return false;
+        }
+    }
+}
+
+template<typename M>
+bool StructParser::ReadMap(M& out)
+{
+    if (content_[parse_pos_] != '{')
+        return Mismatch();
+    out.clear();
+    parse_pos_++;
+    ParseWhitespace();
+    bool done = content_[parse_pos_] == '}';
+    if (done)
+        parse_pos_++;
+    while (!done)
+    {
+        std::string key;
+        if (!ReadKey(&key))
+            return false;
+        auto [slot, inserted] = out.try_emplace(std::move(key));
+        if (!inserted)
+        {
+            // the first of duplicate keys wins, as with Parser
+            SkipValue();
+            if (error_code_ != ParseErrorCode::kOK)
+                return false;
+        }
+        else if (!Read(slot->second))
+        {
+            PrependPath(slot->first);
+            return false;
+        }
+        if (!NextMember(&done))
+            return false;
+    }
+    return true;
+}
+
+template<typename T>
+bool StructParser::ReadStruct(T& out)
+{
+    constexpr auto fields = FieldsOf<T>();
+    constexpr size_t count = std::tuple_size_v<decltype(fields)>;
+    constexpr auto indices = std::make_index_sequence<count>();
+    static constexpr FieldTable<count> table(FieldHashes(fields, indices));
+
+    if (content_[parse_pos_] != '{')
+        return Mismatch();
+    parse_pos_++;
+    ParseWhitespace();
+    std::bitset<count> seen;
+    bool done = content_[parse_pos_] == '}';
+    if (done)
+        parse_pos_++;
+    while (!done)
+    {
+        std::string key;
+        if (!ReadKey(&key))
+            return false;
+
+        size_t index = table.Find(FieldHash(key));
+        if (index != count && !VisitField(fields, index,
+            [&](const auto& field) { return field.name == key; }, indices))
+            index = count;
+
+        if (index == count || seen.test(index))
+        {
+            // not a bound member, or a repeat of one (the first of duplicate
+            // keys wins, as with Parser); step over it without building
+            // anything
+            SkipValue();
+            if (error_code_ != ParseErrorCode::kOK)
+                return false;
+        }
+        else if (!VisitField(fields, index, [&](const auto& field)
+            {
+                return Read(out.*(field.member));
+            }, indices))
+        {
+            PrependPath(key);
+            return false;
+        }
+        else
+            seen.set(index);
+
+        if (!NextMember(&done))
+            return false;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (seen.test(i))
+            continue;
+        bool optional = false;
+        std::string_view name;
+        VisitField(fields, i, [&](const auto& field)
+            {
+                using M = typename std::decay_t<decltype(field)>::member_type;
+                optional = IsOptional<M>::value;
+                name = field.name;
+                return true;
+            }, indices);
+        if (!optional)
+        {
+            error_code_ = ParseErrorCode::kMissField;
+            error_path_ = std::string(name);
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+void Stringify(const T& value, std::string& out);
+
+template<typename T, size_t... I>
+void StringifyFields(const T& value, std::string& out,
+    std::index_sequence<I...>)
+{
+    constexpr auto fields = FieldsOf<T>();
+    // the first key is written without its leading comma
+    ((out.append(I == 0 ? std::get<I>(fields).key.substr(1) :
+        std::get<I>(fields).key),
+        Stringify(value.*(std::get<I>(fields).member), out)), ...);
+}
+
+// Appends the JSON text of a bound value to out. The output matches
+// JsonElem::Stringify for the equivalent tree, except that integer members
+// are written exactly instead of through a double.
+template<typename T>
+void Stringify(const T& value, std::string& out)
+{
+    if constexpr (std::is_same_v<T, bool>)
+        out += value ? "true" : "false";
+    else if constexpr (std::is_integral_v<T>)
+    {
+        char buffer[24];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+    else if constexpr (std::is_floating_point_v<T>)
+        StringifyNumber(static_cast<double>(value), out);
+    else if constexpr (std::is_same_v<T, std::string>)
+        StringifyString(value, out);
+    else if constexpr (std::is_same_v<T, JsonElem>)
+        value.Stringify(out);
+    else if constexpr (IsOptional<T>::value)
+    {
+        if (value)
+            Stringify(*value, out);
+        else
+            out += "null";
+    }
+    else if constexpr (IsVector<T>::value)
+    {
+        out += '[';
+        for (size_t i = 0; i < value.size(); ++i)
+        {
+            if (i > 0)
+                out += ',';
+            Stringify(value[i], out);
+        }
+        out += ']';
+    }
+    else if constexpr (IsStringMap<T>::value)
+    {
+        out += '{';
+        bool first = true;
+        for (const auto& e : value)
+        {
+            if (!first)
+                out += ',';
+            first = false;
+            StringifyString(e.first, out);
+            out += ':';
+            Stringify(e.second, out);
+        }
+        out += '}';
+    }
+    else
+    {
+        static_assert(IsBound<T>::value,
+            "type is not registered with POLOJSON_FIELDS");
+        constexpr size_t count = std::tuple_size_v<decltype(FieldsOf<T>())>;
+        out += '{';
+        StringifyFields(value, out, std::make_index_sequence<count>());
+        out += '}';
+    }
+}
+
+template<typename T>
+std::string Stringify(const T& value)
+{
+    std::string out;
+    Stringify(value, out);
+    return out;
+}
+}
+
+#define POLOJSON_EXPAND(x) x
+#define POLOJSON_FE_1(m, t, x) m(t, x)
+#define POLOJSON_FE_2(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_1(m, t, __VA_ARGS__))
+#define POLOJSON_FE_3(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_2(m, t, __VA_ARGS__))
+#define POLOJSON_FE_4(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_3(m, t, __VA_ARGS__))
+#define POLOJSON_FE_5(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_4(m, t, __VA_ARGS__))
+#define POLOJSON_FE_6(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_5(m, t, __VA_ARGS__))
+#define POLOJSON_FE_7(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_6(m, t, __VA_ARGS__))
+#define POLOJSON_FE_8(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_7(m, t, __VA_ARGS__))
+#define POLOJSON_FE_9(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_8(m, t, __VA_ARGS__))
+#define POLOJSON_FE_10(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_9(m, t, __VA_ARGS__))
+#define POLOJSON_FE_11(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_10(m, t, __VA_ARGS__))
+#define POLOJSON_FE_12(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_11(m, t, __VA_ARGS__))
+#define POLOJSON_FE_13(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_12(m, t, __VA_ARGS__))
+#define POLOJSON_FE_14(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_13(m, t, __VA_ARGS__))
+#define POLOJSON_FE_15(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_14(m, t, __VA_ARGS__))
+#define POLOJSON_FE_16(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_15(m, t, __VA_ARGS__))
+#define POLOJSON_FE_17(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_16(m, t, __VA_ARGS__))
+#define POLOJSON_FE_18(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_17(m, t, __VA_ARGS__))
+#define POLOJSON_FE_19(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_18(m, t, __VA_ARGS__))
+#define POLOJSON_FE_20(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_19(m, t, __VA_ARGS__))
+#define POLOJSON_FE_21(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_20(m, t, __VA_ARGS__))
+#define POLOJSON_FE_22(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_21(m, t, __VA_ARGS__))
+#define POLOJSON_FE_23(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_22(m, t, __VA_ARGS__))
+#define POLOJSON_FE_24(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_23(m, t, __VA_ARGS__))
+#define POLOJSON_FE_25(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_24(m, t, __VA_ARGS__))
+#define POLOJSON_FE_26(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_25(m, t, __VA_ARGS__))
+#define POLOJSON_FE_27(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_26(m, t, __VA_ARGS__))
+#define POLOJSON_FE_28(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_27(m, t, __VA_ARGS__))
+#define POLOJSON_FE_29(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_28(m, t, __VA_ARGS__))
+#define POLOJSON_FE_30(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_29(m, t, __VA_ARGS__))
+#define POLOJSON_FE_31(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_30(m, t, __VA_ARGS__))
+#define POLOJSON_FE_32(m, t, x, ...) m(t, x), POLOJSON_EXPAND(POLOJSON_FE_31(m, t, __VA_ARGS__))
+#define POLOJSON_FE_PICK(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, NAME, ...) NAME
+#define POLOJSON_FOR_EACH(m, t, ...) POLOJSON_EXPAND(POLOJSON_FE_PICK(__VA_ARGS__, \
+    POLOJSON_FE_32, POLOJSON_FE_31, POLOJSON_FE_30, POLOJSON_FE_29, POLOJSON_FE_28, POLOJSON_FE_27, \
+    POLOJSON_FE_26, POLOJSON_FE_25, POLOJSON_FE_24, POLOJSON_FE_23, POLOJSON_FE_22, POLOJSON_FE_21, \
+    POLOJSON_FE_20, POLOJSON_FE_19, POLOJSON_FE_18, POLOJSON_FE_17, POLOJSON_FE_16, POLOJSON_FE_15, \
+    POLOJSON_FE_14, POLOJSON_FE_13, POLOJSON_FE_12, POLOJSON_FE_11, POLOJSON_FE_10, POLOJSON_FE_9, \
+    POLOJSON_FE_8, POLOJSON_FE_7, POLOJSON_FE_6, POLOJSON_FE_5, POLOJSON_FE_4, POLOJSON_FE_3, \
+    POLOJSON_FE_2, POLOJSON_FE_1)(m, t, __VA_ARGS__))
+
+#define POLOJSON_FIELD_ENTRY_(Type, member) \
+    ::polojson::MakeField(#member, ",\"" #member "\":", &Type::member)
+
+#define POLOJSON_FIELDS(Type, ...) \
+    constexpr auto PolojsonFields(const Type*) \
+    { \
+        return std::make_tuple(POLOJSON_FOR_EACH(POLOJSON_FIELD_ENTRY_, Type, __VA_ARGS__)); \
+    }
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+#include "frozen.h"
+
+using namespace polojson;
+
+namespace
+{
+
+uint32_t KeyHash32(std::string_view key)
+{
+    uint64_t hash = KeyHash()(key);
+    return static_cast<uint32_t>(hash ^ (hash >> 32));
+}
+
+class FrozenWriter
+{
+public:
+    explicit FrozenWriter(std::string& out) :out_(out) {}
+
+    uint32_t Write(const JsonElem& elem);
+
+private:
+    uint32_t WriteString(std::string_view str);
+    uint32_t StartNode(JsonType type, uint32_t word, size_t table_words);
+    void SetU32(uint32_t offset, size_t index, uint32_t value);
+    uint32_t Offset() const;
+
+    std::string& out_;
+};
+
+uint32_t FrozenWriter::Offset() const
+{
+    if (out_.size() > UINT32_MAX)
+        throw std::length_error("frozen document larger than 4GB");
+    return static_cast<uint32_t>(out_.size());
+}
+
+// the node header and room for table_words words after it
+uint32_t FrozenWriter::StartNode(JsonType type, uint32_t word,
+    size_t table_words)
+{
+    out_.append((8 - out_.size() % 8) % 8, '\0');
+    uint32_t offset = Offset();
+    out_.append(8 + table_words * 4, '\0');
+    SetU32(offset, 0, static_cast<uint32_t>(type));
+    SetU32(offset, 1, word);
+    return offset;
+}
+
+void FrozenWriter::SetU32(uint32_t offset, size_t index, uint32_t value)
+{
+    memcpy(&out_[offset + index * 4], &value, sizeof(value));
+}
+
+uint32_t FrozenWriter::WriteString(std::string_view str)
+{
+    if (str.size() > UINT32_MAX)
+        throw std::length_error("frozen document larger than 4GB");
+    uint32_t offset = StartNode(JsonType::kString,
+        static_cast<uint32_t>(str.size()), 0);
+    out_ += str;
+    out_ += '\0';
+    return offset;
+}
+
+// parents are written before their children, whose offsets are filled in
+// as they are written
+uint32_t FrozenWriter::Write(const JsonElem& elem)
+{
+    switch (elem.type())
+    {
+    case JsonType::kNull:
+    case JsonType::kTrue:
+    case JsonType::kFalse:
+        return StartNode(elem.type(), 0, 0);
+    case JsonType::kNumber:
+    {
+        uint32_t offset = StartNode(JsonType::kNumber, 0, 2);
+        double value = elem.ToNumber();
+        memcpy(&out_[offset + 8], &value, sizeof(value));
+        return offset;
+    }
+    case JsonType::kString:
+        return WriteString(elem.ToString());
+    case JsonType::kArray:
+    {
+        const array_t& arr = elem.ToArray();
+        uint32_t offset = StartNode(JsonType::kArray,
+            static_cast<uint32_t>(arr.size()), arr.size());
+        for (size_t i = 0; i < arr.size(); ++i)
+        {
+            uint32_t child = Write(arr[i]);
+            SetU32(offset, 2 + i, child);
+        }
+        return offset;
+    }
+    case JsonType::kObject:
+    {
+        std::vector<const object_t::value_type*> entries;
+        entries.reserve(elem.ToObject().size());
+        for (const auto& e : elem.ToObject())
+            entries.push_back(&e);
+        std::sort(entries.begin(), entries.end(),
+            [](const object_t::value_type* a, const object_t::value_type* b)
+            {
+                return a->first < b->first;
+            });
+
+        size_t count = entries.size();
+        uint32_t offset = StartNode(JsonType::kObject,
+            static_cast<uint32_t>(count), count * 4);
+        std::vector<std::pair<uint32_t, uint32_t>> hashes;
+        hashes.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t key = WriteString(entries[i]->first);
+            SetU32(offset, 2 + i * 2, key);
+            uint32_t value = Write(entries[i]->second);
+            SetU32(offset, 3 + i * 2, value);
+            hashes.emplace_back(KeyHash32(entries[i]->first),
+                static_cast<uint32_t>(i));
+        }
+        std::sort(hashes.begin(), hashes.end());
+        for (size_t i = 0; i < count; ++i)
+        {
+            SetU32(offset, 2 + count * 2 + i * 2, hashes[i].first);
+            SetU32(offset, 3 + count * 2 + i * 2, hashes[i].second);
+        }
+        return offset;
+    }
+    default:
+        throw std::runtime_error("invalid type");
+    }
+}
+
+}
+
+FrozenDocument polojson::JsonElem::Freeze() const
+{
+    std::string block;
+    FrozenWriter writer(block);
+    writer.Write(*this);
+    block.append((8 - block.size() % 8) % 8, '\0');
+    block.shrink_to_fit();
+    return FrozenDocument(std::move(block));
+}
+
+polojson::FrozenDocument::FrozenDocument() :FrozenDocument(JsonElem(nullptr).Freeze())
+{
+}
+
+polojson::FrozenDocument::FrozenDocument(std::string block) :
+    block_(std::make_shared<const std::string>(std::move(block)))
+{
+}
+
+FrozenElem polojson::FrozenDocument::Root() const
+{
+    return FrozenElem(block_->data(), 0);
+}
+
+uint32_t polojson::FrozenElem::Word(size_t index) const
+{
+    uint32_t word;
+    memcpy(&word, base_ + offset_ + index * 4, sizeof(word));
+    return word;
+}
+
+JsonType polojson::FrozenElem::type() const noexcept
+{
+    return static_cast<JsonType>(Word(0));
+}
+
+bool polojson::FrozenElem::IsNull() const
+{
+    return type() == JsonType::kNull;
+}
+
+bool polojson::FrozenElem::IsBoolean() const
+{
+    return (type() == JsonType::kTrue) ||
+        (type() == JsonType::kFalse);
+}
+
+bool polojson::FrozenElem::IsNumber() const
+{
+    return type() == JsonType::kNumber;
+}
+
+bool polojson::FrozenElem::IsString() const
+{
+    return type() == JsonType::kString;
+}
+
+bool polojson::FrozenElem::IsArray() const
+{
+    return type() == JsonType::kArray;
+}
+
+bool polojson::FrozenElem::IsObject() const
+{
+    return type() == JsonType::kObject;
+}
+
+bool polojson::FrozenElem::ToBoolean() const
+{
+    assert(IsBoolean());
+    return type() == JsonType::kTrue;
+}
+
+double polojson::FrozenElem::ToNumber() const
+{
+    assert(IsNumber());
+    double value;
+    memcpy(&value, base_ + offset_ + 8, sizeof(value));
+    return value;
+}
+
+int64_t polojson::FrozenElem::ToInt64() const
+{
+    double value = ToNumber();
+    // 2^63 itself is not representable, hence < rather than <=
+    if (value >= -9223372036854775808.0 && value < 9223372036854775808.0 &&
+        value == static_cast<double>(static_cast<int64_t>(value)))
+        return static_cast<int64_t>(value);
+    throw std::range_error("Number is not an int64");
+}
+
+std::string_view polojson::FrozenElem::ToString() const
+{
+    assert(IsString());
+    return std::string_view(base_ + offset_ + 8, Word(1));
+}
+
+size_t polojson::FrozenElem::size() const
+{
+    assert(IsArray() || IsObject());
+    return Word(1);
+}
+
+FrozenElem polojson::FrozenElem::operator[](size_t i) const
+{
+    if (!IsArray())
+        throw std::runtime_error("Not a JsonArray object");
+    if (i >= size())
+        throw std::out_of_range("array index out of range");
+    return FrozenElem(base_, Word(2 + i));
+}
+
+FrozenElem polojson::FrozenElem::operator[](std::string_view key) const
+{
+    FrozenElem value(base_, 0);
+    if (!Find(key, &value))
+        throw std::out_of_range("key not found");
+    return value;
+}
+
+bool polojson::FrozenElem::Find(std::string_view key, FrozenElem* value) const
+{
+    if (!IsObject())
+        throw std::runtime_error("Not a JsonObject object");
+    size_t count = size();
+    size_t index = 2 + count * 2; //first word of the hash index
+    uint32_t hash = KeyHash32(key);
+    size_t low = 0, high = count;
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        if (Word(index + mid * 2) < hash)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    for (; low < count && Word(index + low * 2) == hash; ++low)
+    {
+        uint32_t entry = Word(index + low * 2 + 1);
+        if (KeyAt(entry) == key)
+        {
+            *value = ValueAt(entry);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string_view polojson::FrozenElem::KeyAt(size_t i) const
+{
+    assert(IsObject() && i < size());
+    return FrozenElem(base_, Word(2 + i * 2)).ToString();
+}
+
+FrozenElem polojson::FrozenElem::ValueAt(size_t i) const
+{
+    assert(IsObject() && i < size());
+    return FrozenElem(base_, Word(3 + i * 2));
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include "util.h"
+
+namespace polojson
+{
+
+// Frozen layout, built by JsonElem::Freeze(): one block, nodes 8 byte
+// aligned and in depth-first order, so a value is followed by everything
+// below it, and each key by its value. Offsets are relative to the block.
+//   literal u32 type, u32 0
+//   number  u32 type, u32 0, f64 value
+//   string  u32 type, u32 length, bytes, '\0'
+//   array   u32 type, u32 count, u32 element offsets[count]
+//   object  u32 type, u32 count, {u32 key offset, u32 value offset}[count]
+//           in key order, then {u32 key hash, u32 entry}[count] in hash
+//           order
+// A key lookup is a binary search over the hashes followed by one key
+// compare. Raw numbers are frozen as their double value.
+class FrozenElem
+{
+public:
+    FrozenElem(const char* base, uint32_t offset) :base_(base), offset_(offset) {}
+
+    JsonType type() const noexcept;
+
+    bool IsNull() const;
+    bool IsBoolean() const;
+    bool IsNumber() const;
+    bool IsString() const;
+    bool IsArray() const;
+    bool IsObject() const;
+
+    bool ToBoolean() const;
+    double ToNumber() const;
+    int64_t ToInt64() const; //throws std::range_error, as JsonElem does
+    std::string_view ToString() const;
+    size_t size() const; //element count of an array or object
+
+    // Like JsonElem, these throw std::out_of_range for a missing index/key.
+    FrozenElem operator[](size_t i) const;
+    FrozenElem operator[](std::string_view key) const;
+    bool Find(std::string_view key, FrozenElem* value) const;
+
+    // the i-th entry of an object, in key order
+    std::string_view KeyAt(size_t i) const;
+    FrozenElem ValueAt(size_t i) const;
+
+private:
+    uint32_t Word(size_t index) const;
+
+    const char* base_;
+    uint32_t offset_;
+};
+
+// An immutable document. Copies share the block, so a frozen document can
+// be handed to any number of threads; FrozenElem values stay valid while a
+// copy is alive.
+class FrozenDocument
+{
+public:
+    FrozenDocument(); //holds null
+
+    FrozenElem Root() const;
+    size_t size() const { return block_->size(); } //bytes of the block
+
+private:
+    friend class JsonElem;
+    explicit FrozenDocument(std::string block);
+
+    std::shared_ptr<const std::string> block_;
+};
+}
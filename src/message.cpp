@@ -0,0 +1,214 @@
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+#include "message.h"
+
+using namespace polojson;
+
+polojson::MessageSchema::MessageSchema(std::vector<MessageField> fields) :
+    fields_(std::move(fields)), seed_(0), mask_(0)
+{
+    size_t table_size = 1;
+    while (table_size < fields_.size() * 2)
+        table_size <<= 1;
+
+    // a random-ish seed finds a collision free table quickly once the
+    // table is at least twice the key count; grow it if that ever fails
+    for (;;)
+    {
+        mask_ = static_cast<uint32_t>(table_size - 1);
+        for (seed_ = 1; seed_ <= 4096; ++seed_)
+        {
+            table_.assign(table_size, 0);
+            bool collision = false;
+            for (size_t i = 0; i < fields_.size() && !collision; ++i)
+            {
+                const std::string& key = fields_[i].key;
+                uint32_t& slot = table_[Hash(key.data(), key.size()) & mask_];
+                if (slot != 0)
+                {
+                    if (fields_[slot - 1].key == key)
+                        throw std::invalid_argument("duplicate key " + key);
+                    collision = true;
+                }
+                slot = static_cast<uint32_t>(i + 1);
+            }
+            if (!collision)
+                return;
+        }
+        table_size <<= 1;
+    }
+}
+
+uint32_t polojson::MessageSchema::Hash(const char* key, size_t length) const
+{
+    uint32_t hash = 2166136261u ^ seed_;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= static_cast<unsigned char>(key[i]);
+        hash *= 16777619u;
+    }
+    return hash ^ (hash >> 15);
+}
+
+size_t polojson::MessageSchema::Find(const char* key, size_t length) const
+{
+    uint32_t slot = table_[Hash(key, length) & mask_];
+    if (slot == 0)
+        return npos;
+    const std::string& candidate = fields_[slot - 1].key;
+    if (candidate.size() != length || memcmp(candidate.data(), key, length) != 0)
+        return npos;
+    return slot - 1;
+}
+
+size_t polojson::MessageSchema::Find(const std::string& key) const
+{
+    return Find(key.data(), key.size());
+}
+
+const JsonElem& polojson::Message::operator[](size_t slot) const
+{
+    if (!present_.at(slot))
+        throw std::out_of_range("field not present");
+    return slots_[slot];
+}
+
+const JsonElem* polojson::Message::Get(const std::string& key) const
+{
+    if (schema_ != nullptr)
+    {
+        size_t slot = schema_->Find(key);
+        if (slot != MessageSchema::npos)
+            return present_[slot] ? &slots_[slot] : nullptr;
+    }
+    auto found = extra_.find(key);
+    return found == extra_.end() ? nullptr : &found->second;
+}
+
+const std::string& polojson::MessageParser::GetErrorKey() const
+{
+    return error_key_;
+}
+
+bool polojson::MessageParser::TypeMatches(JsonType expected, char first)
+{
+    switch (expected)
+    {
+    case JsonType::kNull:
+        return first == 'n';
+    case JsonType::kTrue:
+    case JsonType::kFalse:
+        return first == 't' || first == 'f';
+    case JsonType::kNumber:
+        return first == '-' || isdigit(static_cast<unsigned char>(first));
+    case JsonType::kString:
+        return first == '"';
+    case JsonType::kArray:
+        return first == '[';
+    case JsonType::kObject:
+        return first == '{';
+    default:
+        return false;
+    }
+}
+
+bool polojson::MessageParser::Parse(const std::string& content,
+    const MessageSchema& schema, Message* out)
+{
+    SetContent(content);
+    error_key_.clear();
+    out->schema_ = &schema;
+    out->slots_.resize(schema.size());
+    out->present_.assign(schema.size(), false);
+    out->extra_.clear();
+
+    ParseWhitespace();
+    if (content_[parse_pos_] != '{')
+    {
+        error_code_ = content_[parse_pos_] == '\0' ?
+            ParseErrorCode::kExpectValue : ParseErrorCode::kTypeMismatch;
+        return false;
+    }
+    parse_pos_++;
+    ParseWhitespace();
+    bool done = content_[parse_pos_] == '}';
+    if (done)
+        parse_pos_++;
+    while (!done)
+    {
+        if (content_[parse_pos_] != '"')
+        {
+            error_code_ = ParseErrorCode::kMissKey;
+            return false;
+        }
+        std::string key = ParseStringRaw();
+        if (error_code_ != ParseErrorCode::kOK)
+            return false;
+        ParseWhitespace();
+        if (content_[parse_pos_] != ':')
+        {
+            error_code_ = ParseErrorCode::kMissColon;
+            return false;
+        }
+        parse_pos_++;
+        ParseWhitespace();
+
+        size_t slot = schema.Find(key);
+        bool repeated = slot == MessageSchema::npos ?
+            out->extra_.count(key) != 0 : out->present_[slot];
+        if (repeated)
+        {
+            // the first value stays
+            SkipValue();
+            if (error_code_ != ParseErrorCode::kOK)
+                return false;
+        }
+        else if (slot == MessageSchema::npos)
+        {
+            JsonElem value = ParseValue();
+            if (error_code_ != ParseErrorCode::kOK)
+                return false;
+            out->extra_.try_emplace(string_t(key), std::move(value));
+        }
+        else
+        {
+            if (!TypeMatches(schema.field(slot).type, content_[parse_pos_]))
+            {
+                error_code_ = ParseErrorCode::kTypeMismatch;
+                error_key_ = std::move(key);
+                return false;
+            }
+            out->slots_[slot] = ParseValue();
+            if (error_code_ != ParseErrorCode::kOK)
+                return false;
+            out->present_[slot] = true;
+        }
+
+        ParseWhitespace();
+        if (content_[parse_pos_] == ',')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else if (content_[parse_pos_] == '}')
+        {
+            parse_pos_++;
+            done = true;
+        }
+        else
+        {
+            error_code_ = ParseErrorCode::kMissCommaOrCurlyBracket;
+            return false;
+        }
+    }
+
+    ParseWhitespace();
+    if (parse_pos_ < content_.size())
+    {
+        error_code_ = ParseErrorCode::kRootNotSingular;
+        return false;
+    }
+    error_code_ = ParseErrorCode::kOK;
+    return true;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "parse.h"
+
+namespace polojson
+{
+
+// One expected key of a message. kTrue and kFalse both stand for a boolean.
+struct MessageField
+{
+    std::string key;
+    JsonType type;
+};
+
+// The known key set of a message type. Registration searches a seed for
+// which every key lands in its own slot of a power of two table, so a key
+// lookup while parsing is one hash, one probe and one compare.
+class MessageSchema
+{
+public:
+    static const size_t npos = static_cast<size_t>(-1);
+
+    explicit MessageSchema(std::vector<MessageField> fields);
+
+    size_t size() const { return fields_.size(); }
+    const MessageField& field(size_t i) const { return fields_[i]; }
+    // index of key in the field list, npos for unknown keys
+    size_t Find(const char* key, size_t length) const;
+    size_t Find(const std::string& key) const;
+
+private:
+    uint32_t Hash(const char* key, size_t length) const;
+
+    std::vector<MessageField> fields_;
+    std::vector<uint32_t> table_; //field index + 1, 0 for an empty slot
+    uint32_t seed_;
+    uint32_t mask_;
+};
+
+// A parsed message: known keys in fixed slots, in schema order, and any
+// other keys in an ordinary object.
+class Message
+{
+public:
+    Message() :schema_(nullptr) {}
+
+    bool Has(size_t slot) const { return present_[slot]; }
+    const JsonElem& operator[](size_t slot) const;
+    // looks in the slots first, then in the unknown keys; null if absent
+    const JsonElem* Get(const std::string& key) const;
+    const object_t& extra() const { return extra_; }
+
+private:
+    friend class MessageParser;
+
+    const MessageSchema* schema_;
+    std::vector<JsonElem> slots_;
+    std::vector<bool> present_;
+    object_t extra_;
+};
+
+class MessageParser : public Parser
+{
+public:
+    using Parser::Parse;
+
+    // The root must be an object. A known key whose value has the wrong type
+    // fails with kTypeMismatch and GetErrorKey() names it; unknown keys go
+    // through the generic ParseValue path into Message::extra(). Of duplicate
+    // keys the first wins, as with Parser; later ones are only validated.
+    bool Parse(const std::string& content, const MessageSchema& schema,
+        Message* out);
+
+    const std::string& GetErrorKey() const;
+
+private:
+    static bool TypeMatches(JsonType expected, char first);
+
+    std::string error_key_;
+};
+}
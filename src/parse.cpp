@@ -1,10 +1,26 @@
+#include <algorithm>
 #include <cctype> 
 //int isdigit(int ch), the argument should first be converted to unsigned char
 #include <new> //new(std::nothrow)
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
 #include "parse.h"
 
 using namespace polojson;
 
+namespace
+{
+
+// first character of a JSON number
+bool IsNumberStart(char ch)
+{
+    return ch == '-' || isdigit(static_cast<unsigned char>(ch));
+}
+
+}
+
 polojson::Parser::~Parser()
 {
 
@@ -15,9 +31,9 @@ ParseErrorCode polojson::Parser::GetErrorCode() const
     return error_code_;
 }
 
-void polojson::Parser::SetContent(const std::string& content)
+void polojson::Parser::SetContent(std::string_view content)
 {
-	content_ = content;
+	content_.assign(content.data(), content.size()); //keeps the capacity
 	parse_pos_ = 0;
 }
 
@@ -41,7 +57,7 @@ JsonElem polojson::Parser::ParseLiteral(const std::string &literal,
 	JsonType type)
 {
 	assert(content_[parse_pos_] == literal[0]);
-    if (content_.substr(parse_pos_).find(literal) != 0)
+    if (content_.compare(parse_pos_, literal.size(), literal) != 0)
     {
         error_code_ = ParseErrorCode::kInvalidValue;
         return JsonElem{ nullptr };
@@ -51,16 +67,16 @@ JsonElem polojson::Parser::ParseLiteral(const std::string &literal,
     switch (type)
     {
     case polojson::JsonType::kNull:
-        result = JsonElem{ nullptr };
+        result = JsonElem{ nullptr, resource_ };
         break;
     case polojson::JsonType::kTrue:
-        result = JsonElem{ true };
+        result = JsonElem{ true, resource_ };
         break;
     case polojson::JsonType::kFalse:
-        result = JsonElem{ false };
+        result = JsonElem{ false, resource_ };
         break;
     default:
-        result = JsonElem{ nullptr };
+        result = JsonElem{ nullptr, resource_ };
         break;
     }
 	parse_pos_ += literal.size();
@@ -68,73 +84,111 @@ JsonElem polojson::Parser::ParseLiteral(const std::string &literal,
     return result;
 }
 
-JsonElem polojson::Parser::ParseNumber()
+bool polojson::Parser::ScanNumber()
 {
-	int start_pos = parse_pos_;
-    JsonElem result;
-	if (content_[parse_pos_] == '-')
-		parse_pos_++;
-	if (content_[parse_pos_] == '0')
-		parse_pos_++;
-	else
-	{
+    if (content_[parse_pos_] == '-')
+        parse_pos_++;
+    if (content_[parse_pos_] == '0')
+        parse_pos_++;
+    else
+    {
         if (!isdigit(static_cast<unsigned char>(content_[parse_pos_])))
         {
             error_code_ =  ParseErrorCode::kInvalidValue;
-            return JsonElem{ nullptr };
+            return false;
         }
-			
-		for (++parse_pos_;
-			isdigit(static_cast<unsigned char>(content_[parse_pos_]));
-			++parse_pos_);
-	}
 
-	if (content_[parse_pos_] == '.')
-	{
-		parse_pos_++;
+        for (++parse_pos_;
+            isdigit(static_cast<unsigned char>(content_[parse_pos_]));
+            ++parse_pos_);
+    }
+
+    if (content_[parse_pos_] == '.')
+    {
+        parse_pos_++;
         if (!isdigit(static_cast<unsigned char>(content_[parse_pos_])))
         {
             error_code_ = ParseErrorCode::kInvalidValue;
-            return JsonElem{ nullptr };
+            return false;
         }
-		for (++parse_pos_;
-			isdigit(static_cast<unsigned char>(content_[parse_pos_]));
-			++parse_pos_);
-	}
+        for (++parse_pos_;
+            isdigit(static_cast<unsigned char>(content_[parse_pos_]));
+            ++parse_pos_);
+    }
 
-	if (content_[parse_pos_] == 'e' || content_[parse_pos_] == 'E')
-	{
-		parse_pos_++;
-		if(content_[parse_pos_] == '-' || content_[parse_pos_] == '+')
-			parse_pos_++;
-		for (++parse_pos_;
-			isdigit(static_cast<unsigned char>(content_[parse_pos_]));
-			++parse_pos_);
-	}
+    if (content_[parse_pos_] == 'e' || content_[parse_pos_] == 'E')
+    {
+        parse_pos_++;
+        if(content_[parse_pos_] == '-' || content_[parse_pos_] == '+')
+            parse_pos_++;
+        if (!isdigit(static_cast<unsigned char>(content_[parse_pos_])))
+        {
+            error_code_ = ParseErrorCode::kInvalidValue;
+            return false;
+        }
+        for (++parse_pos_;
+            isdigit(static_cast<unsigned char>(content_[parse_pos_]));
+            ++parse_pos_);
+    }
 
-	int count = parse_pos_ - start_pos;
-	try
-	{
-        result = JsonElem{ std::stod(content_.substr(start_pos, count)) };
-	}
-	catch (const std::invalid_argument&)
-	{
+    error_code_ = ParseErrorCode::kOK;
+    return true;
+}
+
+bool polojson::Parser::ParseNumberRaw(double* value)
+{
+    size_t start_pos = parse_pos_;
+    if (!ScanNumber())
+        return false;
+
+    size_t count = parse_pos_ - start_pos;
+    // strtod instead of std::stod: stod also throws on underflow, which
+    // would reject valid denormals such as 4.9406564584124654e-324.
+    // The scanned text is copied out so strtod cannot read past it (e.g.
+    // "0x1"); a stack buffer covers all but absurdly long numbers.
+    char buffer[64];
+    const char* number_str = buffer;
+    if (count < sizeof(buffer))
+    {
+        memcpy(buffer, content_.data() + start_pos, count);
+        buffer[count] = '\0';
+    }
+    else
+    {
+        string_buffer_.assign(content_, start_pos, count);
+        number_str = string_buffer_.c_str();
+    }
+    char* end = nullptr;
+    errno = 0;
+    *value = strtod(number_str, &end);
+    if (end == number_str)
+    {
         error_code_ = ParseErrorCode::kInvalidValue;
-        return JsonElem{ nullptr };
-	}
-	catch (const std::out_of_range&)
-	{
+        return false;
+    }
+    if (errno == ERANGE && (*value == HUGE_VAL || *value == -HUGE_VAL))
+    {
         error_code_ = ParseErrorCode::kNumberTooBig;
-        return JsonElem{ nullptr };
-	}
-	catch (const std::exception&)
-	{
-        error_code_ = ParseErrorCode::kUnknown;
-        return JsonElem{ nullptr };
-	}
-
+        return false;
+    }
     error_code_ = ParseErrorCode::kOK;
-    return result;
+    return true;
+}
+
+JsonElem polojson::Parser::ParseNumber()
+{
+    if (options_.raw_numbers)
+    {
+        size_t start_pos = parse_pos_;
+        if (!ScanNumber())
+            return JsonElem{ nullptr };
+        return JsonElem::FromRawNumber(std::string_view(content_).substr(
+            start_pos, parse_pos_ - start_pos), resource_);
+    }
+    double value;
+    if (!ParseNumberRaw(&value))
+        return JsonElem{ nullptr };
+    return JsonElem{ value, resource_ };
 }
 
 int polojson::Parser::ParseHex4()
@@ -187,9 +241,47 @@ std::string polojson::Parser::EncodeUtf8(int n)
 	return utf8_str;
 }
 
-std::string polojson::Parser::ParseStringRaw()
+// a high surrogate must be followed by an escaped low one, the pair
+// combines into one code point
+int polojson::Parser::ParseUnicodeEscape()
 {
-    std::string str_tmp;
+    int u = ParseHex4();
+    if (u < 0)
+    {
+        error_code_ = ParseErrorCode::kInvalidUnicodeHex;
+        return -1;
+    }
+    if (u >= 0xD800 && u <= 0xDBFF)
+    {
+        if (content_[parse_pos_++] != '\\')
+        {
+            error_code_ = ParseErrorCode::kInvalidUnicodeSurrogate;
+            return -1;
+        }
+        if (content_[parse_pos_++] != 'u')
+        {
+            error_code_ = ParseErrorCode::kInvalidUnicodeSurrogate;
+            return -1;
+        }
+        int u2 = ParseHex4();
+        if (u2 < 0)
+        {
+            error_code_ = ParseErrorCode::kInvalidUnicodeHex;
+            return -1;
+        }
+        if (u2 < 0xDC00 || u2 > 0xDFFF)
+        {
+            error_code_ = ParseErrorCode::kInvalidUnicodeSurrogate;
+            return -1;
+        }
+        u = (((u - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
+    }
+    return u;
+}
+
+bool polojson::Parser::DecodeString(std::string& str_tmp)
+{
+    str_tmp.clear();
     assert(content_[parse_pos_] == '\"');
     parse_pos_++;
     ParseWhitespace();
@@ -200,7 +292,7 @@ std::string polojson::Parser::ParseStringRaw()
         {
         case '\"':
             error_code_ = ParseErrorCode::kOK;
-            return str_tmp;
+            return true;
         case '\\':
             switch (content_[parse_pos_++])
             {
@@ -214,68 +306,45 @@ std::string polojson::Parser::ParseStringRaw()
             case 't': str_tmp.push_back('\t'); break;
             case 'u':
             {
-                int u = ParseHex4();
+                int u = ParseUnicodeEscape();
                 if (u < 0)
-                {
-                    error_code_ = ParseErrorCode::kInvalidUnicodeHex;
-                    return "";
-                }
-                if (u >= 0xD800 && u <= 0xDBFF)
-                {
-                    if (content_[parse_pos_++] != '\\')
-                    {
-                        error_code_ = ParseErrorCode::kInvalidUnicodeSurrogate;
-                        return "";
-                    }
-                    if (content_[parse_pos_++] != 'u')
-                    {
-                        error_code_ = ParseErrorCode::kInvalidUnicodeSurrogate;
-                        return "";
-                    }
-                    int u2 = ParseHex4();
-                    if (u2 < 0)
-                    {
-                        error_code_ = ParseErrorCode::kInvalidUnicodeHex;
-                        return "";
-                    }
-                    if (u2 < 0xDC00 || u2 >0xDFFF)
-                    {
-                        error_code_ = ParseErrorCode::kInvalidUnicodeSurrogate;
-                        return "";
-                    }
-
-                    u = (((u - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
-
-                }
+                    return false;
                 str_tmp += EncodeUtf8(u);
                 break;
             }
             default:
                 error_code_ = ParseErrorCode::kInvalidStringEscape;
-                return "";
+                return false;
             }
             break;
         case '\0':
             error_code_ = ParseErrorCode::kMissQuotationMark;
-            return "";
+            return false;
         default:
             if (static_cast<unsigned char>(ch) < 0x20)
             {
                 error_code_ = ParseErrorCode::kInvalidStringChar;
-                return "";
+                return false;
             }
             str_tmp.push_back(ch);
         }
     }
 }
 
+std::string polojson::Parser::ParseStringRaw()
+{
+    std::string str_tmp;
+    if (!DecodeString(str_tmp))
+        return "";
+    return str_tmp;
+}
+
 JsonElem polojson::Parser::ParseString()
 {
      
-    std::string str_tmp = ParseStringRaw();
-    if (GetErrorCode() == ParseErrorCode::kOK)
+    if (DecodeString(string_buffer_))
     {
-        return JsonElem{ str_tmp };
+        return JsonElem{ std::string_view(string_buffer_), resource_ };
     }
     else
     {
@@ -285,7 +354,7 @@ JsonElem polojson::Parser::ParseString()
 
 JsonElem polojson::Parser::ParseArray()
 {
-    array_t array_tmp;
+    array_t array_tmp(resource_);
 	assert(content_[parse_pos_] == '[');
 	parse_pos_++;
 	ParseWhitespace();
@@ -293,9 +362,42 @@ JsonElem polojson::Parser::ParseArray()
 	{
 		parse_pos_++;
         error_code_ = ParseErrorCode::kOK;
-        return JsonElem{ array_tmp };
+        return JsonElem{ std::move(array_tmp) };
 	}
 
+    if (options_.number_arrays && !options_.raw_numbers &&
+        IsNumberStart(content_[parse_pos_]))
+    {
+        number_buffer_.clear();
+        for (;;)
+        {
+            double value;
+            if (!ParseNumberRaw(&value))
+                return JsonElem{ nullptr };
+            number_buffer_.push_back(value);
+            ParseWhitespace();
+            if (content_[parse_pos_] == ']')
+            {
+                parse_pos_++;
+                error_code_ = ParseErrorCode::kOK;
+                return JsonElem::FromNumbers(number_buffer_, resource_);
+            }
+            if (content_[parse_pos_] != ',')
+            {
+                error_code_ = ParseErrorCode::kMissCommaOrSquareBracket;
+                return JsonElem{ nullptr };
+            }
+            parse_pos_++;
+            ParseWhitespace();
+            if (!IsNumberStart(content_[parse_pos_]))
+                break;
+        }
+        // not all numbers: the ones so far become ordinary elements
+        array_tmp.reserve(number_buffer_.size() + 1);
+        for (double value : number_buffer_)
+            array_tmp.emplace_back(value, resource_);
+    }
+
 	for (;;)
 	{
         JsonElem temp_result = ParseValue();
@@ -303,7 +405,7 @@ JsonElem polojson::Parser::ParseArray()
         if (temp_error_code != ParseErrorCode::kOK)
             return temp_result;
         
-        array_tmp.emplace_back(temp_result);
+        array_tmp.emplace_back(std::move(temp_result));
 		ParseWhitespace();
 		if (content_[parse_pos_] == ',')
 		{
@@ -314,7 +416,7 @@ JsonElem polojson::Parser::ParseArray()
 		{
 			parse_pos_++;
 			error_code_ =  ParseErrorCode::kOK;
-            return JsonElem{ array_tmp };
+            return JsonElem{ std::move(array_tmp) };
 		}
         else
         {
@@ -326,7 +428,7 @@ JsonElem polojson::Parser::ParseArray()
 
 JsonElem polojson::Parser::ParseObject()
 {
-    object_t object_tmp;
+    object_t object_tmp(resource_);
     assert(content_[parse_pos_] == '{');
     parse_pos_++;
     ParseWhitespace();
@@ -334,7 +436,7 @@ JsonElem polojson::Parser::ParseObject()
     {
         parse_pos_++;
         error_code_ = ParseErrorCode::kOK;
-        return JsonElem{ object_tmp };
+        return JsonElem{ std::move(object_tmp) };
     }
 
     for (;;)
@@ -344,9 +446,10 @@ JsonElem polojson::Parser::ParseObject()
             error_code_ = ParseErrorCode::kMissKey;
             return JsonElem{ nullptr };
         }
-        std::string object_key_tmp = ParseStringRaw();
-        if (GetErrorCode() != ParseErrorCode::kOK)
+        if (!DecodeString(string_buffer_))
             return JsonElem{ nullptr };
+        // the buffer is reused by the value, so the key is built first
+        string_t object_key_tmp(string_buffer_, resource_);
         ParseWhitespace();
         if (content_[parse_pos_] == ':')
         {
@@ -362,7 +465,8 @@ JsonElem polojson::Parser::ParseObject()
         JsonElem object_value_tmp = ParseValue();
         if (GetErrorCode() != ParseErrorCode::kOK)
             return object_value_tmp;
-        object_tmp.emplace(std::make_pair(object_key_tmp, object_value_tmp));
+        object_tmp.emplace(std::move(object_key_tmp),
+            std::move(object_value_tmp));
         ParseWhitespace();
         if (content_[parse_pos_] == ',')
         {
@@ -373,7 +477,7 @@ JsonElem polojson::Parser::ParseObject()
         {
             parse_pos_++;
             error_code_ = ParseErrorCode::kOK;
-            return JsonElem{ object_tmp };
+            return JsonElem{ std::move(object_tmp) };
         }
         else
         {
@@ -408,20 +512,825 @@ JsonElem polojson::Parser::ParseValue()
 }
 
 
-JsonElem polojson::Parser::Parse(const std::string& content)
+void polojson::Parser::SkipLiteral(const char* literal)
 {
-    SetContent(content);
-	ParseWhitespace();
-    JsonElem temp_result = ParseValue();
-	if (GetErrorCode() == ParseErrorCode::kOK)
-	{
-		ParseWhitespace();
-		if (parse_pos_ < content_.size())
-		{
-			error_code_ = ParseErrorCode::kRootNotSingular;
+    size_t length = strlen(literal);
+    if (content_.compare(parse_pos_, length, literal) != 0)
+    {
+        error_code_ = ParseErrorCode::kInvalidValue;
+        return;
+    }
+    parse_pos_ += length;
+    error_code_ = ParseErrorCode::kOK;
+}
+
+void polojson::Parser::SkipString()
+{
+    // validates like ParseStringRaw but decodes nothing
+    assert(content_[parse_pos_] == '\"');
+    parse_pos_++;
+    for (;;)
+    {
+        char ch = content_[parse_pos_++];
+        switch (ch)
+        {
+        case '\"':
+            error_code_ = ParseErrorCode::kOK;
+            return;
+        case '\\':
+            switch (content_[parse_pos_++])
+            {
+            case '\"': case '\\': case '/': case 'b':
+            case 'f': case 'n': case 'r': case 't':
+                break;
+            case 'u':
+                if (ParseUnicodeEscape() < 0)
+                    return;
+                break;
+            default:
+                error_code_ = ParseErrorCode::kInvalidStringEscape;
+                return;
+            }
+            break;
+        case '\0':
+            parse_pos_--;
+            error_code_ = ParseErrorCode::kMissQuotationMark;
+            return;
+        default:
+            if (static_cast<unsigned char>(ch) < 0x20)
+            {
+                error_code_ = ParseErrorCode::kInvalidStringChar;
+                return;
+            }
+        }
+    }
+}
+
+void polojson::Parser::SkipValue()
+{
+    switch (content_[parse_pos_])
+    {
+    case 'n':
+        return SkipLiteral("null");
+    case 't':
+        return SkipLiteral("true");
+    case 'f':
+        return SkipLiteral("false");
+    case '"':
+        return SkipString();
+    case '\0':
+        error_code_ = ParseErrorCode::kExpectValue;
+        return;
+    case '[':
+    case '{':
+        break;
+    default:
+        ScanNumber();
+        return;
+    }
+
+    char close = content_[parse_pos_] == '[' ? ']' : '}';
+    bool is_object = close == '}';
+    parse_pos_++;
+    ParseWhitespace();
+    if (content_[parse_pos_] == close)
+    {
+        parse_pos_++;
+        error_code_ = ParseErrorCode::kOK;
+        return;
+    }
+    for (;;)
+    {
+        if (is_object)
+        {
+            if (content_[parse_pos_] != '"')
+            {
+                error_code_ = ParseErrorCode::kMissKey;
+                return;
+            }
+            SkipString();
+            if (error_code_ != ParseErrorCode::kOK)
+                return;
+            ParseWhitespace();
+            if (content_[parse_pos_] != ':')
+            {
+                error_code_ = ParseErrorCode::kMissColon;
+                return;
+            }
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        SkipValue();
+        if (error_code_ != ParseErrorCode::kOK)
+            return;
+        ParseWhitespace();
+        if (content_[parse_pos_] == ',')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else if (content_[parse_pos_] == close)
+        {
+            parse_pos_++;
+            error_code_ = ParseErrorCode::kOK;
+            return;
+        }
+        else
+        {
+            error_code_ = is_object ?
+                ParseErrorCode::kMissCommaOrCurlyBracket :
+                ParseErrorCode::kMissCommaOrSquareBracket;
+            return;
+        }
+    }
+}
+
+void polojson::Projection::Add(std::span<const std::string_view> path)
+{
+    uint32_t node = 0;
+    for (std::string_view key : path)
+    {
+        if (nodes_[node].keep_all)
+            return; //already kept whole
+        auto found = nodes_[node].children.find(key);
+        if (found == nodes_[node].children.end())
+        {
+            uint32_t child = static_cast<uint32_t>(nodes_.size());
+            nodes_[node].children.emplace(std::string(key), child);
+            nodes_.emplace_back();
+            node = child;
+        }
+        else
+            node = found->second;
+    }
+    nodes_[node].keep_all = true;
+    nodes_[node].children.clear();
+}
+
+void polojson::Projection::Add(std::string_view dotted_path)
+{
+    std::vector<std::string_view> path;
+    while (!dotted_path.empty())
+    {
+        size_t dot = dotted_path.find('.');
+        path.push_back(dotted_path.substr(0, dot));
+        if (dot == std::string_view::npos)
+            break;
+        dotted_path.remove_prefix(dot + 1);
+    }
+    Add(path);
+}
+
+JsonElem polojson::Parser::ParseArrayProjected(const Projection& projection,
+    uint32_t node)
+{
+    array_t array_tmp(resource_);
+    assert(content_[parse_pos_] == '[');
+    parse_pos_++;
+    ParseWhitespace();
+    if (content_[parse_pos_] == ']')
+    {
+        parse_pos_++;
+        error_code_ = ParseErrorCode::kOK;
+        return JsonElem{ std::move(array_tmp) };
+    }
+
+    for (;;)
+    {
+        JsonElem temp_result = ParseValueProjected(projection, node);
+        if (GetErrorCode() != ParseErrorCode::kOK)
+            return temp_result;
+        array_tmp.emplace_back(std::move(temp_result));
+        ParseWhitespace();
+        if (content_[parse_pos_] == ',')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else if (content_[parse_pos_] == ']')
+        {
+            parse_pos_++;
+            error_code_ = ParseErrorCode::kOK;
+            return JsonElem{ std::move(array_tmp) };
+        }
+        else
+        {
+            error_code_ = ParseErrorCode::kMissCommaOrSquareBracket;
             return JsonElem{ nullptr };
-		}
-	}
-	return temp_result;
+        }
+    }
 }
 
+JsonElem polojson::Parser::ParseObjectProjected(const Projection& projection,
+    uint32_t node)
+{
+    const Projection::Node& fields = projection.nodes_[node];
+    object_t object_tmp(resource_);
+    assert(content_[parse_pos_] == '{');
+    parse_pos_++;
+    ParseWhitespace();
+    if (content_[parse_pos_] == '}')
+    {
+        parse_pos_++;
+        error_code_ = ParseErrorCode::kOK;
+        return JsonElem{ std::move(object_tmp) };
+    }
+
+    for (;;)
+    {
+        if (content_[parse_pos_] != '"')
+        {
+            error_code_ = ParseErrorCode::kMissKey;
+            return JsonElem{ nullptr };
+        }
+        if (!DecodeString(string_buffer_))
+            return JsonElem{ nullptr };
+        auto field = fields.children.find(std::string_view(string_buffer_));
+        ParseWhitespace();
+        if (content_[parse_pos_] == ':')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else
+        {
+            error_code_ = ParseErrorCode::kMissColon;
+            return JsonElem{ nullptr };
+        }
+
+        if (field == fields.children.end())
+        {
+            SkipValue();
+            if (GetErrorCode() != ParseErrorCode::kOK)
+                return JsonElem{ nullptr };
+        }
+        else
+        {
+            string_t object_key_tmp(string_buffer_, resource_);
+            JsonElem object_value_tmp =
+                ParseValueProjected(projection, field->second);
+            if (GetErrorCode() != ParseErrorCode::kOK)
+                return object_value_tmp;
+            object_tmp.emplace(std::move(object_key_tmp),
+                std::move(object_value_tmp));
+        }
+        ParseWhitespace();
+        if (content_[parse_pos_] == ',')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else if (content_[parse_pos_] == '}')
+        {
+            parse_pos_++;
+            error_code_ = ParseErrorCode::kOK;
+            return JsonElem{ std::move(object_tmp) };
+        }
+        else
+        {
+            error_code_ = ParseErrorCode::kMissCommaOrCurlyBracket;
+            return JsonElem{ nullptr };
+        }
+    }
+}
+
+JsonElem polojson::Parser::ParseValueProjected(const Projection& projection,
+    uint32_t node)
+{
+    if (projection.nodes_[node].keep_all)
+        return ParseValue();
+    switch (content_[parse_pos_])
+    {
+    case '[':
+        return ParseArrayProjected(projection, node);
+    case '{':
+        return ParseObjectProjected(projection, node);
+    default:
+        return ParseValue();
+    }
+}
+
+JsonElem polojson::Parser::SchemaViolated(std::string_view keyword)
+{
+    error_code_ = ParseErrorCode::kSchemaViolation;
+    violation_.keyword = keyword;
+    return JsonElem{ nullptr };
+}
+
+JsonElem polojson::Parser::ParseArrayValidated(const Schema& schema,
+    uint32_t node)
+{
+    uint32_t items = schema.nodes_[node].items;
+    if (items == Schema::kNone || schema.nodes_[items].unconstrained)
+        return ParseArray();
+    array_t array_tmp(resource_);
+    assert(content_[parse_pos_] == '[');
+    parse_pos_++;
+    ParseWhitespace();
+    if (content_[parse_pos_] == ']')
+    {
+        parse_pos_++;
+        error_code_ = ParseErrorCode::kOK;
+        return JsonElem{ std::move(array_tmp) };
+    }
+
+    for (;;)
+    {
+        JsonElem temp_result = ParseValueValidated(schema, items);
+        if (GetErrorCode() != ParseErrorCode::kOK)
+        {
+            if (GetErrorCode() == ParseErrorCode::kSchemaViolation)
+                violation_tokens_.push_back(std::to_string(array_tmp.size()));
+            return temp_result;
+        }
+        array_tmp.emplace_back(std::move(temp_result));
+        ParseWhitespace();
+        if (content_[parse_pos_] == ',')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else if (content_[parse_pos_] == ']')
+        {
+            parse_pos_++;
+            error_code_ = ParseErrorCode::kOK;
+            return JsonElem{ std::move(array_tmp) };
+        }
+        else
+        {
+            error_code_ = ParseErrorCode::kMissCommaOrSquareBracket;
+            return JsonElem{ nullptr };
+        }
+    }
+}
+
+JsonElem polojson::Parser::ParseObjectValidated(const Schema& schema,
+    uint32_t node)
+{
+    const Schema::Node& constraints = schema.nodes_[node];
+    // required names seen so far, a slot each after the enclosing objects'
+    size_t seen = required_seen_.size();
+    required_seen_.resize(seen + constraints.required_count, 0);
+    object_t object_tmp(resource_);
+    assert(content_[parse_pos_] == '{');
+    parse_pos_++;
+    ParseWhitespace();
+    if (content_[parse_pos_] == '}')
+    {
+        parse_pos_++;
+        required_seen_.resize(seen);
+        if (constraints.required_count > 0)
+            return SchemaViolated("required");
+        error_code_ = ParseErrorCode::kOK;
+        return JsonElem{ std::move(object_tmp) };
+    }
+
+    for (;;)
+    {
+        if (content_[parse_pos_] != '"')
+        {
+            error_code_ = ParseErrorCode::kMissKey;
+            return JsonElem{ nullptr };
+        }
+        if (!DecodeString(string_buffer_))
+            return JsonElem{ nullptr };
+        // only names given in properties escape additionalProperties
+        auto found = constraints.properties.find(
+            std::string_view(string_buffer_));
+        bool listed = found != constraints.properties.end() &&
+            found->second.schema != Schema::kNone;
+        if (found != constraints.properties.end() &&
+            found->second.required != Schema::kNone)
+            required_seen_[seen + found->second.required] = 1;
+        uint32_t child = listed ? found->second.schema : constraints.additional;
+        string_t object_key_tmp(string_buffer_, resource_);
+        ParseWhitespace();
+        if (content_[parse_pos_] == ':')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else
+        {
+            error_code_ = ParseErrorCode::kMissColon;
+            return JsonElem{ nullptr };
+        }
+
+        JsonElem object_value_tmp;
+        if (child == Schema::kNone)
+            object_value_tmp = ParseValue();
+        else if (!listed && schema.nodes_[child].reject)
+            object_value_tmp = SchemaViolated("additionalProperties");
+        else
+            object_value_tmp = ParseValueValidated(schema, child);
+        if (GetErrorCode() != ParseErrorCode::kOK)
+        {
+            if (GetErrorCode() == ParseErrorCode::kSchemaViolation)
+                violation_tokens_.emplace_back(object_key_tmp);
+            return object_value_tmp;
+        }
+        object_tmp.emplace(std::move(object_key_tmp),
+            std::move(object_value_tmp));
+        ParseWhitespace();
+        if (content_[parse_pos_] == ',')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else if (content_[parse_pos_] == '}')
+        {
+            parse_pos_++;
+            bool complete = std::find(required_seen_.begin() + seen,
+                required_seen_.end(), 0) == required_seen_.end();
+            required_seen_.resize(seen);
+            if (!complete)
+                return SchemaViolated("required");
+            error_code_ = ParseErrorCode::kOK;
+            return JsonElem{ std::move(object_tmp) };
+        }
+        else
+        {
+            error_code_ = ParseErrorCode::kMissCommaOrCurlyBracket;
+            return JsonElem{ nullptr };
+        }
+    }
+}
+
+JsonElem polojson::Parser::ParseValueValidated(const Schema& schema,
+    uint32_t node)
+{
+    const Schema::Node& constraints = schema.nodes_[node];
+    if (constraints.unconstrained)
+        return ParseValue();
+    // a container of the wrong type is rejected before it is parsed
+    JsonElem value;
+    switch (content_[parse_pos_])
+    {
+    case '[':
+        if (!(constraints.types & Schema::kArrayBit))
+            return SchemaViolated(constraints.reject ? "false" : "type");
+        value = ParseArrayValidated(schema, node);
+        break;
+    case '{':
+        if (!(constraints.types & Schema::kObjectBit))
+            return SchemaViolated(constraints.reject ? "false" : "type");
+        value = ParseObjectValidated(schema, node);
+        break;
+    default:
+        value = ParseValue();
+        break;
+    }
+    if (GetErrorCode() != ParseErrorCode::kOK)
+        return value;
+    std::string_view keyword = schema.Check(constraints, value);
+    if (!keyword.empty())
+        return SchemaViolated(keyword);
+    return value;
+}
+
+const SchemaViolation& polojson::Parser::GetSchemaViolation() const
+{
+    return violation_;
+}
+
+void polojson::Parser::SetAllocationStats(AllocationStats* stats)
+{
+    stats_ = stats;
+}
+
+JsonElem polojson::Parser::Parse(std::string_view content)
+{
+    return Parse(content, std::pmr::get_default_resource());
+}
+
+JsonValue* polojson::Parser::ReusableNode(JsonElem& target, JsonType type)
+{
+    if (!target.value_ || target.value_.use_count() != 1 ||
+        target.type() != type || target.IsNumberArray())
+        return nullptr;
+    target.BeginWrite(); //not shared, so this only drops the caches
+    return target.value_.get();
+}
+
+void polojson::Parser::ParseNumberInto(JsonElem& target)
+{
+    JsonValue* node = ReusableNode(target, JsonType::kNumber);
+    if (node == nullptr ||
+        (node->RawNumber() != nullptr) != options_.raw_numbers)
+    {
+        target = ParseNumber();
+        return;
+    }
+    if (options_.raw_numbers)
+    {
+        size_t start_pos = parse_pos_;
+        if (ScanNumber())
+            static_cast<JsonRawNumber*>(node)->SetText(std::string_view(
+                content_).substr(start_pos, parse_pos_ - start_pos));
+        return;
+    }
+    double value;
+    if (ParseNumberRaw(&value))
+        static_cast<JsonNumber*>(node)->SetNumber(value);
+}
+
+void polojson::Parser::ParseStringInto(JsonElem& target)
+{
+    JsonValue* node = ReusableNode(target, JsonType::kString);
+    if (node == nullptr)
+    {
+        target = ParseString();
+        return;
+    }
+    if (DecodeString(string_buffer_))
+        static_cast<JsonString*>(node)->ToString().assign(string_buffer_);
+}
+
+void polojson::Parser::ParseArrayInto(JsonElem& target)
+{
+    JsonValue* node = ReusableNode(target, JsonType::kArray);
+    if (node == nullptr)
+    {
+        target = ParseArray();
+        return;
+    }
+    array_t& arr = static_cast<JsonArray*>(node)->ToArray();
+    size_t count = 0;
+    assert(content_[parse_pos_] == '[');
+    parse_pos_++;
+    ParseWhitespace();
+    if (content_[parse_pos_] == ']')
+    {
+        parse_pos_++;
+        arr.clear();
+        error_code_ = ParseErrorCode::kOK;
+        return;
+    }
+
+    for (;;)
+    {
+        if (count == arr.size())
+            arr.emplace_back();
+        ParseValueInto(arr[count++]);
+        if (error_code_ != ParseErrorCode::kOK)
+            return;
+        ParseWhitespace();
+        if (content_[parse_pos_] == ',')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else if (content_[parse_pos_] == ']')
+        {
+            parse_pos_++;
+            arr.erase(arr.begin() + count, arr.end());
+            error_code_ = ParseErrorCode::kOK;
+            return;
+        }
+        else
+        {
+            error_code_ = ParseErrorCode::kMissCommaOrSquareBracket;
+            return;
+        }
+    }
+}
+
+void polojson::Parser::ParseObjectInto(JsonElem& target)
+{
+    JsonValue* node = ReusableNode(target, JsonType::kObject);
+    if (node == nullptr)
+    {
+        target = ParseObject();
+        return;
+    }
+    object_t& obj = node->ToObject();
+    size_t start_pos = parse_pos_;
+    // entries written at this level are remembered in seen_ (shared by all
+    // levels, nested objects push above seen_start); the others are dropped
+    // at the end
+    size_t seen_start = seen_.size();
+    assert(content_[parse_pos_] == '{');
+    parse_pos_++;
+    ParseWhitespace();
+    bool done = content_[parse_pos_] == '}';
+    if (done)
+        parse_pos_++;
+    while (!done)
+    {
+        if (content_[parse_pos_] != '"')
+        {
+            error_code_ = ParseErrorCode::kMissKey;
+            break;
+        }
+        if (!DecodeString(string_buffer_))
+            break;
+        auto found = obj.find(string_buffer_);
+        if (found == obj.end())
+        {
+            found = obj.emplace(string_t(string_buffer_,
+                obj.get_allocator().resource()), JsonElem()).first;
+        }
+        ParseWhitespace();
+        if (content_[parse_pos_] != ':')
+        {
+            error_code_ = ParseErrorCode::kMissColon;
+            break;
+        }
+        parse_pos_++;
+        ParseWhitespace();
+        seen_.push_back(&found->second);
+        ParseValueInto(found->second);
+        if (error_code_ != ParseErrorCode::kOK)
+            break;
+        ParseWhitespace();
+        if (content_[parse_pos_] == ',')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else if (content_[parse_pos_] == '}')
+        {
+            parse_pos_++;
+            done = true;
+        }
+        else
+        {
+            error_code_ = ParseErrorCode::kMissCommaOrCurlyBracket;
+            break;
+        }
+    }
+    if (!done)
+    {
+        // a failed parse may leave an entry without a value
+        seen_.resize(seen_start);
+        for (auto iter = obj.begin(); iter != obj.end();)
+            iter = iter->second.value_ ? std::next(iter) : obj.erase(iter);
+        return;
+    }
+
+    auto first = seen_.begin() + seen_start;
+    std::sort(first, seen_.end());
+    size_t unique = std::unique(first, seen_.end()) - first;
+    if (first + unique != seen_.end())
+    {
+        // a duplicate key overwrote an earlier value, parse again so the
+        // first one wins as in Parse
+        seen_.resize(seen_start);
+        parse_pos_ = start_pos;
+        target = ParseObject();
+        return;
+    }
+    if (unique != obj.size())
+    {
+        for (auto iter = obj.begin(); iter != obj.end();)
+        {
+            if (std::binary_search(first, first + unique, &iter->second))
+                ++iter;
+            else
+                iter = obj.erase(iter);
+        }
+    }
+    seen_.resize(seen_start);
+    error_code_ = ParseErrorCode::kOK;
+}
+
+void polojson::Parser::ParseValueInto(JsonElem& target)
+{
+    switch (content_[parse_pos_])
+    {
+    case '"':
+        ParseStringInto(target);
+        return;
+    case '[':
+        ParseArrayInto(target);
+        return;
+    case '{':
+        ParseObjectInto(target);
+        return;
+    case 'n':
+    case 't':
+    case 'f':
+    {
+        // literal nodes hold nothing and are never written, so they are
+        // shared instead of allocated
+        static const char* const literals[] = { "null", "true", "false" };
+        static const JsonElem shared[] = { JsonElem{ nullptr },
+            JsonElem{ true }, JsonElem{ false } };
+        size_t i = content_[parse_pos_] == 'n' ? 0 :
+            content_[parse_pos_] == 't' ? 1 : 2;
+        SkipLiteral(literals[i]);
+        if (error_code_ != ParseErrorCode::kOK)
+        {
+            // a slot just added by the enclosing container needs a value
+            // to keep the partial document usable
+            if (!target.value_)
+                target = shared[0];
+            return;
+        }
+        if (!(target.value_ && target.type() == shared[i].type()))
+            target = shared[i];
+        return;
+    }
+    case '-':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+        ParseNumberInto(target);
+        return;
+    default:
+        target = ParseValue(); //reports the error
+        return;
+    }
+}
+
+bool polojson::Parser::ParseInto(JsonElem& target, std::string_view content,
+    std::pmr::memory_resource* resource)
+{
+    resource_ = resource;
+    if (stats_ != nullptr)
+        *stats_ = AllocationStats();
+    AllocationScope scope(stats_);
+    SetContent(content);
+    seen_.clear();
+    ParseWhitespace();
+    ParseValueInto(target);
+    if (error_code_ != ParseErrorCode::kOK)
+        return false;
+    ParseWhitespace();
+    if (parse_pos_ < content_.size())
+    {
+        error_code_ = ParseErrorCode::kRootNotSingular;
+        return false;
+    }
+    return true;
+}
+
+JsonElem polojson::Parser::Parse(std::string_view content,
+    std::pmr::memory_resource* resource)
+{
+    resource_ = resource;
+    if (stats_ != nullptr)
+        *stats_ = AllocationStats();
+    AllocationScope scope(stats_);
+    SetContent(content);
+	ParseWhitespace();
+    JsonElem temp_result = ParseValue();
+	if (GetErrorCode() == ParseErrorCode::kOK)
+	{
+		ParseWhitespace();
+		if (parse_pos_ < content_.size())
+		{
+			error_code_ = ParseErrorCode::kRootNotSingular;
+            return JsonElem{ nullptr };
+		}
+	}
+	return temp_result;
+}
+
+JsonElem polojson::Parser::Parse(std::string_view content,
+    const Schema& schema, std::pmr::memory_resource* resource)
+{
+    resource_ = resource;
+    if (stats_ != nullptr)
+        *stats_ = AllocationStats();
+    AllocationScope scope(stats_);
+    SetContent(content);
+    violation_ = SchemaViolation();
+    violation_tokens_.clear();
+    required_seen_.clear();
+    ParseWhitespace();
+    JsonElem temp_result = ParseValueValidated(schema, 0);
+    if (GetErrorCode() == ParseErrorCode::kSchemaViolation)
+        violation_.path = Schema::JoinPointer(violation_tokens_);
+    else if (GetErrorCode() == ParseErrorCode::kOK)
+    {
+        ParseWhitespace();
+        if (parse_pos_ < content_.size())
+        {
+            error_code_ = ParseErrorCode::kRootNotSingular;
+            return JsonElem{ nullptr };
+        }
+    }
+    return temp_result;
+}
+
+JsonElem polojson::Parser::Parse(std::string_view content,
+    const Projection& projection, std::pmr::memory_resource* resource)
+{
+    resource_ = resource;
+    if (stats_ != nullptr)
+        *stats_ = AllocationStats();
+    AllocationScope scope(stats_);
+    SetContent(content);
+    ParseWhitespace();
+    JsonElem temp_result = ParseValueProjected(projection, 0);
+    if (GetErrorCode() == ParseErrorCode::kOK)
+    {
+        ParseWhitespace();
+        if (parse_pos_ < content_.size())
+        {
+            error_code_ = ParseErrorCode::kRootNotSingular;
+            return JsonElem{ nullptr };
+        }
+    }
+    return temp_result;
+}
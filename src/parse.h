@@ -1,42 +1,163 @@
 #pragma once
 
+#include <span>
 #include <string>
+#include <string_view>
 #include <cassert>
+#include <unordered_map>
 #include <vector>
+#include "alloc.h"
+#include "schema.h"
 #include "util.h"
 
 namespace polojson
 {
 
+struct ParseOptions
+{
+    // keep numbers as their source text (JsonElem::FromRawNumber), deferring
+    // the conversion to the first ToNumber(); only syntax is checked, so an
+    // out of range number is not reported as kNumberTooBig
+    bool raw_numbers = false;
+    // store arrays whose elements are all numbers as contiguous doubles
+    // (JsonElem::FromNumbers), read with ToNumberArray(); other arrays,
+    // and every array when raw_numbers is set, are parsed as usual
+    bool number_arrays = false;
+};
+
+// The fields to keep when parsing with Parser::Parse(content, projection),
+// as a trie of object keys. A value on a path is kept whole. Arrays along
+// a path keep all their elements, each projected by the rest of the path,
+// and scalars found where the path expects an object are kept as they are.
+// Every other member is skipped without building, decoding or converting
+// it, and left out of the result.
+class Projection
+{
+public:
+    Projection() :nodes_(1) {}
+
+    // path is a list of keys from the root; an empty path keeps everything
+    void Add(std::span<const std::string_view> path);
+    // keys separated by dots, e.g. "user.address.city"
+    void Add(std::string_view dotted_path);
+
+private:
+    friend class Parser;
+
+    struct Node
+    {
+        std::unordered_map<std::string, uint32_t, KeyHash, KeyEqual> children;
+        bool keep_all = false;
+    };
+
+    std::vector<Node> nodes_; //nodes_[0] is the root
+};
+
 class Parser
 {
 public:
 
-	Parser() :content_(), parse_pos_(0){}
+	Parser() :content_(), parse_pos_(0), stats_(nullptr),
+		resource_(std::pmr::get_default_resource()),
+		error_code_(ParseErrorCode::kOK){}
+	explicit Parser(const ParseOptions& options) :content_(), parse_pos_(0),
+		options_(options), stats_(nullptr),
+		resource_(std::pmr::get_default_resource()),
+		error_code_(ParseErrorCode::kOK) {}
 	~Parser();
 
-	JsonElem Parse(const std::string& content);
+    // content is copied into a buffer the parser keeps between calls, which
+    // gives the scanner its terminating '\0'; it only has to live for the
+    // call.
+	JsonElem Parse(std::string_view content);
+    // Builds every node, string and container of the document from
+    // resource, e.g. a std::pmr::monotonic_buffer_resource per request that
+    // is released in one go. The resource must outlive the document.
+    JsonElem Parse(std::string_view content,
+        std::pmr::memory_resource* resource);
+
+    // Builds only the fields selected by projection, see Projection.
+    JsonElem Parse(std::string_view content, const Projection& projection,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // Checks the document against schema in the same pass and stops at
+    // the first violation, in document order: GetErrorCode() is then
+    // kSchemaViolation and GetSchemaViolation() tells where. Values the
+    // schema does not constrain are parsed as usual.
+    JsonElem Parse(std::string_view content, const Schema& schema,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+    const SchemaViolation& GetSchemaViolation() const;
+
+    // Parses into target, reusing its nodes, strings and container
+    // capacity wherever the new document has the same shape, so parsing
+    // messages of a stable shape stops allocating once warmed up. Nodes
+    // that are shared with other JsonElem copies are replaced, never
+    // written. New nodes come from resource, except null, true and false,
+    // which are shared. On an error target holds a partial document,
+    // which is still a valid tree.
+    bool ParseInto(JsonElem& target, std::string_view content,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 
     ParseErrorCode GetErrorCode() const;
-	void SetContent(const std::string& content);
+	void SetContent(std::string_view content);
+    // Every Parse resets *stats and counts its heap allocations into it,
+    // see alloc.h; nullptr stops counting.
+    void SetAllocationStats(AllocationStats* stats);
 
-private:
+protected:
     void ParseWhitespace();
 
     //ParseLiteral include parse true, false, null
     JsonElem ParseLiteral(const std::string&, JsonType);
+    bool ScanNumber(); //validate and step over a number, no conversion
+    bool ParseNumberRaw(double*);
     JsonElem ParseNumber();
     int ParseHex4();
+    int ParseUnicodeEscape(); //after \u, -1 with error_code_ set on failure
     std::string EncodeUtf8(int);
+    bool DecodeString(std::string& out); //out is cleared first
     std::string ParseStringRaw();
     JsonElem ParseString();
     JsonElem ParseArray();
     JsonElem ParseObject();
     JsonElem ParseValue();
 
-private:
+    //*Into variants of ParseInto, see there
+    JsonValue* ReusableNode(JsonElem& target, JsonType type);
+    void ParseNumberInto(JsonElem& target);
+    void ParseStringInto(JsonElem& target);
+    void ParseArrayInto(JsonElem& target);
+    void ParseObjectInto(JsonElem& target);
+    void ParseValueInto(JsonElem& target);
+
+    //*Projected variants of Parse(content, projection), node in the trie
+    JsonElem ParseArrayProjected(const Projection&, uint32_t node);
+    JsonElem ParseObjectProjected(const Projection&, uint32_t node);
+    JsonElem ParseValueProjected(const Projection&, uint32_t node);
+
+    //*Validated variants of Parse(content, schema), node in the schema
+    JsonElem ParseArrayValidated(const Schema& schema, uint32_t node);
+    JsonElem ParseObjectValidated(const Schema& schema, uint32_t node);
+    JsonElem ParseValueValidated(const Schema& schema, uint32_t node);
+    JsonElem SchemaViolated(std::string_view keyword);
+
+    //Skip* validate and step over a value without building it
+    void SkipLiteral(const char*);
+    void SkipString();
+    void SkipValue();
+
+protected:
 	std::string content_;
 	size_t parse_pos_;
+    ParseOptions options_;
+    AllocationStats* stats_;
+    std::pmr::memory_resource* resource_; //of the document being parsed
+    std::string string_buffer_; //decoded strings and keys, reused
+    std::vector<double> number_buffer_; //number array being parsed, reused
+    std::vector<const JsonElem*> seen_; //object entries written by ParseInto
+    SchemaViolation violation_;
+    std::vector<std::string> violation_tokens_; //from the value up
+    std::vector<char> required_seen_; //one slot per required name, per level
 
     ParseErrorCode error_code_;
 };
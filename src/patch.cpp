@@ -0,0 +1,275 @@
+#include <algorithm>
+#include "patch.h"
+
+using namespace polojson;
+
+namespace
+{
+    // a reference token that names an array element: 0 or digits without
+    // a leading zero
+    bool ArrayIndex(std::string_view token, size_t* index)
+    {
+        if (token.empty() || token.size() > 18 ||
+            (token[0] == '0' && token.size() > 1))
+            return false;
+        size_t value = 0;
+        for (char c : token)
+        {
+            if (c < '0' || c > '9')
+                return false;
+            value = value * 10 + (c - '0');
+        }
+        *index = value;
+        return true;
+    }
+}
+
+bool polojson::TextPatcher::AddEdit(std::string_view pointer, uint32_t edit)
+{
+    if (!pointer.empty() && pointer[0] != '/')
+        return false;
+    uint32_t node = 0;
+    size_t pos = 0;
+    std::string token;
+    while (pos < pointer.size())
+    {
+        if (nodes_[node].edit != kNone)
+            return false; //inside the target of an earlier edit
+        size_t end = pointer.find('/', pos + 1);
+        if (end == std::string_view::npos)
+            end = pointer.size();
+        token.clear();
+        for (size_t i = pos + 1; i < end; ++i)
+        {
+            if (pointer[i] != '~')
+                token += pointer[i];
+            else if (i + 1 < end && (pointer[i + 1] == '0' ||
+                pointer[i + 1] == '1'))
+                token += pointer[++i] == '0' ? '~' : '/';
+            else
+                return false;
+        }
+        uint32_t child = Child(node, token);
+        if (child == kNone)
+        {
+            child = static_cast<uint32_t>(nodes_.size());
+            nodes_.emplace_back();
+            nodes_[node].children.emplace_back(token, child);
+        }
+        node = child;
+        pos = end;
+    }
+    if (nodes_[node].edit != kNone || !nodes_[node].children.empty())
+        return false; //the same target twice, or one around another
+    nodes_[node].edit = edit;
+    leaves_.push_back(node);
+    return true;
+}
+
+uint32_t polojson::TextPatcher::Child(uint32_t node,
+    std::string_view token) const
+{
+    for (const auto& child : nodes_[node].children)
+    {
+        if (child.first == token)
+            return child.second;
+    }
+    return kNone;
+}
+
+void polojson::TextPatcher::PatchValue(uint32_t node)
+{
+    nodes_[node].reached = true;
+    if (nodes_[node].edit != kNone)
+    {
+        size_t begin = parse_pos_;
+        SkipValue();
+        if (error_code_ == ParseErrorCode::kOK)
+            splices_.push_back(Splice{ begin, parse_pos_,
+                nodes_[node].edit, std::string() });
+        return;
+    }
+    // targets below a scalar are never reached
+    switch (content_[parse_pos_])
+    {
+    case '{':
+        return PatchObject(node);
+    case '[':
+        return PatchArray(node);
+    default:
+        return SkipValue();
+    }
+}
+
+// edits for members or elements the text does not have, inserted in front
+// of the closing bracket at parse_pos_
+void polojson::TextPatcher::AddMissing(uint32_t node, bool empty,
+    bool is_object)
+{
+    for (const auto& child : nodes_[node].children)
+    {
+        Node& target = nodes_[child.second];
+        if (target.reached || target.edit == kNone ||
+            (!is_object && child.first != "-"))
+            continue;
+        std::string prefix = empty ? "" : ",";
+        if (is_object)
+        {
+            StringifyString(child.first, prefix);
+            prefix += ':';
+        }
+        splices_.push_back(Splice{ parse_pos_, parse_pos_, target.edit,
+            std::move(prefix) });
+        target.reached = true;
+        empty = false;
+    }
+}
+
+void polojson::TextPatcher::PatchObject(uint32_t node)
+{
+    assert(content_[parse_pos_] == '{');
+    parse_pos_++;
+    ParseWhitespace();
+    bool empty = content_[parse_pos_] == '}';
+    while (!empty)
+    {
+        if (content_[parse_pos_] != '"')
+        {
+            error_code_ = ParseErrorCode::kMissKey;
+            return;
+        }
+        if (!DecodeString(string_buffer_))
+            return;
+        uint32_t child = Child(node, string_buffer_);
+        ParseWhitespace();
+        if (content_[parse_pos_] != ':')
+        {
+            error_code_ = ParseErrorCode::kMissColon;
+            return;
+        }
+        parse_pos_++;
+        ParseWhitespace();
+        if (child != kNone)
+            PatchValue(child);
+        else
+            SkipValue();
+        if (error_code_ != ParseErrorCode::kOK)
+            return;
+        ParseWhitespace();
+        if (content_[parse_pos_] == ',')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else if (content_[parse_pos_] == '}')
+            break;
+        else
+        {
+            error_code_ = ParseErrorCode::kMissCommaOrCurlyBracket;
+            return;
+        }
+    }
+    AddMissing(node, empty, true);
+    parse_pos_++;
+    error_code_ = ParseErrorCode::kOK;
+}
+
+void polojson::TextPatcher::PatchArray(uint32_t node)
+{
+    // the indices wanted here, in the order the elements come
+    std::vector<std::pair<size_t, uint32_t>> wanted;
+    for (const auto& child : nodes_[node].children)
+    {
+        size_t index;
+        if (ArrayIndex(child.first, &index))
+            wanted.emplace_back(index, child.second);
+    }
+    std::sort(wanted.begin(), wanted.end());
+
+    assert(content_[parse_pos_] == '[');
+    parse_pos_++;
+    ParseWhitespace();
+    bool empty = content_[parse_pos_] == ']';
+    size_t next = 0;
+    for (size_t index = 0; !empty; ++index)
+    {
+        if (next < wanted.size() && wanted[next].first == index)
+            PatchValue(wanted[next++].second);
+        else
+            SkipValue();
+        if (error_code_ != ParseErrorCode::kOK)
+            return;
+        ParseWhitespace();
+        if (content_[parse_pos_] == ',')
+        {
+            parse_pos_++;
+            ParseWhitespace();
+        }
+        else if (content_[parse_pos_] == ']')
+            break;
+        else
+        {
+            error_code_ = ParseErrorCode::kMissCommaOrSquareBracket;
+            return;
+        }
+    }
+    AddMissing(node, empty, false);
+    parse_pos_++;
+    error_code_ = ParseErrorCode::kOK;
+}
+
+bool polojson::TextPatcher::Patch(std::string_view content,
+    std::span<const TextEdit> edits, std::string& out)
+{
+    nodes_.assign(1, Node());
+    leaves_.clear();
+    splices_.clear();
+    error_edit_ = 0;
+    for (size_t i = 0; i < edits.size(); ++i)
+    {
+        if (!AddEdit(edits[i].pointer, static_cast<uint32_t>(i)))
+        {
+            error_edit_ = i;
+            error_code_ = ParseErrorCode::kInvalidPointer;
+            return false;
+        }
+    }
+
+    SetContent(content);
+    ParseWhitespace();
+    PatchValue(0);
+    if (error_code_ != ParseErrorCode::kOK)
+        return false;
+    ParseWhitespace();
+    if (parse_pos_ < content_.size())
+    {
+        error_code_ = ParseErrorCode::kRootNotSingular;
+        return false;
+    }
+    for (size_t i = 0; i < leaves_.size(); ++i)
+    {
+        if (!nodes_[leaves_[i]].reached)
+        {
+            error_edit_ = i;
+            error_code_ = ParseErrorCode::kMissTarget;
+            return false;
+        }
+    }
+
+    out.clear();
+    size_t copied = 0;
+    for (const Splice& splice : splices_)
+    {
+        out.append(content_, copied, splice.begin - copied);
+        out += splice.prefix;
+        edits[splice.edit].value.Stringify(out);
+        copied = splice.end;
+    }
+    out.append(content_, copied);
+    return true;
+}
+
+size_t polojson::TextPatcher::GetErrorEdit() const
+{
+    return error_edit_;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "parse.h"
+
+namespace polojson
+{
+
+// Replace the value at pointer (RFC 6901, "" for the whole document) with
+// value. A missing member of an existing object is added at its end, and
+// the token "-" appends to an array.
+struct TextEdit
+{
+    std::string pointer;
+    JsonElem value;
+};
+
+// Applies edits to JSON text without building it: one scan validates the
+// text and steps over every value that holds no target, like SkipValue,
+// then the output is the input with the targets' text swapped for the
+// Stringify text of the new values. Everything else, whitespace and
+// escapes included, is copied byte for byte. Only the keys of objects on
+// the way to a target are decoded.
+class TextPatcher : public Parser
+{
+public:
+    using Parser::Parse;
+
+    // On success out holds the patched text; on an error it is left as it
+    // was. An edit whose pointer is malformed, or lies inside the target
+    // of another edit, fails with kInvalidPointer, one whose target does
+    // not exist with kMissTarget, and GetErrorEdit() tells which.
+    bool Patch(std::string_view content, std::span<const TextEdit> edits,
+        std::string& out);
+
+    size_t GetErrorEdit() const;
+
+private:
+    static const uint32_t kNone = UINT32_MAX;
+
+    // the edits' pointers as a trie of reference tokens
+    struct Node
+    {
+        std::vector<std::pair<std::string, uint32_t>> children;
+        uint32_t edit = kNone;
+        bool reached = false;
+    };
+
+    // text [begin, end) of content_ becomes prefix and the edit's value
+    struct Splice
+    {
+        size_t begin;
+        size_t end;
+        uint32_t edit;
+        std::string prefix;
+    };
+
+    bool AddEdit(std::string_view pointer, uint32_t edit);
+    uint32_t Child(uint32_t node, std::string_view token) const;
+    void PatchValue(uint32_t node);
+    void PatchObject(uint32_t node);
+    void PatchArray(uint32_t node);
+    void AddMissing(uint32_t node, bool empty, bool is_object);
+
+    std::vector<Node> nodes_; //nodes_[0] is the document
+    std::vector<uint32_t> leaves_; //node of each edit
+    std::vector<Splice> splices_; //in text order
+    size_t error_edit_ = 0;
+};
+}
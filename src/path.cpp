@@ -0,0 +1,618 @@
+#include <algorithm>
+#include <cstdlib>
+#include "path.h"
+
+using namespace polojson;
+
+namespace
+{
+    bool IsNameFirst(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+            static_cast<unsigned char>(c) >= 0x80;
+    }
+
+    bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    // an index counted from the end when negative, -1 when out of range
+    int64_t NormalizeIndex(int64_t index, int64_t size)
+    {
+        if (index < 0)
+            index += size;
+        return index >= 0 && index < size ? index : -1;
+    }
+}
+
+bool polojson::JsonPath::Compile(std::string_view expression)
+{
+    steps_.clear();
+    filters_.clear();
+    compiled_ = false;
+    text_ = expression;
+    pos_ = 0;
+    error_code_ = PathErrorCode::kOK;
+
+    if (!Consume("$"))
+        return Fail(PathErrorCode::kMissRoot);
+    while (pos_ < text_.size())
+    {
+        Step step;
+        if (Consume("."))
+        {
+            if (Consume("."))
+            {
+                step.descendant = true;
+                if (Consume("["))
+                {
+                    if (!ParseBracket(&step))
+                        return false;
+                    steps_.push_back(std::move(step));
+                    continue;
+                }
+            }
+            if (Consume("*"))
+                step.kind = StepKind::kWildcard;
+            else if (!ParseName(&step.name))
+                return Fail(PathErrorCode::kInvalidName);
+        }
+        else if (Consume("["))
+        {
+            if (!ParseBracket(&step))
+                return false;
+        }
+        else
+            return Fail(PathErrorCode::kInvalidSelector);
+        steps_.push_back(std::move(step));
+    }
+    text_ = std::string_view();
+    compiled_ = true;
+    return true;
+}
+
+PathErrorCode polojson::JsonPath::GetErrorCode() const
+{
+    return error_code_;
+}
+
+size_t polojson::JsonPath::GetErrorOffset() const
+{
+    return pos_;
+}
+
+bool polojson::JsonPath::Fail(PathErrorCode code)
+{
+    error_code_ = code;
+    steps_.clear();
+    filters_.clear();
+    text_ = std::string_view();
+    return false;
+}
+
+void polojson::JsonPath::SkipWhitespace()
+{
+    while (pos_ < text_.size() && (text_[pos_] == ' ' || text_[pos_] == '\t' ||
+        text_[pos_] == '\n' || text_[pos_] == '\r'))
+        ++pos_;
+}
+
+bool polojson::JsonPath::Consume(std::string_view token)
+{
+    if (text_.substr(pos_, token.size()) != token)
+        return false;
+    pos_ += token.size();
+    return true;
+}
+
+bool polojson::JsonPath::ParseName(std::string* name)
+{
+    if (pos_ >= text_.size() || !IsNameFirst(text_[pos_]))
+        return false;
+    size_t begin = pos_;
+    while (pos_ < text_.size() && (IsNameFirst(text_[pos_]) ||
+        IsDigit(text_[pos_])))
+        ++pos_;
+    name->assign(text_.substr(begin, pos_ - begin));
+    return true;
+}
+
+bool polojson::JsonPath::ParseQuoted(std::string* text)
+{
+    char quote = text_[pos_++];
+    text->clear();
+    while (pos_ < text_.size())
+    {
+        char c = text_[pos_++];
+        if (c == quote)
+            return true;
+        if (c != '\\')
+        {
+            text->push_back(c);
+            continue;
+        }
+        if (pos_ >= text_.size())
+            return false;
+        switch (text_[pos_++])
+        {
+        case '\\': text->push_back('\\'); break;
+        case '/': text->push_back('/'); break;
+        case '\'': text->push_back('\''); break;
+        case '"': text->push_back('"'); break;
+        case 'b': text->push_back('\b'); break;
+        case 'f': text->push_back('\f'); break;
+        case 'n': text->push_back('\n'); break;
+        case 'r': text->push_back('\r'); break;
+        case 't': text->push_back('\t'); break;
+        default: return false;
+        }
+    }
+    return false;
+}
+
+bool polojson::JsonPath::ParseInteger(int64_t* value)
+{
+    const char* begin = text_.data() + pos_;
+    const char* end = text_.data() + text_.size();
+    auto parsed = std::from_chars(begin, end, *value);
+    if (parsed.ec != std::errc())
+        return false;
+    pos_ += parsed.ptr - begin;
+    return true;
+}
+
+// after the '['
+bool polojson::JsonPath::ParseBracket(Step* step)
+{
+    SkipWhitespace();
+    if (Consume("*"))
+        step->kind = StepKind::kWildcard;
+    else if (pos_ < text_.size() && (text_[pos_] == '\'' || text_[pos_] == '"'))
+    {
+        step->kind = StepKind::kName;
+        if (!ParseQuoted(&step->name))
+            return Fail(PathErrorCode::kInvalidSelector);
+    }
+    else if (Consume("?"))
+    {
+        step->kind = StepKind::kFilter;
+        if (!ParseFilterOr(&step->filter))
+            return false;
+    }
+    else if (!ParseSlice(step))
+        return false;
+    SkipWhitespace();
+    if (pos_ >= text_.size())
+        return Fail(PathErrorCode::kMissBracket);
+    if (!Consume("]"))
+        return Fail(PathErrorCode::kInvalidSelector);
+    return true;
+}
+
+// [n] or [start:end:step]
+bool polojson::JsonPath::ParseSlice(Step* step)
+{
+    step->has_start = ParseInteger(&step->index);
+    SkipWhitespace();
+    if (!Consume(":"))
+    {
+        if (!step->has_start)
+            return Fail(PathErrorCode::kInvalidSelector);
+        step->kind = StepKind::kIndex;
+        return true;
+    }
+    step->kind = StepKind::kSlice;
+    SkipWhitespace();
+    step->has_end = ParseInteger(&step->end);
+    SkipWhitespace();
+    if (Consume(":"))
+    {
+        SkipWhitespace();
+        ParseInteger(&step->stride);
+    }
+    return true;
+}
+
+bool polojson::JsonPath::ParseFilterOr(size_t* node)
+{
+    if (!ParseFilterAnd(node))
+        return false;
+    for (;;)
+    {
+        SkipWhitespace();
+        if (!Consume("||"))
+            return true;
+        size_t right;
+        if (!ParseFilterAnd(&right))
+            return false;
+        *node = AddFilter(FilterOp::kOr, *node, right);
+    }
+}
+
+bool polojson::JsonPath::ParseFilterAnd(size_t* node)
+{
+    if (!ParseFilterUnary(node))
+        return false;
+    for (;;)
+    {
+        SkipWhitespace();
+        if (!Consume("&&"))
+            return true;
+        size_t right;
+        if (!ParseFilterUnary(&right))
+            return false;
+        *node = AddFilter(FilterOp::kAnd, *node, right);
+    }
+}
+
+bool polojson::JsonPath::ParseFilterUnary(size_t* node)
+{
+    SkipWhitespace();
+    if (Consume("!"))
+    {
+        size_t operand;
+        if (!ParseFilterUnary(&operand))
+            return false;
+        *node = AddFilter(FilterOp::kNot, operand, 0);
+        return true;
+    }
+    if (Consume("("))
+    {
+        if (!ParseFilterOr(node))
+            return false;
+        SkipWhitespace();
+        if (pos_ >= text_.size())
+            return Fail(PathErrorCode::kMissBracket);
+        if (!Consume(")"))
+            return Fail(PathErrorCode::kInvalidFilter);
+        return true;
+    }
+    return ParseComparison(node);
+}
+
+// @path, or @path op literal
+bool polojson::JsonPath::ParseComparison(size_t* node)
+{
+    FilterNode filter;
+    if (!Consume("@"))
+        return Fail(PathErrorCode::kInvalidFilter);
+    for (;;)
+    {
+        Step step;
+        if (Consume("."))
+        {
+            if (!ParseName(&step.name))
+                return Fail(PathErrorCode::kInvalidFilter);
+        }
+        else if (Consume("["))
+        {
+            SkipWhitespace();
+            if (pos_ < text_.size() && (text_[pos_] == '\'' || text_[pos_] == '"'))
+            {
+                if (!ParseQuoted(&step.name))
+                    return Fail(PathErrorCode::kInvalidFilter);
+            }
+            else if (ParseInteger(&step.index))
+                step.kind = StepKind::kIndex;
+            else
+                return Fail(PathErrorCode::kInvalidFilter);
+            SkipWhitespace();
+            if (!Consume("]"))
+                return Fail(PathErrorCode::kInvalidFilter);
+        }
+        else
+            break;
+        filter.path.push_back(std::move(step));
+    }
+
+    static const struct
+    {
+        std::string_view token;
+        FilterOp op;
+    } kOperators[] = {
+        { "==", FilterOp::kEqual }, { "!=", FilterOp::kNotEqual },
+        { "<=", FilterOp::kLessEqual }, { ">=", FilterOp::kGreaterEqual },
+        { "<", FilterOp::kLess }, { ">", FilterOp::kGreater }
+    };
+    SkipWhitespace();
+    for (const auto& op : kOperators)
+    {
+        if (Consume(op.token))
+        {
+            filter.op = op.op;
+            SkipWhitespace();
+            if (!ParseLiteral(&filter.literal))
+                return Fail(PathErrorCode::kInvalidFilter);
+            break;
+        }
+    }
+    filters_.push_back(std::move(filter));
+    *node = filters_.size() - 1;
+    return true;
+}
+
+bool polojson::JsonPath::ParseLiteral(JsonElem* literal)
+{
+    if (pos_ >= text_.size())
+        return false;
+    if (text_[pos_] == '\'' || text_[pos_] == '"')
+    {
+        std::string text;
+        if (!ParseQuoted(&text))
+            return false;
+        *literal = JsonElem(std::string_view(text));
+        return true;
+    }
+    if (Consume("true"))
+        *literal = JsonElem(true);
+    else if (Consume("false"))
+        *literal = JsonElem(false);
+    else if (Consume("null"))
+        *literal = JsonElem(nullptr);
+    else
+    {
+        size_t begin = pos_;
+        while (pos_ < text_.size() && (IsDigit(text_[pos_]) ||
+            text_[pos_] == '-' || text_[pos_] == '+' || text_[pos_] == '.' ||
+            text_[pos_] == 'e' || text_[pos_] == 'E'))
+            ++pos_;
+        std::string number(text_.substr(begin, pos_ - begin));
+        char* end;
+        double value = strtod(number.c_str(), &end);
+        if (number.empty() || *end != '\0')
+            return false;
+        *literal = JsonElem(value);
+    }
+    return true;
+}
+
+size_t polojson::JsonPath::AddFilter(FilterOp op, size_t left, size_t right)
+{
+    FilterNode filter;
+    filter.op = op;
+    filter.left = left;
+    filter.right = right;
+    filters_.push_back(std::move(filter));
+    return filters_.size() - 1;
+}
+
+std::vector<const JsonElem*> polojson::JsonPath::Evaluate(
+    const JsonElem& root) const
+{
+    std::vector<const JsonElem*> out;
+    Evaluate(root, out);
+    return out;
+}
+
+void polojson::JsonPath::Evaluate(const JsonElem& root,
+    std::vector<const JsonElem*>& out) const
+{
+    Scratch scratch;
+    Run(root, out, scratch);
+}
+
+std::vector<std::vector<const JsonElem*>> polojson::JsonPath::EvaluateBatch(
+    std::span<const JsonElem> documents) const
+{
+    std::vector<std::vector<const JsonElem*>> results(documents.size());
+    Scratch scratch;
+    for (size_t i = 0; i < documents.size(); ++i)
+        Run(documents[i], results[i], scratch);
+    return results;
+}
+
+void polojson::JsonPath::Run(const JsonElem& root,
+    std::vector<const JsonElem*>& out, Scratch& scratch) const
+{
+    if (!compiled_)
+        return;
+    scratch.current.assign(1, &root);
+    for (size_t i = 0; i < steps_.size(); ++i)
+    {
+        // the last step writes straight into out
+        std::vector<const JsonElem*>& next =
+            i + 1 == steps_.size() ? out : scratch.next;
+        if (&next == &scratch.next)
+            next.clear();
+        for (const JsonElem* elem : scratch.current)
+        {
+            if (steps_[i].descendant)
+                SelectDescendants(steps_[i], *elem, next);
+            else
+                Select(steps_[i], *elem, next);
+        }
+        if (&next == &out)
+            return;
+        std::swap(scratch.current, scratch.next);
+        if (scratch.current.empty())
+            return;
+    }
+    out.push_back(&root); //the path is just "$"
+}
+
+void polojson::JsonPath::Select(const Step& step, const JsonElem& elem,
+    std::vector<const JsonElem*>& out) const
+{
+    JsonType type = elem.type();
+    switch (step.kind)
+    {
+    case StepKind::kName:
+        if (type == JsonType::kObject)
+        {
+            const object_t& object = elem.ToObject();
+            auto found = object.find(std::string_view(step.name));
+            if (found != object.end())
+                out.push_back(&found->second);
+        }
+        break;
+    case StepKind::kWildcard:
+        if (type == JsonType::kArray)
+        {
+            for (const JsonElem& e : elem.ToArray())
+                out.push_back(&e);
+        }
+        else if (type == JsonType::kObject)
+        {
+            for (const auto& member : elem.ToObject())
+                out.push_back(&member.second);
+        }
+        break;
+    case StepKind::kIndex:
+        if (type == JsonType::kArray)
+        {
+            const array_t& array = elem.ToArray();
+            int64_t i = NormalizeIndex(step.index,
+                static_cast<int64_t>(array.size()));
+            if (i >= 0)
+                out.push_back(&array[i]);
+        }
+        break;
+    case StepKind::kSlice:
+        if (type == JsonType::kArray && step.stride != 0)
+        {
+            // bounds as in RFC 9535, section 2.3.4.2.2
+            const array_t& array = elem.ToArray();
+            int64_t n = static_cast<int64_t>(array.size());
+            auto bound = [n](int64_t i, int64_t low, int64_t high)
+            {
+                return std::clamp(i < 0 ? n + i : i, low, high);
+            };
+            if (step.stride > 0)
+            {
+                int64_t lower = bound(step.has_start ? step.index : 0, 0, n);
+                int64_t upper = bound(step.has_end ? step.end : n, 0, n);
+                for (int64_t i = lower; i < upper; i += step.stride)
+                    out.push_back(&array[i]);
+            }
+            else
+            {
+                int64_t upper = bound(step.has_start ? step.index : n - 1,
+                    -1, n - 1);
+                int64_t lower = bound(step.has_end ? step.end : -n - 1,
+                    -1, n - 1);
+                for (int64_t i = upper; i > lower; i += step.stride)
+                    out.push_back(&array[i]);
+            }
+        }
+        break;
+    case StepKind::kFilter:
+        if (type == JsonType::kArray)
+        {
+            for (const JsonElem& e : elem.ToArray())
+                if (Test(step.filter, e))
+                    out.push_back(&e);
+        }
+        else if (type == JsonType::kObject)
+        {
+            for (const auto& member : elem.ToObject())
+                if (Test(step.filter, member.second))
+                    out.push_back(&member.second);
+        }
+        break;
+    }
+}
+
+// elem itself first, then everything below it
+void polojson::JsonPath::SelectDescendants(const Step& step,
+    const JsonElem& elem, std::vector<const JsonElem*>& out) const
+{
+    Select(step, elem, out);
+    JsonType type = elem.type();
+    if (type == JsonType::kArray)
+    {
+        for (const JsonElem& e : elem.ToArray())
+            SelectDescendants(step, e, out);
+    }
+    else if (type == JsonType::kObject)
+    {
+        for (const auto& member : elem.ToObject())
+            SelectDescendants(step, member.second, out);
+    }
+}
+
+bool polojson::JsonPath::Test(size_t node, const JsonElem& current) const
+{
+    const FilterNode& filter = filters_[node];
+    switch (filter.op)
+    {
+    case FilterOp::kNot:
+        return !Test(filter.left, current);
+    case FilterOp::kAnd:
+        return Test(filter.left, current) && Test(filter.right, current);
+    case FilterOp::kOr:
+        return Test(filter.left, current) || Test(filter.right, current);
+    default:
+        break;
+    }
+
+    const JsonElem* value = Resolve(filter.path, current);
+    switch (filter.op)
+    {
+    case FilterOp::kExists:
+        return value != nullptr;
+    case FilterOp::kEqual:
+        return value != nullptr && *value == filter.literal;
+    case FilterOp::kNotEqual:
+        return value == nullptr || *value != filter.literal;
+    default:
+        break;
+    }
+    if (value == nullptr)
+        return false;
+
+    int order;
+    JsonType type = value->type();
+    JsonType literal_type = filter.literal.type();
+    if (type == JsonType::kNumber && literal_type == JsonType::kNumber)
+    {
+        double a = value->ToNumber(), b = filter.literal.ToNumber();
+        if (a != a || b != b) //NaN is unordered
+            return false;
+        order = a < b ? -1 : (a > b ? 1 : 0);
+    }
+    else if (type == JsonType::kString && literal_type == JsonType::kString)
+        order = value->ToString().compare(filter.literal.ToString());
+    else
+        return false;
+
+    switch (filter.op)
+    {
+    case FilterOp::kLess: return order < 0;
+    case FilterOp::kLessEqual: return order <= 0;
+    case FilterOp::kGreater: return order > 0;
+    case FilterOp::kGreaterEqual: return order >= 0;
+    default: return false;
+    }
+}
+
+const JsonElem* polojson::JsonPath::Resolve(const std::vector<Step>& path,
+    const JsonElem& current)
+{
+    const JsonElem* elem = &current;
+    for (const Step& step : path)
+    {
+        if (step.kind == StepKind::kName)
+        {
+            if (elem->type() != JsonType::kObject)
+                return nullptr;
+            const object_t& object = elem->ToObject();
+            auto found = object.find(std::string_view(step.name));
+            if (found == object.end())
+                return nullptr;
+            elem = &found->second;
+        }
+        else
+        {
+            if (elem->type() != JsonType::kArray)
+                return nullptr;
+            const array_t& array = elem->ToArray();
+            int64_t i = NormalizeIndex(step.index,
+                static_cast<int64_t>(array.size()));
+            if (i < 0)
+                return nullptr;
+            elem = &array[i];
+        }
+    }
+    return elem;
+}
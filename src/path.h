@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "util.h"
+
+namespace polojson
+{
+
+enum class PathErrorCode
+{
+    kOK = 0,
+    kMissRoot,          // the expression does not start with '$'
+    kInvalidName,       // a .name that is empty or has invalid characters
+    kInvalidSelector,   // a malformed [...] selector
+    kInvalidFilter,     // a malformed ?(...) expression
+    kMissBracket        // an unclosed [ or (
+};
+
+// A JSONPath expression compiled into a list of steps. The supported
+// subset of RFC 9535:
+//   $                      the root
+//   .name  ['name']        member of an object
+//   .*  [*]                every member or element
+//   ..name  ..*  ..[...]   the selector applied to a node and all nodes below
+//   [n]                    element of an array, negative counts from the end
+//   [start:end:step]       slice of an array, each part optional
+//   [?(expr)]  [?expr]     members or elements for which expr holds
+// A filter compares a relative path (@, @.name, @['name'], @[n]) with a
+// number, string, true, false or null literal using == != < <= > >=, or
+// tests that it exists; tests combine with !, && and || and parentheses.
+// Only numbers with numbers and strings with strings are ordered, and a
+// missing value equals nothing.
+//
+// Results point into the document and stay valid as long as it is not
+// modified. Object members come in the iteration order of the object.
+// Evaluation does not change the JsonPath, so one compiled path can be
+// used from many threads.
+class JsonPath
+{
+public:
+    JsonPath() :compiled_(false), pos_(0), error_code_(PathErrorCode::kOK) {}
+
+    bool Compile(std::string_view expression);
+    PathErrorCode GetErrorCode() const;
+    // offset in the expression where compiling stopped
+    size_t GetErrorOffset() const;
+
+    // nothing matches before a successful Compile
+    std::vector<const JsonElem*> Evaluate(const JsonElem& root) const;
+    void Evaluate(const JsonElem& root,
+        std::vector<const JsonElem*>& out) const; //append to out
+    // results[i] belongs to documents[i]; scratch space is reused across
+    // the documents
+    std::vector<std::vector<const JsonElem*>> EvaluateBatch(
+        std::span<const JsonElem> documents) const;
+
+private:
+    enum class StepKind { kName, kWildcard, kIndex, kSlice, kFilter };
+
+    struct Step
+    {
+        StepKind kind = StepKind::kName;
+        bool descendant = false; //..selector
+        std::string name;
+        int64_t index = 0; //kIndex, and the start of a kSlice
+        int64_t end = 0;
+        int64_t stride = 1;
+        bool has_start = false;
+        bool has_end = false;
+        size_t filter = 0; //root of the expression in filters_
+    };
+
+    enum class FilterOp
+    {
+        kExists, kEqual, kNotEqual, kLess, kLessEqual, kGreater,
+        kGreaterEqual, kNot, kAnd, kOr
+    };
+
+    struct FilterNode
+    {
+        FilterOp op = FilterOp::kExists;
+        size_t left = 0;  //operands of kNot, kAnd and kOr
+        size_t right = 0;
+        std::vector<Step> path; //relative path, kName and kIndex steps only
+        JsonElem literal;
+    };
+
+    struct Scratch
+    {
+        std::vector<const JsonElem*> current;
+        std::vector<const JsonElem*> next;
+    };
+
+    bool Fail(PathErrorCode code);
+    void SkipWhitespace();
+    bool Consume(std::string_view token);
+    bool ParseName(std::string* name);
+    bool ParseQuoted(std::string* text);
+    bool ParseInteger(int64_t* value);
+    bool ParseBracket(Step* step);
+    bool ParseSlice(Step* step);
+    bool ParseFilterOr(size_t* node);
+    bool ParseFilterAnd(size_t* node);
+    bool ParseFilterUnary(size_t* node);
+    bool ParseComparison(size_t* node);
+    bool ParseLiteral(JsonElem* literal);
+    size_t AddFilter(FilterOp op, size_t left, size_t right);
+
+    void Run(const JsonElem& root, std::vector<const JsonElem*>& out,
+        Scratch& scratch) const;
+    void Select(const Step& step, const JsonElem& elem,
+        std::vector<const JsonElem*>& out) const;
+    void SelectDescendants(const Step& step, const JsonElem& elem,
+        std::vector<const JsonElem*>& out) const;
+    bool Test(size_t node, const JsonElem& current) const;
+    static const JsonElem* Resolve(const std::vector<Step>& path,
+        const JsonElem& current);
+
+    std::vector<Step> steps_;
+    std::vector<FilterNode> filters_;
+    bool compiled_;
+
+    std::string_view text_; //the expression, while compiling
+    size_t pos_;
+    PathErrorCode error_code_;
+};
+}
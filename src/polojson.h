@@ -8,6 +8,7 @@ class Json
 {
 public:
     Json() :parser_(new Parser()) {};
+    explicit Json(const ParseOptions& options) :parser_(new Parser(options)) {}
 	~Json() { delete parser_; }
 	JsonElem Parse(const std::string& content);
     Json& operator=(const Json& other);
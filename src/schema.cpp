@@ -0,0 +1,375 @@
+#include <algorithm>
+#include <cmath>
+#include "schema.h"
+
+using namespace polojson;
+
+namespace
+{
+    // appends /token, escaped as JSON Pointer requires
+    void AppendPointerToken(std::string& pointer, std::string_view token)
+    {
+        pointer += '/';
+        for (char c : token)
+        {
+            if (c == '~')
+                pointer += "~0";
+            else if (c == '/')
+                pointer += "~1";
+            else
+                pointer += c;
+        }
+    }
+
+    // a UTF-8 string counts its lead bytes
+    size_t CodePoints(std::string_view str)
+    {
+        size_t count = 0;
+        for (char c : str)
+            count += (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+        return count;
+    }
+
+    bool IsCount(const JsonElem& value)
+    {
+        return value.IsNumber() && value.ToNumber() >= 0 &&
+            value.ToNumber() == std::floor(value.ToNumber());
+    }
+}
+
+bool polojson::Schema::Compile(const JsonElem& schema)
+{
+    nodes_.assign(1, Node());
+    error_path_.clear();
+    error_code_ = SchemaErrorCode::kOK;
+    if (!CompileNode(schema, 0))
+    {
+        nodes_.assign(1, Node());
+        return false;
+    }
+    return true;
+}
+
+SchemaErrorCode polojson::Schema::GetErrorCode() const
+{
+    return error_code_;
+}
+
+const std::string& polojson::Schema::GetErrorPath() const
+{
+    return error_path_;
+}
+
+bool polojson::Schema::Fail(SchemaErrorCode code)
+{
+    error_code_ = code;
+    return false;
+}
+
+bool polojson::Schema::CompileNode(const JsonElem& schema, uint32_t index)
+{
+    if (schema.IsBoolean())
+    {
+        if (!schema.ToBoolean())
+        {
+            nodes_[index].unconstrained = false;
+            nodes_[index].reject = true;
+            nodes_[index].types = 0;
+        }
+        return true;
+    }
+    if (!schema.IsObject())
+        return Fail(SchemaErrorCode::kNotSchema);
+    for (const auto& member : schema.ToObject())
+    {
+        size_t length = error_path_.size();
+        AppendPointerToken(error_path_, member.first);
+        if (!CompileKeyword(member.first, member.second, index))
+            return false;
+        error_path_.resize(length);
+    }
+    return true;
+}
+
+// nodes_ may grow below, so the node is looked up again after each child
+bool polojson::Schema::CompileKeyword(std::string_view keyword,
+    const JsonElem& value, uint32_t index)
+{
+    static const std::string_view kIgnored[] = { "$schema", "$id",
+        "$comment", "title", "description", "default", "examples" };
+    if (std::find(std::begin(kIgnored), std::end(kIgnored), keyword) !=
+        std::end(kIgnored))
+        return true;
+    nodes_[index].unconstrained = false;
+
+    if (keyword == "type")
+    {
+        static const std::pair<std::string_view, uint8_t> kTypes[] = {
+            { "null", kNullBit }, { "boolean", kBooleanBit },
+            { "integer", kIntegerBit }, { "number", kNumberBit },
+            { "string", kStringBit }, { "array", kArrayBit },
+            { "object", kObjectBit } };
+        uint8_t types = 0;
+        auto add = [&](const JsonElem& name)
+        {
+            if (!name.IsString())
+                return false;
+            for (const auto& type : kTypes)
+            {
+                if (type.first == name.ToString())
+                {
+                    types |= type.second;
+                    return true;
+                }
+            }
+            return false;
+        };
+        if (value.IsString())
+        {
+            if (!add(value))
+                return Fail(SchemaErrorCode::kInvalidKeyword);
+        }
+        else if (value.IsArray() && !value.ToArray().empty())
+        {
+            for (const JsonElem& name : value.ToArray())
+            {
+                if (!add(name))
+                    return Fail(SchemaErrorCode::kInvalidKeyword);
+            }
+        }
+        else
+            return Fail(SchemaErrorCode::kInvalidKeyword);
+        nodes_[index].types = types;
+    }
+    else if (keyword == "enum")
+    {
+        if (!value.IsArray())
+            return Fail(SchemaErrorCode::kInvalidKeyword);
+        nodes_[index].has_enum = true;
+        nodes_[index].enum_values.assign(value.ToArray().begin(),
+            value.ToArray().end());
+    }
+    else if (keyword == "minimum" || keyword == "maximum")
+    {
+        if (!value.IsNumber())
+            return Fail(SchemaErrorCode::kInvalidKeyword);
+        Node& node = nodes_[index];
+        if (keyword == "minimum")
+        {
+            node.has_minimum = true;
+            node.minimum = value.ToNumber();
+        }
+        else
+        {
+            node.has_maximum = true;
+            node.maximum = value.ToNumber();
+        }
+    }
+    else if (keyword == "minLength" || keyword == "maxLength")
+    {
+        if (!IsCount(value))
+            return Fail(SchemaErrorCode::kInvalidKeyword);
+        // saturates for lengths no string can have
+        size_t length = value.ToNumber() >= 1.8e19 ? SIZE_MAX :
+            static_cast<size_t>(value.ToNumber());
+        if (keyword == "minLength")
+            nodes_[index].min_length = length;
+        else
+            nodes_[index].max_length = length;
+    }
+    else if (keyword == "items")
+    {
+        if (value.IsArray()) //the tuple form of older drafts
+            return Fail(SchemaErrorCode::kUnsupportedKeyword);
+        uint32_t child;
+        if (!CompileChild(value, &child))
+            return false;
+        nodes_[index].items = child;
+    }
+    else if (keyword == "properties")
+    {
+        if (!value.IsObject())
+            return Fail(SchemaErrorCode::kInvalidKeyword);
+        for (const auto& member : value.ToObject())
+        {
+            size_t length = error_path_.size();
+            AppendPointerToken(error_path_, member.first);
+            uint32_t child;
+            if (!CompileChild(member.second, &child))
+                return false;
+            nodes_[index].properties[std::string(member.first)].schema = child;
+            error_path_.resize(length);
+        }
+    }
+    else if (keyword == "required")
+    {
+        if (!value.IsArray())
+            return Fail(SchemaErrorCode::kInvalidKeyword);
+        Node& node = nodes_[index];
+        for (const JsonElem& name : value.ToArray())
+        {
+            if (!name.IsString())
+                return Fail(SchemaErrorCode::kInvalidKeyword);
+            Property& property = node.properties[std::string(name.ToString())];
+            if (property.required == kNone)
+                property.required = node.required_count++;
+        }
+    }
+    else if (keyword == "additionalProperties")
+    {
+        uint32_t child;
+        if (!CompileChild(value, &child))
+            return false;
+        nodes_[index].additional = child;
+    }
+    else
+        return Fail(SchemaErrorCode::kUnsupportedKeyword);
+    return true;
+}
+
+bool polojson::Schema::CompileChild(const JsonElem& schema, uint32_t* child)
+{
+    *child = static_cast<uint32_t>(nodes_.size());
+    nodes_.emplace_back();
+    return CompileNode(schema, *child);
+}
+
+std::string_view polojson::Schema::Check(const Node& node,
+    const JsonElem& value) const
+{
+    if (node.reject)
+        return "false";
+    switch (value.type())
+    {
+    case JsonType::kNull:
+        if (!(node.types & kNullBit))
+            return "type";
+        break;
+    case JsonType::kTrue:
+    case JsonType::kFalse:
+        if (!(node.types & kBooleanBit))
+            return "type";
+        break;
+    case JsonType::kNumber:
+    {
+        double number = value.ToNumber();
+        if (!(node.types & kNumberBit) &&
+            !((node.types & kIntegerBit) && number == std::floor(number)))
+            return "type";
+        if (node.has_minimum && number < node.minimum)
+            return "minimum";
+        if (node.has_maximum && number > node.maximum)
+            return "maximum";
+        break;
+    }
+    case JsonType::kString:
+    {
+        if (!(node.types & kStringBit))
+            return "type";
+        if (node.min_length > 0 || node.max_length != SIZE_MAX)
+        {
+            size_t length = CodePoints(value.ToString());
+            if (length < node.min_length)
+                return "minLength";
+            if (length > node.max_length)
+                return "maxLength";
+        }
+        break;
+    }
+    case JsonType::kArray:
+        if (!(node.types & kArrayBit))
+            return "type";
+        break;
+    case JsonType::kObject:
+        if (!(node.types & kObjectBit))
+            return "type";
+        break;
+    }
+    if (node.has_enum && std::find(node.enum_values.begin(),
+        node.enum_values.end(), value) == node.enum_values.end())
+        return "enum";
+    return {};
+}
+
+std::string_view polojson::Schema::ValidateNode(uint32_t index,
+    const JsonElem& value, std::vector<std::string>& tokens) const
+{
+    const Node& node = nodes_[index];
+    if (node.unconstrained)
+        return {};
+    std::string_view keyword = Check(node, value);
+    if (!keyword.empty())
+        return keyword;
+
+    if (value.IsArray() && node.items != kNone &&
+        !nodes_[node.items].unconstrained)
+    {
+        const array_t& elements = value.ToArray();
+        for (size_t i = 0; i < elements.size(); ++i)
+        {
+            keyword = ValidateNode(node.items, elements[i], tokens);
+            if (!keyword.empty())
+            {
+                tokens.push_back(std::to_string(i));
+                return keyword;
+            }
+        }
+    }
+    else if (value.IsObject())
+    {
+        const object_t& members = value.ToObject();
+        if (node.required_count > 0)
+        {
+            for (const auto& property : node.properties)
+            {
+                if (property.second.required != kNone &&
+                    members.find(property.first) == members.end())
+                    return "required";
+            }
+        }
+        for (const auto& member : members)
+        {
+            // only names given in properties escape additionalProperties
+            auto found = node.properties.find(member.first);
+            bool listed = found != node.properties.end() &&
+                found->second.schema != kNone;
+            uint32_t child = listed ? found->second.schema : node.additional;
+            if (child == kNone)
+                continue;
+            if (!listed && nodes_[child].reject)
+                keyword = "additionalProperties";
+            else
+                keyword = ValidateNode(child, member.second, tokens);
+            if (!keyword.empty())
+            {
+                tokens.emplace_back(member.first);
+                return keyword;
+            }
+        }
+    }
+    return {};
+}
+
+bool polojson::Schema::Validate(const JsonElem& document,
+    SchemaViolation* violation) const
+{
+    std::vector<std::string> tokens;
+    std::string_view keyword = ValidateNode(0, document, tokens);
+    if (keyword.empty())
+        return true;
+    if (violation != nullptr)
+    {
+        violation->path = JoinPointer(tokens);
+        violation->keyword = keyword;
+    }
+    return false;
+}
+
+std::string polojson::Schema::JoinPointer(
+    const std::vector<std::string>& tokens)
+{
+    std::string pointer;
+    for (auto token = tokens.rbegin(); token != tokens.rend(); ++token)
+        AppendPointerToken(pointer, *token);
+    return pointer;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "util.h"
+
+namespace polojson
+{
+
+enum class SchemaErrorCode
+{
+    kOK = 0,
+    kNotSchema,         // a schema that is neither an object nor a boolean
+    kInvalidKeyword,    // a supported keyword with a value of the wrong kind
+    kUnsupportedKeyword // a keyword outside the supported subset
+};
+
+// Where a document first broke its schema.
+struct SchemaViolation
+{
+    std::string path;         // JSON Pointer to the value, "" for the root
+    std::string_view keyword; // the keyword it failed, e.g. "maxLength"
+};
+
+// A JSON Schema compiled for checking documents, either while they are
+// parsed with Parser::Parse(content, schema) or afterwards with Validate.
+// The supported subset:
+//   true, false                     anything, nothing
+//   type                            a name or a list of names; "integer"
+//                                   is a number without a fraction
+//   enum                            a list of values, compared with ==
+//   minimum, maximum                inclusive bounds of a number
+//   minLength, maxLength            in code points, for a string
+//   items                           schema of every array element
+//   properties, required            members of an object
+//   additionalProperties            schema of the members not in properties
+// $schema, $id, $comment, title, description, default and examples are
+// ignored; any other keyword fails Compile with kUnsupportedKeyword
+// rather than being skipped, so a schema never checks less than it says.
+// A compiled schema is not changed by checking, so one can be used from
+// many threads.
+class Schema
+{
+public:
+    Schema() :nodes_(1), error_code_(SchemaErrorCode::kOK) {}
+
+    // on an error the schema accepts everything
+    bool Compile(const JsonElem& schema);
+    SchemaErrorCode GetErrorCode() const;
+    // JSON Pointer to the part of the schema where compiling stopped
+    const std::string& GetErrorPath() const;
+
+    // Checks a parsed document. Members of an object are visited in the
+    // object's iteration order, so with several violations the one
+    // reported may differ from Parser::Parse(content, schema).
+    bool Validate(const JsonElem& document,
+        SchemaViolation* violation = nullptr) const;
+
+private:
+    friend class Parser;
+
+    static const uint32_t kNone = UINT32_MAX;
+
+    enum TypeBits : uint8_t
+    {
+        kNullBit = 1,
+        kBooleanBit = 2,
+        kIntegerBit = 4, //integral numbers; a number is kNumberBit
+        kNumberBit = 8,
+        kStringBit = 16,
+        kArrayBit = 32,
+        kObjectBit = 64,
+        kAnyType = 127
+    };
+
+    struct Property
+    {
+        uint32_t schema = kNone;   //kNone for a required name only
+        uint32_t required = kNone; //index among the required names
+    };
+
+    struct Node
+    {
+        bool unconstrained = true; //true or {}, nothing to check below
+        bool reject = false;       //false
+        uint8_t types = kAnyType;
+        bool has_minimum = false;
+        bool has_maximum = false;
+        double minimum = 0;
+        double maximum = 0;
+        size_t min_length = 0;
+        size_t max_length = SIZE_MAX;
+        bool has_enum = false;
+        std::vector<JsonElem> enum_values;
+        std::unordered_map<std::string, Property, KeyHash, KeyEqual>
+            properties;
+        uint32_t required_count = 0;
+        uint32_t items = kNone;      //kNone: any element
+        uint32_t additional = kNone; //kNone: any member
+    };
+
+    bool CompileNode(const JsonElem& schema, uint32_t index);
+    bool CompileKeyword(std::string_view keyword, const JsonElem& value,
+        uint32_t index);
+    bool CompileChild(const JsonElem& schema, uint32_t* child);
+    bool Fail(SchemaErrorCode code);
+
+    // the keyword value breaks, empty when it passes; children of a
+    // container are not looked at
+    std::string_view Check(const Node& node, const JsonElem& value) const;
+    std::string_view ValidateNode(uint32_t index, const JsonElem& value,
+        std::vector<std::string>& tokens) const;
+    // tokens are collected from the value up to the root
+    static std::string JoinPointer(const std::vector<std::string>& tokens);
+
+    std::vector<Node> nodes_; //nodes_[0] is the root
+
+    std::string error_path_;
+    SchemaErrorCode error_code_;
+};
+}
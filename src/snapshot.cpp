@@ -0,0 +1,63 @@
+#include "snapshot.h"
+
+using namespace polojson;
+
+polojson::SnapshotHolder::SnapshotHolder(JsonElem document) :
+    current_(std::make_shared<const JsonElem>(std::move(document))),
+    version_(1)
+{
+}
+
+void polojson::SnapshotHolder::Publish(JsonElem document)
+{
+    // the pointer is stored before the version moves on, so a reader that
+    // sees the new version also loads the new pointer
+    std::atomic_store(&current_,
+        std::shared_ptr<const JsonElem>(
+            std::make_shared<const JsonElem>(std::move(document))));
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+bool polojson::SnapshotHolder::Reload(Parser& parser,
+    std::string_view content)
+{
+    JsonElem document = parser.Parse(content);
+    if (parser.GetErrorCode() != ParseErrorCode::kOK)
+        return false;
+    Publish(std::move(document));
+    return true;
+}
+
+std::shared_ptr<const JsonElem> polojson::SnapshotHolder::Acquire() const
+{
+    return std::atomic_load(&current_);
+}
+
+uint64_t polojson::SnapshotHolder::version() const
+{
+    return version_.load(std::memory_order_acquire);
+}
+
+polojson::SnapshotHolder::Reader::Reader(const SnapshotHolder& holder) :
+    holder_(&holder), version_(0)
+{
+}
+
+const JsonElem& polojson::SnapshotHolder::Reader::Get()
+{
+    uint64_t version = holder_->version();
+    if (version != version_)
+    {
+        // a publish racing with this may hand out a pointer newer than
+        // version, which only costs one more reload on the next call
+        snapshot_ = holder_->Acquire();
+        version_ = version;
+    }
+    return *snapshot_;
+}
+
+void polojson::SnapshotHolder::Reader::Release()
+{
+    snapshot_.reset();
+    version_ = 0;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include "parse.h"
+
+namespace polojson
+{
+
+// Publishes immutable documents to any number of reader threads, e.g. a
+// configuration that is reloaded at run time. Readers go through a Reader
+// handle, one per thread, which keeps the snapshot it last saw together
+// with its version: as long as nothing new has been published, Get() is a
+// single atomic load and touches no shared cache line for writing, so it
+// is wait-free and readers do not slow each other down. After a publish
+// each reader picks up the new snapshot once, on its next Get().
+//
+// A snapshot is freed when the last handle and Acquire() result holding
+// it let go, so a retired document lives until every reader has moved on;
+// a reader that stops calling Get() keeps its snapshot until Release().
+class SnapshotHolder
+{
+public:
+    explicit SnapshotHolder(JsonElem document = JsonElem(nullptr));
+    SnapshotHolder(const SnapshotHolder&) = delete;
+    SnapshotHolder& operator=(const SnapshotHolder&) = delete;
+
+    // Swaps in document; any thread may publish. References into the
+    // caller's copy of document taken before the call must not be written
+    // through afterwards, see JsonElem.
+    void Publish(JsonElem document);
+    // Parses content with parser, off the readers' path, and publishes
+    // the result. On a parse error the current snapshot stays and
+    // parser.GetErrorCode() tells why.
+    bool Reload(Parser& parser, std::string_view content);
+
+    // the current snapshot, without a Reader; takes the slow path
+    std::shared_ptr<const JsonElem> Acquire() const;
+    // incremented by every publish
+    uint64_t version() const;
+
+    class Reader
+    {
+    public:
+        explicit Reader(const SnapshotHolder& holder);
+
+        // Valid until the next Get() or Release() on this handle.
+        const JsonElem& Get();
+        void Release();
+
+    private:
+        const SnapshotHolder* holder_;
+        uint64_t version_;
+        std::shared_ptr<const JsonElem> snapshot_;
+    };
+
+private:
+    std::shared_ptr<const JsonElem> current_; //accessed with std::atomic_*
+    std::atomic<uint64_t> version_;
+};
+}
@@ -0,0 +1,769 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "util.h"
+
+namespace polojson
+{
+
+// JSON literals parsed by the compiler:
+//
+//   static constexpr auto kDefaults = ParseStatic<R"({"retries":3})">();
+//   double retries = kDefaults.Root()["retries"].ToNumber();
+//
+// The document is a constant of fixed size, so a static one sits in
+// read-only data and costs no parsing and no allocation at run time; its
+// values can be queried in constant expressions too. A malformed literal
+// fails the build in StaticParseError<code>, code being the ParseErrorCode
+// Parser::Parse reports for it. Numbers round exactly like strtod. Object
+// keys are sorted for binary search, and the first of duplicate keys wins,
+// as with Parser.
+template<size_t N>
+struct StaticString
+{
+    constexpr StaticString(const char (&literal)[N])
+    {
+        std::copy_n(literal, N, text);
+    }
+    constexpr std::string_view view() const
+    {
+        return std::string_view(text, N - 1);
+    }
+
+    char text[N];
+};
+
+struct StaticNode
+{
+    JsonType type = JsonType::kNull;
+    double number = 0;
+    // string: offset of the characters, array and object: offset of the
+    // element indexes or key/value index pairs in the links
+    uint32_t first = 0;
+    uint32_t size = 0; //string length, element or member count
+};
+
+// A value of a StaticDocument, read with the accessors of JsonElem
+class StaticElem
+{
+public:
+    constexpr StaticElem(const StaticNode* nodes, const uint32_t* links,
+        const char* chars, uint32_t index) :nodes_(nodes), links_(links),
+        chars_(chars), index_(index) {}
+
+    constexpr JsonType type() const noexcept { return Node().type; }
+
+    constexpr bool IsNull() const { return type() == JsonType::kNull; }
+    constexpr bool IsBoolean() const
+    {
+        return type() == JsonType::kTrue || type() == JsonType::kFalse;
+    }
+    constexpr bool IsNumber() const { return type() == JsonType::kNumber; }
+    constexpr bool IsString() const { return type() == JsonType::kString; }
+    constexpr bool IsArray() const { return type() == JsonType::kArray; }
+    constexpr bool IsObject() const { return type() == JsonType::kObject; }
+
+    constexpr bool ToBoolean() const
+    {
+        assert(IsBoolean());
+        return type() == JsonType::kTrue;
+    }
+    constexpr double ToNumber() const
+    {
+        assert(IsNumber());
+        return Node().number;
+    }
+    // throws std::range_error unless the number is an integral int64
+    constexpr int64_t ToInt64() const
+    {
+        double value = ToNumber();
+        if (value >= -9223372036854775808.0 && value < 9223372036854775808.0 &&
+            value == static_cast<double>(static_cast<int64_t>(value)))
+            return static_cast<int64_t>(value);
+        throw std::range_error("Number is not an int64");
+    }
+    constexpr std::string_view ToString() const
+    {
+        assert(IsString());
+        return std::string_view(chars_ + Node().first, Node().size);
+    }
+    constexpr size_t size() const //element count of an array or object
+    {
+        assert(IsArray() || IsObject());
+        return Node().size;
+    }
+
+    // Like JsonElem, these throw std::out_of_range for a missing index/key.
+    constexpr StaticElem operator[](size_t i) const
+    {
+        if (!IsArray())
+            throw std::runtime_error("Not a JsonArray object");
+        if (i >= size())
+            throw std::out_of_range("array index out of range");
+        return At(links_[Node().first + i]);
+    }
+    constexpr StaticElem operator[](std::string_view key) const
+    {
+        StaticElem value = *this;
+        if (!Find(key, &value))
+            throw std::out_of_range("key not found");
+        return value;
+    }
+    constexpr bool Find(std::string_view key, StaticElem* value) const
+    {
+        if (!IsObject())
+            throw std::runtime_error("Not a JsonObject object");
+        size_t low = 0, high = size();
+        while (low < high)
+        {
+            size_t mid = low + (high - low) / 2;
+            int cmp = KeyAt(mid).compare(key);
+            if (cmp == 0)
+            {
+                *value = ValueAt(mid);
+                return true;
+            }
+            if (cmp < 0)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        return false;
+    }
+
+    // the i-th entry of an object, in key order
+    constexpr std::string_view KeyAt(size_t i) const
+    {
+        assert(IsObject() && i < size());
+        return At(links_[Node().first + i * 2]).ToString();
+    }
+    constexpr StaticElem ValueAt(size_t i) const
+    {
+        assert(IsObject() && i < size());
+        return At(links_[Node().first + i * 2 + 1]);
+    }
+
+private:
+    constexpr const StaticNode& Node() const { return nodes_[index_]; }
+    constexpr StaticElem At(uint32_t index) const
+    {
+        return StaticElem(nodes_, links_, chars_, index);
+    }
+
+    const StaticNode* nodes_;
+    const uint32_t* links_;
+    const char* chars_;
+    uint32_t index_;
+};
+
+namespace detail
+{
+    // unsigned integer of any size for exact decimal to binary conversion
+    struct StaticBigInt
+    {
+        std::vector<uint32_t> limbs; //little-endian, no leading zero limb
+
+        constexpr void MulAdd(uint32_t mul, uint32_t add)
+        {
+            uint64_t carry = add;
+            for (uint32_t& limb : limbs)
+            {
+                uint64_t v = static_cast<uint64_t>(limb) * mul + carry;
+                limb = static_cast<uint32_t>(v);
+                carry = v >> 32;
+            }
+            if (carry != 0)
+                limbs.push_back(static_cast<uint32_t>(carry));
+        }
+
+        constexpr void ShiftLeft(size_t bits)
+        {
+            if (limbs.empty())
+                return;
+            size_t rest = bits % 32;
+            if (rest != 0)
+            {
+                uint32_t carry = 0;
+                for (uint32_t& limb : limbs)
+                {
+                    uint32_t next = limb >> (32 - rest);
+                    limb = (limb << rest) | carry;
+                    carry = next;
+                }
+                if (carry != 0)
+                    limbs.push_back(carry);
+            }
+            limbs.insert(limbs.begin(), bits / 32, 0);
+        }
+
+        constexpr size_t BitLength() const
+        {
+            if (limbs.empty())
+                return 0;
+            return (limbs.size() - 1) * 32 + std::bit_width(limbs.back());
+        }
+
+        constexpr int Compare(const StaticBigInt& other) const
+        {
+            if (limbs.size() != other.limbs.size())
+                return limbs.size() < other.limbs.size() ? -1 : 1;
+            for (size_t i = limbs.size(); i-- > 0;)
+            {
+                if (limbs[i] != other.limbs[i])
+                    return limbs[i] < other.limbs[i] ? -1 : 1;
+            }
+            return 0;
+        }
+
+        constexpr void Subtract(const StaticBigInt& other) //other <= *this
+        {
+            int64_t borrow = 0;
+            for (size_t i = 0; i < limbs.size(); ++i)
+            {
+                int64_t v = static_cast<int64_t>(limbs[i]) - borrow -
+                    (i < other.limbs.size() ? other.limbs[i] : 0);
+                borrow = v < 0 ? 1 : 0;
+                limbs[i] = static_cast<uint32_t>(v + (borrow << 32));
+            }
+            while (!limbs.empty() && limbs.back() == 0)
+                limbs.pop_back();
+        }
+    };
+
+    // digits (no leading or trailing zeros) * 10^exponent, rounded to
+    // nearest even; false when it overflows a double
+    constexpr bool DecimalToDouble(std::string_view digits, int64_t exponent,
+        double* out)
+    {
+        int64_t magnitude = static_cast<int64_t>(digits.size()) + exponent;
+        if (magnitude > 310)
+            return false;
+        if (magnitude < -330)
+        {
+            *out = 0;
+            return true;
+        }
+        // both operands exact, so one IEEE operation rounds correctly
+        if (digits.size() <= 15 && exponent >= -22 && exponent <= 22)
+        {
+            uint64_t mantissa = 0;
+            for (char c : digits)
+                mantissa = mantissa * 10 + (c - '0');
+            double scale = 1;
+            for (int64_t i = 0; i < (exponent < 0 ? -exponent : exponent); ++i)
+                scale *= 10;
+            double value = static_cast<double>(mantissa);
+            *out = exponent < 0 ? value / scale : value * scale;
+            return true;
+        }
+
+        // q = floor(num * 2^k / den) with 2^63 <= q < 2^64, then round q
+        StaticBigInt num, den;
+        for (char c : digits)
+            num.MulAdd(10, c - '0');
+        den.limbs.push_back(1);
+        for (int64_t i = 0; i < exponent; ++i)
+            num.MulAdd(10, 0);
+        for (int64_t i = 0; i < -exponent; ++i)
+            den.MulAdd(10, 0);
+        int64_t k = 64 - static_cast<int64_t>(num.BitLength()) +
+            static_cast<int64_t>(den.BitLength());
+        StaticBigInt n, d;
+        for (int attempt = 0; attempt < 2; ++attempt, --k)
+        {
+            n = num;
+            d = den;
+            if (k > 0)
+                n.ShiftLeft(static_cast<size_t>(k));
+            else
+                d.ShiftLeft(static_cast<size_t>(-k));
+            StaticBigInt limit = d;
+            limit.ShiftLeft(64);
+            if (n.Compare(limit) < 0)
+                break;
+        }
+        uint64_t q = 0;
+        for (int bit = 63; bit >= 0; --bit)
+        {
+            StaticBigInt shifted = d;
+            shifted.ShiftLeft(static_cast<size_t>(bit));
+            if (n.Compare(shifted) >= 0)
+            {
+                n.Subtract(shifted);
+                q |= uint64_t(1) << bit;
+            }
+        }
+        bool sticky = !n.limbs.empty();
+
+        int64_t e2 = 63 - k; //the value is in [2^e2, 2^(e2+1))
+        int64_t bits = e2 >= -1022 ? 53 : 53 - (-1022 - e2); //subnormals keep fewer
+        uint64_t m;
+        if (bits <= 0)
+        {
+            // only [2^-1075, 2^-1074) can round up, to the smallest subnormal
+            m = bits == 0 && (q != uint64_t(1) << 63 || sticky) ? 1 : 0;
+        }
+        else
+        {
+            int64_t drop = 64 - bits;
+            m = q >> drop;
+            uint64_t rest = q & ((uint64_t(1) << drop) - 1);
+            uint64_t half = uint64_t(1) << (drop - 1);
+            if (rest > half || (rest == half && (sticky || (m & 1))))
+                ++m;
+        }
+        uint64_t raw = m; //subnormal, m == 2^52 being the smallest normal
+        if (e2 >= -1022)
+        {
+            if (m == uint64_t(1) << 53)
+            {
+                m >>= 1;
+                ++e2;
+            }
+            if (e2 > 1023)
+                return false;
+            raw = (static_cast<uint64_t>(e2 + 1023) << 52) |
+                (m & ((uint64_t(1) << 52) - 1));
+        }
+        *out = std::bit_cast<double>(raw);
+        return true;
+    }
+
+    // Parses a literal into growable tables, reporting errors the way
+    // Parser does. Run once to size a StaticDocument and once to fill it.
+    class StaticBuilder
+    {
+    public:
+        constexpr explicit StaticBuilder(std::string_view text) :text_(text) {}
+
+        constexpr bool Parse()
+        {
+            SkipWhitespace();
+            uint32_t root;
+            if (!ParseValue(&root))
+                return false;
+            SkipWhitespace();
+            if (pos_ < text_.size())
+                return Fail(ParseErrorCode::kRootNotSingular);
+            return true;
+        }
+
+        std::vector<StaticNode> nodes;
+        std::vector<uint32_t> links;
+        std::string chars;
+        ParseErrorCode error_code = ParseErrorCode::kOK;
+
+    private:
+        constexpr char Peek() const
+        {
+            return pos_ < text_.size() ? text_[pos_] : '\0';
+        }
+
+        static constexpr bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+        constexpr bool Fail(ParseErrorCode code)
+        {
+            error_code = code;
+            return false;
+        }
+
+        constexpr void SkipWhitespace()
+        {
+            while (Peek() == ' ' || Peek() == '\t' || Peek() == '\n' ||
+                Peek() == '\r')
+                ++pos_;
+        }
+
+        constexpr bool ParseValue(uint32_t* index)
+        {
+            *index = static_cast<uint32_t>(nodes.size());
+            nodes.emplace_back();
+            switch (Peek())
+            {
+            case 'n':
+                return ParseLiteral("null", JsonType::kNull, *index);
+            case 't':
+                return ParseLiteral("true", JsonType::kTrue, *index);
+            case 'f':
+                return ParseLiteral("false", JsonType::kFalse, *index);
+            case '"':
+                return ParseString(*index);
+            case '[':
+                return ParseArray(*index);
+            case '{':
+                return ParseObject(*index);
+            case '\0':
+                return Fail(ParseErrorCode::kExpectValue);
+            default:
+                return ParseNumber(*index);
+            }
+        }
+
+        constexpr bool ParseLiteral(std::string_view literal, JsonType type,
+            uint32_t index)
+        {
+            if (text_.substr(pos_, literal.size()) != literal)
+                return Fail(ParseErrorCode::kInvalidValue);
+            pos_ += literal.size();
+            nodes[index].type = type;
+            return true;
+        }
+
+        constexpr bool ParseNumber(uint32_t index)
+        {
+            bool negative = false;
+            std::string digits;
+            int64_t exponent = 0;
+            if (Peek() == '-')
+            {
+                negative = true;
+                ++pos_;
+            }
+            if (Peek() == '0')
+                ++pos_;
+            else
+            {
+                if (!IsDigit(Peek()))
+                    return Fail(ParseErrorCode::kInvalidValue);
+                while (IsDigit(Peek()))
+                    digits.push_back(text_[pos_++]);
+            }
+            if (Peek() == '.')
+            {
+                ++pos_;
+                if (!IsDigit(Peek()))
+                    return Fail(ParseErrorCode::kInvalidValue);
+                for (; IsDigit(Peek()); --exponent)
+                    digits.push_back(text_[pos_++]);
+            }
+            if (Peek() == 'e' || Peek() == 'E')
+            {
+                ++pos_;
+                bool negative_exponent = Peek() == '-';
+                if (Peek() == '-' || Peek() == '+')
+                    ++pos_;
+                if (!IsDigit(Peek()))
+                    return Fail(ParseErrorCode::kInvalidValue);
+                int64_t e = 0;
+                for (; IsDigit(Peek()); ++pos_)
+                {
+                    if (e < 1000000) //far beyond any double either way
+                        e = e * 10 + (Peek() - '0');
+                }
+                exponent += negative_exponent ? -e : e;
+            }
+
+            double value = 0;
+            size_t first = digits.find_first_not_of('0');
+            if (first != std::string::npos)
+            {
+                digits.erase(0, first);
+                for (; digits.back() == '0'; ++exponent)
+                    digits.pop_back();
+                if (!DecimalToDouble(digits, exponent, &value))
+                    return Fail(ParseErrorCode::kNumberTooBig);
+            }
+            nodes[index].type = JsonType::kNumber;
+            nodes[index].number = negative ? -value : value;
+            return true;
+        }
+
+        constexpr int ParseHex4()
+        {
+            int value = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                char c = Peek();
+                int digit;
+                if (c >= '0' && c <= '9')
+                    digit = c - '0';
+                else if (c >= 'a' && c <= 'f')
+                    digit = c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F')
+                    digit = c - 'A' + 10;
+                else
+                    return -1;
+                value = value * 16 + digit;
+                ++pos_;
+            }
+            return value;
+        }
+
+        constexpr void EncodeUtf8(int u)
+        {
+            if (u <= 0x7F)
+                chars.push_back(static_cast<char>(u));
+            else if (u <= 0x7FF)
+            {
+                chars.push_back(static_cast<char>(0xC0 | (u >> 6)));
+                chars.push_back(static_cast<char>(0x80 | (u & 0x3F)));
+            }
+            else if (u <= 0xFFFF)
+            {
+                chars.push_back(static_cast<char>(0xE0 | (u >> 12)));
+                chars.push_back(static_cast<char>(0x80 | ((u >> 6) & 0x3F)));
+                chars.push_back(static_cast<char>(0x80 | (u & 0x3F)));
+            }
+            else
+            {
+                chars.push_back(static_cast<char>(0xF0 | (u >> 18)));
+                chars.push_back(static_cast<char>(0x80 | ((u >> 12) & 0x3F)));
+                chars.push_back(static_cast<char>(0x80 | ((u >> 6) & 0x3F)));
+                chars.push_back(static_cast<char>(0x80 | (u & 0x3F)));
+            }
+        }
+
+        constexpr bool ParseString(uint32_t index)
+        {
+            ++pos_; //the opening quote
+            size_t begin = chars.size();
+            for (;;)
+            {
+                char c = Peek();
+                ++pos_;
+                switch (c)
+                {
+                case '"':
+                    nodes[index].type = JsonType::kString;
+                    nodes[index].first = static_cast<uint32_t>(begin);
+                    nodes[index].size = static_cast<uint32_t>(chars.size() - begin);
+                    return true;
+                case '\\':
+                {
+                    char escape = Peek();
+                    ++pos_;
+                    switch (escape)
+                    {
+                    case '"': chars.push_back('"'); break;
+                    case '\\': chars.push_back('\\'); break;
+                    case '/': chars.push_back('/'); break;
+                    case 'b': chars.push_back('\b'); break;
+                    case 'f': chars.push_back('\f'); break;
+                    case 'n': chars.push_back('\n'); break;
+                    case 'r': chars.push_back('\r'); break;
+                    case 't': chars.push_back('\t'); break;
+                    case 'u':
+                    {
+                        int u = ParseHex4();
+                        if (u < 0)
+                            return Fail(ParseErrorCode::kInvalidUnicodeHex);
+                        if (u >= 0xD800 && u <= 0xDBFF)
+                        {
+                            if (Peek() != '\\')
+                                return Fail(ParseErrorCode::kInvalidUnicodeSurrogate);
+                            ++pos_;
+                            if (Peek() != 'u')
+                                return Fail(ParseErrorCode::kInvalidUnicodeSurrogate);
+                            ++pos_;
+                            int u2 = ParseHex4();
+                            if (u2 < 0)
+                                return Fail(ParseErrorCode::kInvalidUnicodeHex);
+                            if (u2 < 0xDC00 || u2 > 0xDFFF)
+                                return Fail(ParseErrorCode::kInvalidUnicodeSurrogate);
+                            u = (((u - 0xD800) << 10) | (u2 - 0xDC00)) + 0x10000;
+                        }
+                        EncodeUtf8(u);
+                        break;
+                    }
+                    default:
+                        return Fail(ParseErrorCode::kInvalidStringEscape);
+                    }
+                    break;
+                }
+                case '\0':
+                    return Fail(ParseErrorCode::kMissQuotationMark);
+                default:
+                    if (static_cast<unsigned char>(c) < 0x20)
+                        return Fail(ParseErrorCode::kInvalidStringChar);
+                    chars.push_back(c);
+                }
+            }
+        }
+
+        constexpr bool ParseArray(uint32_t index)
+        {
+            std::vector<uint32_t> elements;
+            ++pos_;
+            SkipWhitespace();
+            if (Peek() != ']')
+            {
+                for (;;)
+                {
+                    uint32_t element;
+                    if (!ParseValue(&element))
+                        return false;
+                    elements.push_back(element);
+                    SkipWhitespace();
+                    if (Peek() == ',')
+                    {
+                        ++pos_;
+                        SkipWhitespace();
+                    }
+                    else if (Peek() == ']')
+                        break;
+                    else
+                        return Fail(ParseErrorCode::kMissCommaOrSquareBracket);
+                }
+            }
+            ++pos_;
+            nodes[index].type = JsonType::kArray;
+            nodes[index].first = static_cast<uint32_t>(links.size());
+            nodes[index].size = static_cast<uint32_t>(elements.size());
+            links.insert(links.end(), elements.begin(), elements.end());
+            return true;
+        }
+
+        constexpr std::string_view Key(uint32_t index) const
+        {
+            return std::string_view(chars).substr(nodes[index].first,
+                nodes[index].size);
+        }
+
+        constexpr bool ParseObject(uint32_t index)
+        {
+            struct Member
+            {
+                uint32_t key;
+                uint32_t value;
+            };
+            std::vector<Member> members;
+            ++pos_;
+            SkipWhitespace();
+            if (Peek() != '}')
+            {
+                for (;;)
+                {
+                    if (Peek() != '"')
+                        return Fail(ParseErrorCode::kMissKey);
+                    Member member{};
+                    member.key = static_cast<uint32_t>(nodes.size());
+                    nodes.emplace_back();
+                    if (!ParseString(member.key))
+                        return false;
+                    SkipWhitespace();
+                    if (Peek() != ':')
+                        return Fail(ParseErrorCode::kMissColon);
+                    ++pos_;
+                    SkipWhitespace();
+                    if (!ParseValue(&member.value))
+                        return false;
+                    members.push_back(member);
+                    SkipWhitespace();
+                    if (Peek() == ',')
+                    {
+                        ++pos_;
+                        SkipWhitespace();
+                    }
+                    else if (Peek() == '}')
+                        break;
+                    else
+                        return Fail(ParseErrorCode::kMissCommaOrCurlyBracket);
+                }
+            }
+            ++pos_;
+
+            // key order, earlier first among equal keys, which then win
+            std::sort(members.begin(), members.end(),
+                [this](const Member& a, const Member& b)
+                {
+                    int cmp = Key(a.key).compare(Key(b.key));
+                    return cmp != 0 ? cmp < 0 : a.key < b.key;
+                });
+            auto end = std::unique(members.begin(), members.end(),
+                [this](const Member& a, const Member& b)
+                {
+                    return Key(a.key) == Key(b.key);
+                });
+            members.erase(end, members.end());
+
+            nodes[index].type = JsonType::kObject;
+            nodes[index].first = static_cast<uint32_t>(links.size());
+            nodes[index].size = static_cast<uint32_t>(members.size());
+            for (const Member& member : members)
+            {
+                links.push_back(member.key);
+                links.push_back(member.value);
+            }
+            return true;
+        }
+
+        std::string_view text_;
+        size_t pos_ = 0;
+    };
+
+    struct StaticSizes
+    {
+        size_t nodes;
+        size_t links;
+        size_t chars;
+        ParseErrorCode error_code;
+    };
+
+    consteval StaticSizes MeasureStatic(std::string_view text)
+    {
+        StaticBuilder builder(text);
+        builder.Parse();
+        return { builder.nodes.size(), builder.links.size(),
+            builder.chars.size(), builder.error_code };
+    }
+}
+
+// The tables of a parsed literal, sized exactly at compile time
+template<size_t Nodes, size_t Links, size_t Chars>
+class StaticDocument
+{
+public:
+    constexpr explicit StaticDocument(const detail::StaticBuilder& builder)
+    {
+        std::copy(builder.nodes.begin(), builder.nodes.end(), nodes_);
+        std::copy(builder.links.begin(), builder.links.end(), links_);
+        std::copy(builder.chars.begin(), builder.chars.end(), chars_);
+    }
+
+    constexpr StaticElem Root() const
+    {
+        return StaticElem(nodes_, links_, chars_, 0);
+    }
+
+private:
+    // never empty, zero-length arrays are not allowed
+    StaticNode nodes_[Nodes] = {};
+    uint32_t links_[Links] = {};
+    char chars_[Chars] = {};
+};
+
+template<ParseErrorCode Error>
+struct StaticParseError
+{
+    static_assert(Error == ParseErrorCode::kOK,
+        "malformed JSON literal, see the ParseErrorCode above");
+    static constexpr bool ok = true;
+};
+
+// ParseErrorCode of a literal, kOK when ParseStatic accepts it
+template<StaticString Text>
+consteval ParseErrorCode StaticErrorCode()
+{
+    return detail::MeasureStatic(Text.view()).error_code;
+}
+
+template<StaticString Text>
+consteval auto ParseStatic()
+{
+    constexpr detail::StaticSizes sizes = detail::MeasureStatic(Text.view());
+    static_assert(StaticParseError<sizes.error_code>::ok);
+    detail::StaticBuilder builder(Text.view());
+    builder.Parse();
+    return StaticDocument<std::max<size_t>(sizes.nodes, 1),
+        std::max<size_t>(sizes.links, 1), std::max<size_t>(sizes.chars, 1)>(
+            builder);
+}
+}
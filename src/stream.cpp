@@ -0,0 +1,223 @@
+#include <cerrno>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "stream.h"
+
+using namespace polojson;
+
+namespace
+{
+
+bool IsWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+}
+
+polojson::ArrayStreamReader::ArrayStreamReader(std::istream& in, size_t buffer_size)
+    :in_(&in), fd_(-1), buffer_(buffer_size ? buffer_size : 1), pos_(0), end_(0),
+    eof_(false), state_(State::kStart), error_code_(ParseErrorCode::kOK)
+{
+}
+
+polojson::ArrayStreamReader::ArrayStreamReader(int fd, size_t buffer_size)
+    :in_(nullptr), fd_(fd), buffer_(buffer_size ? buffer_size : 1), pos_(0), end_(0),
+    eof_(false), state_(State::kStart), error_code_(ParseErrorCode::kOK)
+{
+}
+
+ParseErrorCode polojson::ArrayStreamReader::GetErrorCode() const
+{
+    return error_code_;
+}
+
+bool polojson::ArrayStreamReader::Fill()
+{
+    if (eof_)
+        return false;
+    size_t count = 0;
+    if (in_)
+    {
+        in_->read(buffer_.data(), buffer_.size());
+        count = static_cast<size_t>(in_->gcount());
+    }
+    else
+    {
+        for (;;)
+        {
+#ifdef _WIN32
+            int n = _read(fd_, buffer_.data(), static_cast<unsigned>(buffer_.size()));
+#else
+            ssize_t n = read(fd_, buffer_.data(), buffer_.size());
+#endif
+            if (n < 0 && errno == EINTR)
+                continue;
+            count = n > 0 ? static_cast<size_t>(n) : 0;
+            break;
+        }
+    }
+    pos_ = 0;
+    end_ = count;
+    if (count == 0)
+        eof_ = true;
+    return count != 0;
+}
+
+int polojson::ArrayStreamReader::Peek()
+{
+    if (pos_ == end_ && !Fill())
+        return -1;
+    return static_cast<unsigned char>(buffer_[pos_]);
+}
+
+void polojson::ArrayStreamReader::SkipWhitespace()
+{
+    for (int c = Peek(); c != -1 && IsWhitespace(static_cast<char>(c)); c = Peek())
+        ++pos_;
+}
+
+bool polojson::ArrayStreamReader::Fail(ParseErrorCode code)
+{
+    error_code_ = code;
+    state_ = State::kDone;
+    return false;
+}
+
+bool polojson::ArrayStreamReader::Finish()
+{
+    state_ = State::kDone;
+    SkipWhitespace();
+    if (Peek() != -1)
+        error_code_ = ParseErrorCode::kRootNotSingular;
+    return false;
+}
+
+// Copies the text of one element into element_, tracking nesting and string
+// state only as far as needed to find where the element ends. Validation is
+// left to the parser.
+void polojson::ArrayStreamReader::ReadElement()
+{
+    element_.clear();
+    int depth = 0;
+    bool in_string = false;
+    bool escape = false;
+    for (;;)
+    {
+        // at the end of input the parser reports what is incomplete
+        if (pos_ == end_ && !Fill())
+            return;
+        size_t i = pos_;
+        bool done = false;
+        for (; i != end_ && !done; ++i)
+        {
+            char c = buffer_[i];
+            if (in_string)
+            {
+                if (escape)
+                    escape = false;
+                else if (c == '\\')
+                    escape = true;
+                else if (c == '"')
+                {
+                    in_string = false;
+                    done = depth == 0;
+                }
+                continue;
+            }
+            switch (c)
+            {
+            case '"':
+                in_string = true;
+                break;
+            case '[':
+            case '{':
+                ++depth;
+                break;
+            case ']':
+            case '}':
+                if (depth == 0)
+                {
+                    element_.append(&buffer_[pos_], i - pos_);
+                    pos_ = i;
+                    return;
+                }
+                done = --depth == 0;
+                break;
+            case ',':
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+                if (depth == 0)
+                {
+                    element_.append(&buffer_[pos_], i - pos_);
+                    pos_ = i;
+                    return;
+                }
+                break;
+            }
+        }
+        element_.append(&buffer_[pos_], i - pos_);
+        pos_ = i;
+        if (done)
+            return;
+    }
+}
+
+bool polojson::ArrayStreamReader::Next(JsonElem* elem)
+{
+    if (state_ == State::kStart)
+    {
+        SkipWhitespace();
+        int c = Peek();
+        if (c == -1)
+            return Fail(ParseErrorCode::kExpectValue);
+        if (c != '[')
+            return Fail(ParseErrorCode::kTypeMismatch);
+        ++pos_;
+        SkipWhitespace();
+        if (Peek() == ']')
+        {
+            ++pos_;
+            return Finish();
+        }
+        state_ = State::kElement;
+    }
+    else if (state_ == State::kAfterElement)
+    {
+        SkipWhitespace();
+        int c = Peek();
+        if (c == ']')
+        {
+            ++pos_;
+            return Finish();
+        }
+        if (c != ',')
+            return Fail(ParseErrorCode::kMissCommaOrSquareBracket);
+        ++pos_;
+        SkipWhitespace();
+        state_ = State::kElement;
+    }
+    else if (state_ == State::kDone)
+        return false;
+
+    ReadElement();
+    JsonElem value = parser_.Parse(element_);
+    if (parser_.GetErrorCode() != ParseErrorCode::kOK)
+        return Fail(parser_.GetErrorCode());
+    *elem = std::move(value);
+    state_ = State::kAfterElement;
+    return true;
+}
+
+#if defined(__cpp_impl_coroutine)
+Generator<JsonElem> polojson::ArrayStreamReader::Elements()
+{
+    JsonElem elem;
+    while (Next(&elem))
+        co_yield std::move(elem);
+}
+#endif
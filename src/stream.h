@@ -0,0 +1,178 @@
+#pragma once
+
+#include <istream>
+#include <iterator>
+#include <string>
+#include <vector>
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#endif
+#include "parse.h"
+
+namespace polojson
+{
+
+#if defined(__cpp_impl_coroutine)
+// Minimal lazily started generator for co_yield based producers.
+template<typename T>
+class Generator
+{
+public:
+    struct promise_type
+    {
+        T value_;
+        std::exception_ptr error_;
+
+        Generator get_return_object()
+        {
+            return Generator(handle::from_promise(*this));
+        }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+        std::suspend_always yield_value(T value)
+        {
+            value_ = std::move(value);
+            return {};
+        }
+        void return_void() {}
+        void unhandled_exception() { error_ = std::current_exception(); }
+    };
+    using handle = std::coroutine_handle<promise_type>;
+
+    class iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T*;
+        using reference = T&;
+
+        iterator() :coro_(nullptr) {}
+        explicit iterator(handle coro) :coro_(coro) {}
+
+        T& operator*() const { return coro_.promise().value_; }
+        T* operator->() const { return &coro_.promise().value_; }
+        iterator& operator++()
+        {
+            Resume(coro_);
+            if (coro_.done())
+                coro_ = nullptr;
+            return *this;
+        }
+        bool operator==(const iterator& other) const { return coro_ == other.coro_; }
+        bool operator!=(const iterator& other) const { return coro_ != other.coro_; }
+
+    private:
+        handle coro_;
+    };
+
+    explicit Generator(handle coro) :coro_(coro) {}
+    Generator(Generator&& other) noexcept :coro_(other.coro_) { other.coro_ = nullptr; }
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+    ~Generator()
+    {
+        if (coro_)
+            coro_.destroy();
+    }
+
+    iterator begin()
+    {
+        Resume(coro_);
+        return coro_.done() ? iterator() : iterator(coro_);
+    }
+    iterator end() { return iterator(); }
+
+private:
+    static void Resume(handle coro)
+    {
+        coro.resume();
+        if (coro.promise().error_)
+            std::rethrow_exception(coro.promise().error_);
+    }
+
+    handle coro_;
+};
+#endif
+
+// Reads a top-level JSON array element by element from a stream through a
+// fixed size buffer. Only the text of the current element is kept, so
+// memory stays bounded by the largest element instead of the document.
+class ArrayStreamReader
+{
+public:
+    explicit ArrayStreamReader(std::istream& in, size_t buffer_size = 64 << 10);
+    explicit ArrayStreamReader(int fd, size_t buffer_size = 64 << 10);
+
+    // Parses the next element into elem. Returns false at the end of the
+    // array or on an error; GetErrorCode() tells them apart. A root that is
+    // not an array fails with kTypeMismatch.
+    bool Next(JsonElem* elem);
+    ParseErrorCode GetErrorCode() const;
+
+    class iterator
+    {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = JsonElem;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const JsonElem*;
+        using reference = const JsonElem&;
+
+        iterator() :reader_(nullptr) {}
+        explicit iterator(ArrayStreamReader* reader) :reader_(reader) { ++*this; }
+
+        const JsonElem& operator*() const { return elem_; }
+        const JsonElem* operator->() const { return &elem_; }
+        iterator& operator++()
+        {
+            if (!reader_->Next(&elem_))
+                reader_ = nullptr;
+            return *this;
+        }
+        bool operator==(const iterator& other) const { return reader_ == other.reader_; }
+        bool operator!=(const iterator& other) const { return reader_ != other.reader_; }
+
+    private:
+        ArrayStreamReader* reader_;
+        JsonElem elem_;
+    };
+
+    iterator begin() { return iterator(this); }
+    iterator end() { return iterator(); }
+
+#if defined(__cpp_impl_coroutine)
+    Generator<JsonElem> Elements();
+#endif
+
+private:
+    enum class State
+    {
+        kStart,
+        kElement,
+        kAfterElement,
+        kDone
+    };
+
+    bool Fill();
+    int Peek(); //next byte without consuming it, -1 at the end of input
+    void SkipWhitespace();
+    void ReadElement();
+    bool Fail(ParseErrorCode code);
+    bool Finish();
+
+    std::istream* in_;
+    int fd_;
+    std::vector<char> buffer_;
+    size_t pos_;
+    size_t end_;
+    bool eof_;
+
+    State state_;
+    std::string element_;
+    Parser parser_;
+    ParseErrorCode error_code_;
+};
+}
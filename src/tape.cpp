@@ -0,0 +1,562 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "tape.h"
+
+using namespace polojson;
+
+namespace
+{
+
+// kTapeMagic as read back from a tape of the other byte order
+const uint32_t kSwappedTapeMagic = 0x504A5450;
+
+uint64_t Fnv1a(const char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint32_t ReadU32(const char* data, size_t offset)
+{
+    uint32_t word;
+    memcpy(&word, data + offset, sizeof(word));
+    return word;
+}
+
+// Checks the nodes reachable from root against the layout in tape.h. Each
+// node is checked once, even when shared, and child offsets must be below
+// their parent's, so crafted tapes cannot loop or blow up the walk.
+bool CheckTree(const char* data, size_t size, uint32_t root)
+{
+    std::vector<bool> checked(size / 8);
+    std::vector<uint32_t> pending{ root };
+    auto valid = [&](uint32_t offset, uint64_t bytes)
+    {
+        return offset >= kTapeHeaderSize && offset % 8 == 0 &&
+            offset + bytes <= size;
+    };
+    auto is_string = [&](uint32_t offset)
+    {
+        if (!valid(offset, 8) ||
+            ReadU32(data, offset) != static_cast<uint32_t>(JsonType::kString))
+            return false;
+        uint64_t length = ReadU32(data, offset + 4);
+        return valid(offset, 8 + length + 1) && data[offset + 8 + length] == '\0';
+    };
+    while (!pending.empty())
+    {
+        uint32_t offset = pending.back();
+        pending.pop_back();
+        if (!valid(offset, 8))
+            return false;
+        if (checked[offset / 8])
+            continue;
+        checked[offset / 8] = true;
+        uint32_t type = ReadU32(data, offset);
+        uint64_t count = ReadU32(data, offset + 4);
+        switch (static_cast<JsonType>(type))
+        {
+        case JsonType::kNull:
+        case JsonType::kTrue:
+        case JsonType::kFalse:
+            break;
+        case JsonType::kNumber:
+            if (!valid(offset, 16))
+                return false;
+            break;
+        case JsonType::kString:
+            if (!is_string(offset))
+                return false;
+            break;
+        case JsonType::kArray:
+            if (!valid(offset, 8 + count * 4))
+                return false;
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                uint32_t child = ReadU32(data, offset + 8 + i * 4);
+                if (child >= offset)
+                    return false;
+                pending.push_back(child);
+            }
+            break;
+        case JsonType::kObject:
+        {
+            if (!valid(offset, 8 + count * 8))
+                return false;
+            std::string_view previous;
+            for (uint64_t i = 0; i < count; ++i)
+            {
+                uint32_t key = ReadU32(data, offset + 8 + i * 8);
+                uint32_t value = ReadU32(data, offset + 12 + i * 8);
+                if (key >= offset || value >= offset || !is_string(key))
+                    return false;
+                // Find is a binary search over the keys
+                std::string_view name(data + key + 8, ReadU32(data, key + 4));
+                if (i > 0 && !(previous < name))
+                    return false;
+                previous = name;
+                pending.push_back(value);
+            }
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+class TapeWriter
+{
+public:
+    explicit TapeWriter(std::string& out) :out_(out), base_(out.size()) {}
+
+    void WriteDocument(const JsonElem& elem);
+
+private:
+    uint32_t Write(const JsonElem& elem);
+    uint32_t WriteString(std::string_view str);
+    uint32_t WriteKey(std::string_view key);
+    uint32_t StartNode(JsonType type, uint32_t word);
+    void PutU32(uint32_t value);
+    uint32_t Offset() const;
+
+    std::string& out_;
+    size_t base_;
+    // keys repeat across objects, each distinct key is stored once; the
+    // views point into the tree being written
+    std::unordered_map<std::string_view, uint32_t> keys_;
+};
+
+void TapeWriter::PutU32(uint32_t value)
+{
+    char bytes[4];
+    memcpy(bytes, &value, sizeof(bytes));
+    out_.append(bytes, sizeof(bytes));
+}
+
+uint32_t TapeWriter::Offset() const
+{
+    size_t offset = out_.size() - base_;
+    if (offset > UINT32_MAX)
+        throw std::length_error("tape larger than 4GB");
+    return static_cast<uint32_t>(offset);
+}
+
+uint32_t TapeWriter::StartNode(JsonType type, uint32_t word)
+{
+    out_.append((8 - (out_.size() - base_) % 8) % 8, '\0');
+    uint32_t offset = Offset();
+    PutU32(static_cast<uint32_t>(type));
+    PutU32(word);
+    return offset;
+}
+
+uint32_t TapeWriter::WriteString(std::string_view str)
+{
+    if (str.size() > UINT32_MAX)
+        throw std::length_error("tape larger than 4GB");
+    uint32_t offset = StartNode(JsonType::kString,
+        static_cast<uint32_t>(str.size()));
+    out_ += str;
+    out_ += '\0';
+    return offset;
+}
+
+uint32_t TapeWriter::WriteKey(std::string_view key)
+{
+    auto found = keys_.find(key);
+    if (found != keys_.end())
+        return found->second;
+    uint32_t offset = WriteString(key);
+    keys_.emplace(key, offset);
+    return offset;
+}
+
+uint32_t TapeWriter::Write(const JsonElem& elem)
+{
+    switch (elem.type())
+    {
+    case JsonType::kNull:
+    case JsonType::kTrue:
+    case JsonType::kFalse:
+        return StartNode(elem.type(), 0);
+    case JsonType::kNumber:
+    {
+        uint32_t offset = StartNode(JsonType::kNumber, 0);
+        double value = elem.ToNumber();
+        char bytes[8];
+        memcpy(bytes, &value, sizeof(bytes));
+        out_.append(bytes, sizeof(bytes));
+        return offset;
+    }
+    case JsonType::kString:
+        return WriteString(elem.ToString());
+    case JsonType::kArray:
+    {
+        // children are written first so the node can list their offsets
+        const array_t& arr = elem.ToArray();
+        std::vector<uint32_t> children;
+        children.reserve(arr.size());
+        for (const auto& e : arr)
+            children.push_back(Write(e));
+        uint32_t offset = StartNode(JsonType::kArray,
+            static_cast<uint32_t>(children.size()));
+        for (uint32_t child : children)
+            PutU32(child);
+        return offset;
+    }
+    case JsonType::kObject:
+    {
+        std::vector<const object_t::value_type*> entries;
+        entries.reserve(elem.ToObject().size());
+        for (const auto& e : elem.ToObject())
+            entries.push_back(&e);
+        std::sort(entries.begin(), entries.end(),
+            [](const object_t::value_type* a, const object_t::value_type* b)
+            {
+                return a->first < b->first;
+            });
+
+        std::vector<uint32_t> children;
+        children.reserve(entries.size() * 2);
+        for (const auto* e : entries)
+        {
+            children.push_back(WriteKey(e->first));
+            children.push_back(Write(e->second));
+        }
+        uint32_t offset = StartNode(JsonType::kObject,
+            static_cast<uint32_t>(entries.size()));
+        for (uint32_t child : children)
+            PutU32(child);
+        return offset;
+    }
+    default:
+        throw std::runtime_error("invalid type");
+    }
+}
+
+void TapeWriter::WriteDocument(const JsonElem& elem)
+{
+    out_.append(kTapeHeaderSize, '\0');
+    uint32_t root = Write(elem);
+    out_.append((8 - (out_.size() - base_) % 8) % 8, '\0');
+
+    char* header = &out_[base_];
+    uint64_t size = out_.size() - base_;
+    uint64_t checksum = Fnv1a(header + kTapeHeaderSize,
+        size - kTapeHeaderSize);
+    memcpy(header, &kTapeMagic, 4);
+    memcpy(header + 4, &kTapeVersion, 2);
+    memcpy(header + 8, &root, 4);
+    memcpy(header + 16, &size, 8);
+    memcpy(header + 24, &checksum, 8);
+}
+
+}
+
+void polojson::WriteTape(const JsonElem& elem, std::string& out)
+{
+    TapeWriter writer(out);
+    writer.WriteDocument(elem);
+}
+
+uint32_t polojson::TapeElem::Word(size_t index) const
+{
+    uint32_t word;
+    memcpy(&word, base_ + offset_ + index * 4, sizeof(word));
+    return word;
+}
+
+JsonType polojson::TapeElem::type() const noexcept
+{
+    return static_cast<JsonType>(Word(0));
+}
+
+bool polojson::TapeElem::IsNull() const
+{
+    return type() == JsonType::kNull;
+}
+
+bool polojson::TapeElem::IsBoolean() const
+{
+    return (type() == JsonType::kTrue) ||
+        (type() == JsonType::kFalse);
+}
+
+bool polojson::TapeElem::IsNumber() const
+{
+    return type() == JsonType::kNumber;
+}
+
+bool polojson::TapeElem::IsString() const
+{
+    return type() == JsonType::kString;
+}
+
+bool polojson::TapeElem::IsArray() const
+{
+    return type() == JsonType::kArray;
+}
+
+bool polojson::TapeElem::IsObject() const
+{
+    return type() == JsonType::kObject;
+}
+
+bool polojson::TapeElem::ToBoolean() const
+{
+    assert(IsBoolean());
+    return type() == JsonType::kTrue;
+}
+
+double polojson::TapeElem::ToNumber() const
+{
+    assert(IsNumber());
+    double value;
+    memcpy(&value, base_ + offset_ + 8, sizeof(value));
+    return value;
+}
+
+std::string_view polojson::TapeElem::ToString() const
+{
+    assert(IsString());
+    return std::string_view(base_ + offset_ + 8, Word(1));
+}
+
+size_t polojson::TapeElem::size() const
+{
+    assert(IsArray() || IsObject());
+    return Word(1);
+}
+
+TapeElem polojson::TapeElem::operator[](size_t i) const
+{
+    if (!IsArray())
+        throw std::runtime_error("Not a JsonArray object");
+    if (i >= size())
+        throw std::out_of_range("array index out of range");
+    return TapeElem(base_, Word(2 + i));
+}
+
+TapeElem polojson::TapeElem::operator[](std::string_view key) const
+{
+    TapeElem value(base_, 0);
+    if (!Find(key, &value))
+        throw std::out_of_range("key not found");
+    return value;
+}
+
+bool polojson::TapeElem::Find(std::string_view key, TapeElem* value) const
+{
+    if (!IsObject())
+        throw std::runtime_error("Not a JsonObject object");
+    size_t low = 0, high = size();
+    while (low < high)
+    {
+        size_t mid = low + (high - low) / 2;
+        int cmp = KeyAt(mid).compare(key);
+        if (cmp == 0)
+        {
+            *value = ValueAt(mid);
+            return true;
+        }
+        if (cmp < 0)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return false;
+}
+
+std::string_view polojson::TapeElem::KeyAt(size_t i) const
+{
+    assert(IsObject() && i < size());
+    return TapeElem(base_, Word(2 + i * 2)).ToString();
+}
+
+TapeElem polojson::TapeElem::ValueAt(size_t i) const
+{
+    assert(IsObject() && i < size());
+    return TapeElem(base_, Word(3 + i * 2));
+}
+
+polojson::TapeDocument::~TapeDocument()
+{
+    Close();
+}
+
+TapeErrorCode polojson::TapeDocument::GetErrorCode() const
+{
+    return error_code_;
+}
+
+bool polojson::TapeDocument::Open(const std::string& path)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        error_code_ = TapeErrorCode::kOpenFailed;
+        return false;
+    }
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        error_code_ = TapeErrorCode::kTruncated;
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0,
+        nullptr);
+    CloseHandle(file);
+    if (mapping == nullptr)
+    {
+        error_code_ = TapeErrorCode::kOpenFailed;
+        return false;
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        error_code_ = TapeErrorCode::kOpenFailed;
+        return false;
+    }
+    mapping_ = mapping;
+    data_ = static_cast<const char*>(view);
+    size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error_code_ = TapeErrorCode::kOpenFailed;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        error_code_ = TapeErrorCode::kTruncated;
+        return false;
+    }
+    void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+        MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+    {
+        error_code_ = TapeErrorCode::kOpenFailed;
+        return false;
+    }
+    mapping_ = view;
+    data_ = static_cast<const char*>(view);
+    size_ = static_cast<size_t>(st.st_size);
+#endif
+    return CheckHeader();
+}
+
+bool polojson::TapeDocument::Load(std::string tape)
+{
+    Close();
+    owned_ = std::move(tape);
+    data_ = owned_.data();
+    size_ = owned_.size();
+    return CheckHeader();
+}
+
+void polojson::TapeDocument::Close()
+{
+    if (mapping_ != nullptr)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(data_);
+        CloseHandle(static_cast<HANDLE>(mapping_));
+#else
+        munmap(mapping_, size_);
+#endif
+        mapping_ = nullptr;
+    }
+    owned_.clear();
+    data_ = nullptr;
+    size_ = 0;
+}
+
+bool polojson::TapeDocument::CheckHeader()
+{
+    TapeErrorCode code = TapeErrorCode::kOK;
+    uint32_t magic = 0, root = 0;
+    uint16_t version = 0;
+    uint64_t size = 0;
+    if (size_ >= kTapeHeaderSize)
+    {
+        memcpy(&magic, data_, 4);
+        memcpy(&version, data_ + 4, 2);
+        memcpy(&root, data_ + 8, 4);
+        memcpy(&size, data_ + 16, 8);
+    }
+
+    if (size_ < kTapeHeaderSize)
+        code = TapeErrorCode::kTruncated;
+    else if (magic == kSwappedTapeMagic)
+        code = TapeErrorCode::kForeignByteOrder;
+    else if (magic != kTapeMagic)
+        code = TapeErrorCode::kBadMagic;
+    else if (version != kTapeVersion)
+        code = TapeErrorCode::kBadVersion;
+    else if (size != size_ || root < kTapeHeaderSize || root >= size_)
+        code = TapeErrorCode::kTruncated;
+
+    error_code_ = code;
+    if (code != TapeErrorCode::kOK)
+    {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool polojson::TapeDocument::Verify()
+{
+    if (data_ == nullptr)
+        return false;
+    uint64_t checksum;
+    memcpy(&checksum, data_ + 24, 8);
+    if (Fnv1a(data_ + kTapeHeaderSize, size_ - kTapeHeaderSize) != checksum)
+    {
+        error_code_ = TapeErrorCode::kBadChecksum;
+        return false;
+    }
+    uint32_t root;
+    memcpy(&root, data_ + 8, 4);
+    if (!CheckTree(data_, size_, root))
+    {
+        error_code_ = TapeErrorCode::kMalformed;
+        return false;
+    }
+    return true;
+}
+
+TapeElem polojson::TapeDocument::Root() const
+{
+    assert(data_ != nullptr);
+    uint32_t root;
+    memcpy(&root, data_ + 8, 4);
+    return TapeElem(data_, root);
+}
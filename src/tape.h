@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include "util.h"
+
+namespace polojson
+{
+
+// Tape: a relocatable binary snapshot of a JsonElem tree that is queried in
+// place, e.g. straight from an mmapped file shared by many processes.
+//
+// Layout (in the byte order of the machine that wrote it, every node 8 byte
+// aligned, offsets are relative to the start of the tape):
+//   header  u32 magic "PJTP", u16 version, u16 0, u32 root offset, u32 0,
+//           u64 total size, u64 FNV-1a checksum of the bytes after the header
+//   literal u32 type, u32 0
+//   number  u32 type, u32 0, f64 value
+//   string  u32 type, u32 length, bytes, '\0'
+//   array   u32 type, u32 count, u32 element offsets[count]
+//   object  u32 type, u32 count, {u32 key offset, u32 value offset}[count]
+// Object entries are sorted by key so lookups are a binary search, and keys
+// point at string nodes that are shared between objects.
+// Fields are read in place without swapping, so a tape only opens on a
+// machine of the same byte order; others fail with kForeignByteOrder.
+// Children are written before their parent, so every offset in a node is
+// below the node's own. Queries trust the offsets and lengths they read:
+// a tape from an untrusted source must pass Verify() before it is queried.
+const uint32_t kTapeMagic = 0x50544A50; // "PJTP"
+const uint16_t kTapeVersion = 1;
+const size_t kTapeHeaderSize = 32;
+
+enum class TapeErrorCode
+{
+    kOK = 0,
+    kOpenFailed,
+    kTruncated,
+    kBadMagic,
+    kForeignByteOrder, // written on a machine of the other byte order
+    kBadVersion,
+    kBadChecksum,
+    kMalformed  // a node out of bounds, misaligned or of an unknown type
+};
+
+// Appends the tape of elem to out. Tapes are limited to 4GB, larger trees
+// throw std::length_error.
+void WriteTape(const JsonElem& elem, std::string& out);
+
+class TapeElem
+{
+public:
+    TapeElem(const char* base, uint32_t offset) :base_(base), offset_(offset) {}
+
+    JsonType type() const noexcept;
+
+    bool IsNull() const;
+    bool IsBoolean() const;
+    bool IsNumber() const;
+    bool IsString() const;
+    bool IsArray() const;
+    bool IsObject() const;
+
+    bool ToBoolean() const;
+    double ToNumber() const;
+    std::string_view ToString() const;
+    size_t size() const; //element count of an array or object
+
+    // Like JsonElem, these throw std::out_of_range for a missing index/key.
+    TapeElem operator[](size_t i) const;
+    TapeElem operator[](std::string_view key) const;
+    bool Find(std::string_view key, TapeElem* value) const;
+
+    // the i-th entry of an object, in key order
+    std::string_view KeyAt(size_t i) const;
+    TapeElem ValueAt(size_t i) const;
+
+private:
+    uint32_t Word(size_t index) const;
+
+    const char* base_;
+    uint32_t offset_;
+};
+
+class TapeDocument
+{
+public:
+    TapeDocument() :data_(nullptr), size_(0), mapping_(nullptr),
+        error_code_(TapeErrorCode::kOK) {}
+    ~TapeDocument();
+    TapeDocument(const TapeDocument&) = delete;
+    TapeDocument& operator=(const TapeDocument&) = delete;
+
+    // Maps the file read-only; only the header is checked, so opening is
+    // O(1) and pages are shared with every other process mapping the file.
+    bool Open(const std::string& path);
+    // Takes a tape held in memory, e.g. produced by WriteTape.
+    bool Load(std::string tape);
+    void Close();
+
+    // Recomputes the checksum and checks every node reachable from the root
+    // (bounds, alignment, types, sorted keys), in time linear in the size
+    // of the tape. Opening checks only the header.
+    bool Verify();
+
+    TapeElem Root() const;
+    size_t size() const { return size_; }
+    TapeErrorCode GetErrorCode() const;
+
+private:
+    bool CheckHeader();
+
+    const char* data_;
+    size_t size_;
+    void* mapping_; //platform mapping handle, null for in-memory tapes
+    std::string owned_;
+
+    TapeErrorCode error_code_;
+};
+}
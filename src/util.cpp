@@ -1,73 +1,302 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define POLOJSON_SSE2 1
+#else
+#define POLOJSON_SSE2 0
+#endif
 #include "util.h"
 using namespace polojson;
 
-polojson::JsonElem::JsonElem(const JsonElem& e)
+namespace
 {
-    switch (e.type())
+
+// nodes are allocated together with their reference counts from resource
+template<typename T, typename... Args>
+std::shared_ptr<JsonValue> MakeValue(std::pmr::memory_resource* resource,
+    Args&&... args)
+{
+    return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(resource),
+        std::forward<Args>(args)...);
+}
+
+// character written after the backslash for bytes that need escaping, 'u'
+// for a \u00XX escape and 0 for bytes copied as is
+struct EscapeTable
+{
+    char escape[256];
+
+    constexpr EscapeTable() :escape()
+    {
+        for (int ch = 0; ch < 0x20; ++ch)
+            escape[ch] = 'u';
+        escape['"'] = '"';
+        escape['\\'] = '\\';
+        escape['\b'] = 'b';
+        escape['\f'] = 'f';
+        escape['\n'] = 'n';
+        escape['\r'] = 'r';
+        escape['\t'] = 't';
+    }
+
+    char operator[](unsigned char ch) const { return escape[ch]; }
+};
+
+constexpr EscapeTable kEscape;
+
+// Index of the first byte in data[pos, size) that needs escaping, size when
+// there is none. With SSE2 it tests 16 bytes per step.
+size_t FindEscape(const char* data, size_t pos, size_t size)
+{
+#if POLOJSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    for (; pos + 16 <= size; pos += 16)
+    {
+        __m128i chunk = _mm_loadu_si128(
+            reinterpret_cast<const __m128i*>(data + pos));
+        // unsigned ch <= 0x1F exactly when max(ch, 0x1F) == 0x1F
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0)
+        {
+            int bit = 0;
+            while (!(mask & (1 << bit)))
+                ++bit;
+            return pos + bit;
+        }
+    }
+#endif
+    for (; pos < size; ++pos)
+    {
+        if (kEscape[static_cast<unsigned char>(data[pos])])
+            return pos;
+    }
+    return size;
+}
+
+
+uint64_t Mix(uint64_t x)
+{
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+uint64_t HashBytes(std::string_view str)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (char ch : str)
+    {
+        hash ^= static_cast<unsigned char>(ch);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t NumberHash(double value)
+{
+    if (value == 0)
+        value = 0; // -0 == 0
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return Mix(bits ^ 0x4E554D);
+}
+
+// both hashes are known and tell the values apart
+bool HashesDiffer(const JsonValue& a, const JsonValue& b)
+{
+    std::atomic<uint64_t>* slot_a = a.HashSlot();
+    std::atomic<uint64_t>* slot_b = b.HashSlot();
+    if (slot_a == nullptr || slot_b == nullptr)
+        return false;
+    uint64_t hash_a = slot_a->load(std::memory_order_relaxed);
+    uint64_t hash_b = slot_b->load(std::memory_order_relaxed);
+    return hash_a != 0 && hash_b != 0 && hash_a != hash_b;
+}
+
+// allocate_shared puts the node next to its reference counts: a vtable
+// pointer, two counters and the allocator
+const size_t kControlBlockBytes = sizeof(void*) + 2 * sizeof(int) +
+    sizeof(std::pmr::polymorphic_allocator<char>);
+
+size_t StringHeapBytes(const std::string& s)
+{
+    static const size_t inline_capacity = std::string().capacity();
+    return s.capacity() > inline_capacity ? s.capacity() + 1 : 0;
+}
+
+size_t StringHeapBytes(const string_t& s)
+{
+    static const size_t inline_capacity = string_t().capacity();
+    return s.capacity() > inline_capacity ? s.capacity() + 1 : 0;
+}
+
+// bytes of one node without its children's values
+size_t NodeBytes(const JsonValue& value)
+{
+    size_t bytes = kControlBlockBytes;
+    switch (value.type())
     {
-    case JsonType::kNull:
-        value_ = std::make_unique<JsonNull>(nullptr);
-        break;
-    case JsonType::kFalse:
-        value_ = std::make_unique<JsonFalse>(nullptr);
-        break;
-    case JsonType::kTrue:
-        value_ = std::make_unique<JsonTrue>(nullptr);
-        break;
     case JsonType::kNumber:
-        value_ = std::make_unique<JsonNumber>(e.ToNumber());
+    {
+        const string_t* raw = value.RawNumber();
+        if (raw != nullptr)
+            bytes += sizeof(JsonRawNumber) + StringHeapBytes(*raw);
+        else
+            bytes += sizeof(JsonNumber);
         break;
+    }
     case JsonType::kString:
-        value_ = std::make_unique<JsonString>(e.ToString());
+        bytes += sizeof(JsonString) + StringHeapBytes(value.ToString());
         break;
     case JsonType::kArray:
-        value_ = std::make_unique<JsonArray>(e.ToArray());
+        if (const auto* numbers = value.NumberArray())
+        {
+            bytes += sizeof(JsonNumberArray) +
+                numbers->capacity() * sizeof(double);
+            // elements built by a const ToArray() or operator[]
+            const array_t* elements =
+                static_cast<const JsonNumberArray&>(value).Elements();
+            if (elements != nullptr)
+                bytes += elements->capacity() * sizeof(JsonElem) +
+                    elements->size() * (kControlBlockBytes + sizeof(JsonNumber));
+            break;
+        }
+        bytes += sizeof(JsonArray) +
+            value.ToArray().capacity() * sizeof(JsonElem);
         break;
     case JsonType::kObject:
-        value_ = std::make_unique<JsonObject>(e.ToObject());
+    {
+        // buckets plus one node per entry: next pointer, entry and the
+        // cached hash code
+        const object_t& obj = value.ToObject();
+        bytes += sizeof(JsonObject) + obj.bucket_count() * sizeof(void*) +
+            obj.size() * (sizeof(void*) + sizeof(object_t::value_type) +
+                sizeof(size_t));
+        for (const auto& e : obj)
+            bytes += StringHeapBytes(e.first);
         break;
+    }
     default:
-        value_ = std::make_unique<JsonNull>(nullptr);
+        bytes += sizeof(JsonNull);
         break;
     }
+    if (JsonValue::StringifyCacheSlot* slot = value.CacheSlot())
+    {
+        JsonValue::stringify_cache_ptr cache = slot->Load();
+        if (cache)
+            bytes += kControlBlockBytes + sizeof(JsonValue::StringifyCache) +
+                StringHeapBytes(cache->text);
+    }
+    return bytes;
 }
 
-polojson::JsonElem::JsonElem(JsonElem&& e) noexcept
-{
-    value_ = std::move(e.value_);
-    e.value_.reset(nullptr);
 }
 
+polojson::JsonElem::JsonElem(const JsonElem& e) :
+    value_(e.value_) {}
+
+polojson::JsonElem::JsonElem(JsonElem&& e) noexcept :
+    value_(std::move(e.value_)) {}
+
 polojson::JsonElem::~JsonElem() {}
 
-JsonElem& polojson::JsonElem::operator=(JsonElem& other)
+JsonElem& polojson::JsonElem::operator=(const JsonElem& other)
+{
+    value_ = other.value_;
+    return *this;
+}
+
+JsonElem& polojson::JsonElem::operator=(JsonElem&& other) noexcept
 {
-    std::swap(value_, other.value_);
+    value_ = std::move(other.value_);
     return *this;
 }
 
-polojson::JsonElem::JsonElem(std::nullptr_t) :
-    value_(std::make_unique<JsonNull>(nullptr)) {}
+polojson::JsonElem::JsonElem(std::nullptr_t,
+    std::pmr::memory_resource* resource) :
+    value_(MakeValue<JsonNull>(resource, resource)) {}
 
-polojson::JsonElem::JsonElem(bool val)
+polojson::JsonElem::JsonElem(bool val, std::pmr::memory_resource* resource)
 {
     if (val)
-        value_ = std::make_unique<JsonTrue>(nullptr);
+        value_ = MakeValue<JsonTrue>(resource, resource);
     else
-        value_ = std::make_unique<JsonFalse>(nullptr);
+        value_ = MakeValue<JsonFalse>(resource, resource);
 }
 
-polojson::JsonElem::JsonElem(double val) :
-    value_(std::make_unique<JsonNumber>(val)) {}
+polojson::JsonElem::JsonElem(double val, std::pmr::memory_resource* resource) :
+    value_(MakeValue<JsonNumber>(resource, val, resource)) {}
+
+polojson::JsonElem::JsonElem(std::string_view val,
+    std::pmr::memory_resource* resource) :
+    value_(MakeValue<JsonString>(resource, string_t(val, resource))) {}
 
-polojson::JsonElem::JsonElem(const std::string& val) :
-    value_(std::make_unique<JsonString>(val)) {}
+polojson::JsonElem::JsonElem(string_t&& val) :
+    value_(MakeValue<JsonString>(val.get_allocator().resource(),
+        std::move(val))) {}
 
 polojson::JsonElem::JsonElem(const array_t& val) :
-    value_(std::make_unique<JsonArray>(val)) {}
+    value_(MakeValue<JsonArray>(val.get_allocator().resource(), val)) {}
+
+polojson::JsonElem::JsonElem(array_t&& val) :
+    value_(MakeValue<JsonArray>(val.get_allocator().resource(),
+        std::move(val))) {}
 
 polojson::JsonElem::JsonElem(const object_t& val):
-    value_(std::make_unique<JsonObject>(val)) {}
+    value_(MakeValue<JsonObject>(val.get_allocator().resource(), val)) {}
+
+polojson::JsonElem::JsonElem(object_t&& val) :
+    value_(MakeValue<JsonObject>(val.get_allocator().resource(),
+        std::move(val))) {}
+
+JsonElem polojson::JsonElem::FromRawNumber(std::string_view text,
+    std::pmr::memory_resource* resource)
+{
+    JsonElem elem;
+    elem.value_ = MakeValue<JsonRawNumber>(resource, string_t(text, resource));
+    return elem;
+}
+
+JsonElem polojson::JsonElem::FromNumbers(std::span<const double> numbers,
+    std::pmr::memory_resource* resource)
+{
+    JsonElem elem;
+    elem.value_ = MakeValue<JsonNumberArray>(resource,
+        std::pmr::vector<double>(numbers.begin(), numbers.end(), resource));
+    return elem;
+}
+
+const array_t& polojson::JsonNumberArray::ToArray() const
+{
+    std::call_once(once_, [this]
+        {
+            std::pmr::memory_resource* resource =
+                value_.get_allocator().resource();
+            elements_.reserve(value_.size());
+            for (double number : value_)
+                elements_.emplace_back(number, resource);
+            built_.store(true, std::memory_order_release);
+        });
+    return elements_;
+}
+
+const array_t* polojson::JsonNumberArray::Elements() const
+{
+    return built_.load(std::memory_order_acquire) ? &elements_ : nullptr;
+}
 
 JsonType polojson::JsonElem::type() const noexcept
 {
@@ -105,32 +334,34 @@ bool polojson::JsonElem::IsObject() const
     return type() == JsonType::kObject;
 }
 
+bool polojson::JsonElem::IsNumberArray() const
+{
+    return value_->NumberArray() != nullptr;
+}
+
+std::pmr::memory_resource* polojson::JsonElem::Resource() const
+{
+    return value_ ? value_->Resource() : std::pmr::get_default_resource();
+}
+
 void polojson::JsonElem::SetNull()
 {
-    value_.reset(nullptr);
-    value_ = std::make_unique<JsonNull>(nullptr);
+    *this = JsonElem{ nullptr, Resource() };
 }
 
 void polojson::JsonElem::SetBoolean(bool val)
 {
-    value_.reset(nullptr);
-    if (val)
-        value_ = std::make_unique<JsonTrue>(nullptr);
-    else
-        value_ = std::make_unique<JsonFalse>(nullptr);
+    *this = JsonElem{ val, Resource() };
 }
 
-
 void polojson::JsonElem::SetNumber(double val)
 {
-    value_.reset(nullptr);
-    value_ = std::make_unique<JsonNumber>(val);
+    *this = JsonElem{ val, Resource() };
 }
 
-void polojson::JsonElem::SetString(const std::string& val)
+void polojson::JsonElem::SetString(std::string_view val)
 {
-    value_.reset(nullptr);
-    value_ = std::make_unique<JsonString>(val);
+    *this = JsonElem{ val, Resource() };
 }
 
 bool polojson::JsonElem::ToBoolean() const
@@ -145,7 +376,23 @@ double polojson::JsonElem::ToNumber() const
     return value_->ToNumber();;
 }
 
-const std::string& polojson::JsonElem::ToString() const
+int64_t polojson::JsonElem::ToInt64() const
+{
+    assert(IsNumber());
+    return value_->ToInt64();
+}
+
+int64_t polojson::JsonValue::ToInt64() const
+{
+    double value = ToNumber();
+    // 2^63 itself is not representable, hence < rather than <=
+    if (value >= -9223372036854775808.0 && value < 9223372036854775808.0 &&
+        value == static_cast<double>(static_cast<int64_t>(value)))
+        return static_cast<int64_t>(value);
+    throw std::range_error("Number is not an int64");
+}
+
+const string_t& polojson::JsonElem::ToString() const
 {
     assert(IsString());
     return value_->ToString();
@@ -157,6 +404,15 @@ const array_t& polojson::JsonElem::ToArray() const
     return value_->ToArray();
 }
 
+std::span<const double> polojson::JsonElem::ToNumberArray() const
+{
+    assert(IsNumberArray());
+    const std::pmr::vector<double>* numbers = value_->NumberArray();
+    if (numbers == nullptr)
+        throw std::runtime_error("Not a number array");
+    return *numbers;
+}
+
 const object_t& polojson::JsonElem::ToObject() const
 {
     assert(IsObject());
@@ -166,110 +422,492 @@ const object_t& polojson::JsonElem::ToObject() const
 object_t& polojson::JsonElem::ToObject()
 {
     assert(IsObject());
+    BeginWrite();
     return value_->ToObject();
 }
 
-std::string polojson::JsonElem::Stringify() const
+void polojson::JsonElem::BeginWrite()
 {
-    switch (value_->type())
+    if (value_ == nullptr)
+        return;
+    if (const auto* numbers = value_->NumberArray())
     {
-    case JsonType::kNull:
-        return "null";
-    case JsonType::kTrue:
-        return "true";
-    case JsonType::kFalse:
-        return "false";
-    case JsonType::kNumber:
+        // writes need an element to hand out, so the numbers become an
+        // ordinary array, in their resource
+        std::pmr::memory_resource* resource =
+            numbers->get_allocator().resource();
+        array_t arr(resource);
+        arr.reserve(numbers->size());
+        for (double number : *numbers)
+            arr.emplace_back(number, resource);
+        *this = JsonElem{ std::move(arr) };
+        return;
+    }
+    if (value_.use_count() <= 1)
     {
-        char buffer[32];
-        int length = sprintf_s(buffer, "%.17g", value_->ToNumber());
-        return buffer;
+        // the caller may change anything below this value
+        JsonValue::StringifyCacheSlot* slot = value_->CacheSlot();
+        if (slot != nullptr)
+            slot->Store(nullptr);
+        std::atomic<uint64_t>* hash = value_->HashSlot();
+        if (hash != nullptr)
+            hash->store(0, std::memory_order_relaxed);
+        return;
     }
-    case JsonType::kString:
-        return StringifyString();
+    // children are shared by the copied container, so only this level is
+    // duplicated; deeper levels are copied when a write reaches them
+    switch (value_->type())
+    {
     case JsonType::kArray:
-        return StringfyArray();
+        *this = JsonElem{ value_->ToArray() };
+        break;
     case JsonType::kObject:
-        return StringfyObject();
+        *this = JsonElem{ static_cast<const JsonValue&>(*value_).ToObject() };
+        break;
     default:
         break;
     }
-    throw std::runtime_error("invalid type");
 }
 
-std::string polojson::JsonElem::StringifyString() const
+std::string polojson::JsonElem::Stringify() const
 {
-    static const char hex_digits[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
-    std::string ret = "\"";
-    for (auto e : value_->ToString())
+    std::string ret;
+    Stringify(ret);
+    return ret;
+}
+
+void polojson::JsonElem::Stringify(std::string& out) const
+{
+    StringifyImpl(out, nullptr);
+}
+
+void polojson::JsonElem::Stringify(std::string& out,
+    const StringifyCacheOptions& options) const
+{
+    StringifyImpl(out, &options);
+}
+
+std::string polojson::JsonElem::Stringify(
+    const StringifyCacheOptions& options) const
+{
+    std::string ret;
+    StringifyImpl(ret, &options);
+    return ret;
+}
+
+void polojson::JsonElem::StringifyImpl(std::string& out,
+    const StringifyCacheOptions* options) const
+{
+    // Containers are walked with an explicit stack instead of recursion, so
+    // deep trees cannot exhaust the call stack and every level appends to
+    // the same output buffer instead of returning a temporary string.
+    struct Frame
+    {
+        const JsonElem* elem;
+        size_t index;
+        object_t::const_iterator iter;
+        size_t start;        //offset of the container's text in out
+        size_t cached_below; //cache bytes kept by its descendants
+    };
+    std::vector<Frame> stack;
+    const JsonElem* cur = this;
+    size_t cached_total = 0; //cache bytes kept in the whole tree so far
+    size_t cached_done = 0;  //cache bytes kept by the value just written
+
+    for (;;)
     {
-        switch (e)
+        cached_done = 0;
+        switch (cur->type())
+        {
+        case JsonType::kNull:
+            out += "null";
+            break;
+        case JsonType::kTrue:
+            out += "true";
+            break;
+        case JsonType::kFalse:
+            out += "false";
+            break;
+        case JsonType::kNumber:
+            if (const string_t* raw = cur->value_->RawNumber())
+                out += *raw;
+            else
+                StringifyNumber(cur->ToNumber(), out);
+            break;
+        case JsonType::kString:
+            StringifyString(cur->ToString(), out);
+            break;
+        case JsonType::kArray:
         {
-        case '\"': ret += "\\\""; break;
-        case '\\': ret += "\\\\"; break;
-        case '\b': ret += "\\b"; break;
-        case '\f': ret += "\\f"; break;
-        case '\n': ret += "\\n"; break;
-        case '\r': ret += "\\r"; break;
-        case '\t': ret += "\\t"; break;
+            if (const auto* numbers = cur->value_->NumberArray())
+            {
+                out += '[';
+                for (size_t i = 0; i < numbers->size(); ++i)
+                {
+                    if (i > 0)
+                        out += ',';
+                    StringifyNumber((*numbers)[i], out);
+                }
+                out += ']';
+                break;
+            }
+            if (cur->StringifyFromCache(out, options, &cached_total,
+                &cached_done))
+                break;
+            const array_t& arr = cur->ToArray();
+            if (arr.empty())
+            {
+                out += "[]";
+                break;
+            }
+            stack.push_back(Frame{ cur, 0, object_t::const_iterator(),
+                out.size(), 0 });
+            out += '[';
+            cur = &arr[0];
+            continue;
+        }
+        case JsonType::kObject:
+        {
+            if (cur->StringifyFromCache(out, options, &cached_total,
+                &cached_done))
+                break;
+            const object_t& obj = cur->ToObject();
+            if (obj.empty())
+            {
+                out += "{}";
+                break;
+            }
+            auto iter = obj.begin();
+            stack.push_back(Frame{ cur, 0, iter, out.size(), 0 });
+            out += '{';
+            StringifyString(iter->first, out);
+            out += ':';
+            cur = &iter->second;
+            continue;
+        }
         default:
-            unsigned char ch = static_cast<unsigned char>(e);
-            if (ch < 0x20)
+            throw std::runtime_error("invalid type");
+        }
+
+        // cur is fully written, close finished containers until one of them
+        // still has a next child
+        for (;;)
+        {
+            if (stack.empty())
+                return;
+            Frame& top = stack.back();
+            top.cached_below += cached_done;
+            if (top.elem->IsArray())
             {
-                ret += "\\u00";
-                ret += hex_digits[ch >> 4];
-                ret += hex_digits[ch & 0b1111];
+                const array_t& arr = top.elem->ToArray();
+                if (++top.index < arr.size())
+                {
+                    out += ',';
+                    cur = &arr[top.index];
+                    break;
+                }
+                out += ']';
             }
             else
-                ret += e;
+            {
+                if (++top.iter != top.elem->ToObject().end())
+                {
+                    out += ',';
+                    StringifyString(top.iter->first, out);
+                    out += ':';
+                    cur = &top.iter->second;
+                    break;
+                }
+                out += '}';
+            }
+
+            cached_done = top.cached_below;
+            size_t size = out.size() - top.start;
+            if (options != nullptr && size >= options->min_bytes &&
+                cached_total + size <= options->max_bytes)
+            {
+                auto cache = std::make_shared<JsonValue::StringifyCache>();
+                cache->text.assign(out, top.start, size);
+                cache->subtree_bytes = size + top.cached_below;
+                cached_total += size;
+                cached_done = cache->subtree_bytes;
+                top.elem->value_->CacheSlot()->Store(std::move(cache));
+            }
+            stack.pop_back();
         }
     }
-    return ret + '"';
 }
 
-std::string polojson::JsonElem::StringfyArray() const
+bool polojson::JsonElem::StringifyFromCache(std::string& out,
+    const StringifyCacheOptions* options, size_t* cached_total,
+    size_t* cached_done) const
 {
-    std::string ret = "[";
-    for (size_t i = 0; i < value_->ToArray().size(); ++i)
+    JsonValue::StringifyCacheSlot* slot = value_->CacheSlot();
+    JsonValue::stringify_cache_ptr cache = slot->Load();
+    if (!cache)
+        return false;
+    if (options != nullptr)
     {
-        if (i > 0)
-            ret += ",";
-        ret += value_->ToArray()[i].Stringify();
+        if (*cached_total + cache->subtree_bytes > options->max_bytes)
+        {
+            // over the cap, drop it and rebuild from the children
+            slot->Store(nullptr);
+            return false;
+        }
+        *cached_total += cache->subtree_bytes;
+    }
+    *cached_done = cache->subtree_bytes;
+    out += cache->text;
+    return true;
+}
+
+void polojson::JsonElem::ClearStringifyCache()
+{
+    std::vector<const JsonElem*> pending{ this };
+    while (!pending.empty())
+    {
+        const JsonElem* e = pending.back();
+        pending.pop_back();
+        JsonValue::StringifyCacheSlot* slot = e->value_->CacheSlot();
+        if (slot == nullptr)
+            continue;
+        slot->Store(nullptr);
+        if (e->IsArray())
+        {
+            for (const auto& child : e->ToArray())
+                pending.push_back(&child);
+        }
+        else
+        {
+            for (const auto& child : e->ToObject())
+                pending.push_back(&child.second);
+        }
     }
-    ret += "]";
-    return ret;
 }
 
-std::string polojson::JsonElem::StringfyObject() const
+void polojson::StringifyNumber(double value, std::string& out)
 {
-    std::string ret = "{";
-    for (auto i = value_->ToObject().begin(); i != value_->ToObject().end();
-        ++i)
+    char buffer[32];
+    int length = snprintf(buffer, sizeof(buffer), "%.17g", value);
+    out.append(buffer, length);
+}
+
+void polojson::StringifyString(std::string_view value, std::string& out)
+{
+    static const char hex_digits[] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+    const char* data = value.data();
+    size_t size = value.size();
+    // grow geometrically, an exact reserve per string would reallocate on
+    // every call when writing a long document
+    size_t needed = out.size() + size + 2;
+    if (needed > out.capacity())
+        out.reserve(std::max(needed, out.capacity() * 2));
+
+    out += '"';
+    size_t run = 0;
+    for (size_t i = FindEscape(data, 0, size); i != size;
+        i = FindEscape(data, run, size))
     {
-        if(i!=value_->ToObject().begin())
-            ret += ",";
-        ret += "\"" + i->first + "\"";
-        ret += ":" + i->second.Stringify();
+        out.append(data + run, i - run);
+        unsigned char ch = static_cast<unsigned char>(data[i]);
+        char escape = kEscape[ch];
+        if (escape == 'u')
+        {
+            const char text[] = { '\\', 'u', '0', '0', hex_digits[ch >> 4],
+                hex_digits[ch & 0b1111] };
+            out.append(text, sizeof(text));
+        }
+        else
+        {
+            const char text[] = { '\\', escape };
+            out.append(text, sizeof(text));
+        }
+        run = i + 1;
     }
-    ret += "}";
-    return ret;
+    out.append(data + run, size - run);
+    out += '"';
 }
+
 JsonElem& polojson::JsonElem::operator[](size_t i)
 {
+    BeginWrite();
     return (*value_.get())[i];
 }
 
 const JsonElem& polojson::JsonElem::operator[](size_t i) const
 {
-    return (*value_.get())[i];
+    return static_cast<const JsonValue&>(*value_)[i];
 }
 
-JsonElem& polojson::JsonElem::operator[](const std::string& key)
+JsonElem& polojson::JsonElem::operator[](std::string_view key)
 {
+    BeginWrite();
     return (*value_.get())[key];
 }
 
-const JsonElem& polojson::JsonElem::operator[](const std::string& key) const
+const JsonElem& polojson::JsonElem::operator[](std::string_view key) const
 {
     return (*value_.get())[key];
-}
\ No newline at end of file
+}
+
+namespace
+{
+
+bool NumbersEqual(const std::pmr::vector<double>& numbers, const array_t& arr)
+{
+    if (numbers.size() != arr.size())
+        return false;
+    for (size_t i = 0; i < numbers.size(); ++i)
+    {
+        if (!arr[i].IsNumber() || arr[i].ToNumber() != numbers[i])
+            return false;
+    }
+    return true;
+}
+
+}
+
+bool polojson::JsonElem::operator==(const JsonElem& other) const
+{
+    if (value_ == other.value_)
+        return true;
+    if (type() != other.type())
+        return false;
+    switch (type())
+    {
+    case JsonType::kNumber:
+        return ToNumber() == other.ToNumber();
+    case JsonType::kString:
+        return ToString() == other.ToString();
+    case JsonType::kArray:
+    {
+        const auto* numbers_a = value_->NumberArray();
+        const auto* numbers_b = other.value_->NumberArray();
+        if (numbers_a != nullptr || numbers_b != nullptr)
+        {
+            if (HashesDiffer(*value_, *other.value_))
+                return false;
+            if (numbers_a != nullptr && numbers_b != nullptr)
+                return *numbers_a == *numbers_b;
+            if (numbers_a != nullptr)
+                return NumbersEqual(*numbers_a, other.ToArray());
+            return NumbersEqual(*numbers_b, ToArray());
+        }
+        const array_t& a = ToArray();
+        const array_t& b = other.ToArray();
+        if (a.size() != b.size() || HashesDiffer(*value_, *other.value_))
+            return false;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            if (a[i] != b[i])
+                return false;
+        }
+        return true;
+    }
+    case JsonType::kObject:
+    {
+        const object_t& a = ToObject();
+        const object_t& b = other.ToObject();
+        if (a.size() != b.size() || HashesDiffer(*value_, *other.value_))
+            return false;
+        for (const auto& e : a)
+        {
+            auto found = b.find(e.first);
+            if (found == b.end() || e.second != found->second)
+                return false;
+        }
+        return true;
+    }
+    default:
+        return true;
+    }
+}
+
+bool polojson::JsonElem::operator!=(const JsonElem& other) const
+{
+    return !(*this == other);
+}
+
+size_t polojson::JsonElem::MemoryUsage() const
+{
+    size_t bytes = 0;
+    std::unordered_set<const JsonValue*> shared;
+    std::vector<const JsonElem*> stack{ this };
+    while (!stack.empty())
+    {
+        const JsonElem* e = stack.back();
+        stack.pop_back();
+        if (e->value_.use_count() > 1 && !shared.insert(e->value_.get()).second)
+            continue;
+        bytes += NodeBytes(*e->value_);
+        if (e->IsNumberArray())
+            continue; //counted with the node
+        if (e->IsArray())
+        {
+            for (const auto& child : e->ToArray())
+                stack.push_back(&child);
+        }
+        else if (e->IsObject())
+        {
+            for (const auto& entry : e->ToObject())
+                stack.push_back(&entry.second);
+        }
+    }
+    return bytes;
+}
+
+uint64_t polojson::JsonElem::Hash() const
+{
+    std::atomic<uint64_t>* slot = value_->HashSlot();
+    if (slot != nullptr)
+    {
+        uint64_t cached = slot->load(std::memory_order_relaxed);
+        if (cached != 0)
+            return cached;
+    }
+
+    uint64_t hash;
+    switch (type())
+    {
+    case JsonType::kNumber:
+        hash = NumberHash(ToNumber());
+        break;
+    case JsonType::kString:
+        hash = Mix(HashBytes(ToString()) ^ 0x535452);
+        break;
+    case JsonType::kArray:
+        if (const auto* numbers = value_->NumberArray())
+        {
+            // the same as an array_t of the same numbers
+            hash = Mix(0x415252 + numbers->size());
+            for (double number : *numbers)
+            {
+                uint64_t element = NumberHash(number);
+                hash = Mix(hash ^ (element == 0 ? 1 : element));
+            }
+            break;
+        }
+        hash = Mix(0x415252 + ToArray().size());
+        for (const auto& e : ToArray())
+            hash = Mix(hash ^ e.Hash());
+        break;
+    case JsonType::kObject:
+    {
+        // summing the entry hashes makes the result independent of order
+        uint64_t sum = 0;
+        for (const auto& e : ToObject())
+            sum += Mix(HashBytes(e.first) ^ Mix(e.second.Hash()));
+        hash = Mix(sum ^ Mix(0x4F424A + ToObject().size()));
+        break;
+    }
+    default:
+        hash = Mix(static_cast<uint64_t>(type()) + 1);
+        break;
+    }
+
+    if (hash == 0)
+        hash = 1;
+    if (slot != nullptr)
+        slot->store(hash, std::memory_order_relaxed);
+    return hash;
+}
@@ -1,5 +1,14 @@
 #pragma once
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory_resource>
+#include <mutex>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <memory>
@@ -10,9 +19,36 @@ namespace polojson
 {
     class JsonElem;
     class JsonValue;
-
-    using array_t = std::vector<JsonElem>;
-    using object_t = std::unordered_map<std::string, JsonElem>;
+    class Parser;
+    class FrozenDocument;
+
+    // Strings, arrays and objects allocate from a std::pmr::memory_resource,
+    // and so do the nodes holding them, so a whole document can live in a
+    // per-request arena, shared memory or a huge page pool; see
+    // Parser::Parse. Nodes built without a resource use the default one.
+    using string_t = std::pmr::string;
+    using array_t = std::pmr::vector<JsonElem>;
+
+    // keys hash and compare as string_view, so lookups by std::string,
+    // string_view or a literal do not have to build a string_t first
+    struct KeyHash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view key) const
+        {
+            return std::hash<std::string_view>()(key);
+        }
+    };
+    struct KeyEqual
+    {
+        using is_transparent = void;
+        bool operator()(std::string_view a, std::string_view b) const
+        {
+            return a == b;
+        }
+    };
+    using object_t = std::pmr::unordered_map<string_t, JsonElem, KeyHash,
+        KeyEqual>;
     
     enum class JsonType
     {
@@ -41,24 +77,87 @@ namespace polojson
         kMissKey,
         kMissColon,
         kMissCommaOrCurlyBracket,
+        kMissField,     // a bound struct field is absent
+        kTypeMismatch,  // a value does not fit the bound C++ type
+        kSchemaViolation, // the document breaks the schema it is parsed with
+        kInvalidPointer,  // a malformed or overlapping JSON Pointer edit
+        kMissTarget,      // a JSON Pointer edit leads nowhere
+        kNestingTooDeep,  // binary input nested deeper than the decoder allows
         kUnknown
     };
 
+    // Text of a single number or string, appended to out. Every writer goes
+    // through these so they all produce the same bytes.
+    void StringifyNumber(double value, std::string& out);
+    void StringifyString(std::string_view value, std::string& out);
+
+    // Caching for JsonElem::Stringify(out, options): containers whose text is
+    // at least min_bytes long keep it, up to max_bytes for the document, and
+    // the next call copies those spans instead of re-serializing them.
+    // Writes through the non-const operator[] and ToObject() drop the cache
+    // (and the cached Hash()) of every container on the way from the root,
+    // so later calls re-emit only the changed path. A reference kept from
+    // before a cached Stringify or Hash must not be written through,
+    // because its ancestors would keep their stale state; index again from
+    // the root instead.
+    // Plain Stringify() reuses existing caches but never adds any, and
+    // ClearStringifyCache() frees a document's cache.
+    struct StringifyCacheOptions
+    {
+        size_t max_bytes = 64 << 20;
+        size_t min_bytes = 64;
+    };
+
+    // JsonElem shares its value with every copy: copying only bumps an atomic
+    // reference count, so documents can be handed across threads cheaply.
+    // Writes go through the non-const operator[] and ToObject(), which
+    // first duplicate the container they are called on if it is shared, so
+    // indexing from the root copies only the path that is written to.
+    // Sharing is only detected at the container being written: a reference
+    // obtained from a document before it was copied still points into the
+    // value both copies share, and writing through it changes both
+    //
+    //   JsonElem& r = a["x"];
+    //   JsonElem b = a;
+    //   r["y"].SetNumber(1); // b sees it too, and so would readers of b
+    //
+    // Do not write through references taken before a copy (including one
+    // handed to SnapshotHolder::Publish); index again from the root.
     class JsonElem
     {
     public:
         JsonElem():value_(nullptr) { }
-        JsonElem(const JsonElem&); //copy constructor
+        JsonElem(const JsonElem&); //copy constructor, O(1)
         JsonElem(JsonElem&&) noexcept;
         ~JsonElem();
-        JsonElem& operator=(JsonElem&);
-
-        explicit JsonElem(std::nullptr_t);      // null
-        explicit JsonElem(bool);                // true or false
-        explicit JsonElem(double);              // number
-        explicit JsonElem(const std::string&);  // string
+        JsonElem& operator=(const JsonElem&);
+        JsonElem& operator=(JsonElem&&) noexcept;
+
+        // Scalars take the resource for their node. Strings, arrays and
+        // objects given as string_t/array_t/object_t use the resource of
+        // their allocator, which a copy keeps.
+        explicit JsonElem(std::nullptr_t,       // null
+            std::pmr::memory_resource* = std::pmr::get_default_resource());
+        explicit JsonElem(bool,                 // true or false
+            std::pmr::memory_resource* = std::pmr::get_default_resource());
+        explicit JsonElem(double,               // number
+            std::pmr::memory_resource* = std::pmr::get_default_resource());
+        explicit JsonElem(std::string_view,     // string
+            std::pmr::memory_resource* = std::pmr::get_default_resource());
+        explicit JsonElem(string_t&&);
         explicit JsonElem(const array_t&);      // array
+        explicit JsonElem(array_t&&);
         explicit JsonElem(const object_t&);     // object
+        explicit JsonElem(object_t&&);
+        // number kept as its source text, which must be a valid JSON number;
+        // converted on the first ToNumber() and written back unchanged by
+        // Stringify
+        static JsonElem FromRawNumber(std::string_view text,
+            std::pmr::memory_resource* = std::pmr::get_default_resource());
+        // array of numbers kept as contiguous doubles, like the arrays
+        // parsed with ParseOptions::number_arrays
+        static JsonElem FromNumbers(std::span<const double> numbers,
+            std::pmr::memory_resource* = std::pmr::get_default_resource());
 
         JsonType type() const noexcept;
 
@@ -68,50 +167,137 @@ namespace polojson
         bool IsString() const;
         bool IsArray() const;
         bool IsObject() const;
+        // an array stored as contiguous doubles, see FromNumbers
+        bool IsNumberArray() const;
 
+        // the new value takes the resource of the one it replaces
         void SetNull();
         void SetBoolean(bool);
         void SetNumber(double);
-        void SetString(const std::string&);
+        void SetString(std::string_view);
         //void SetArray();
 
         bool ToBoolean() const;
         double ToNumber() const;
-        const std::string& ToString() const;
+        // exact for integral numbers within range, also beyond 2^53 for raw
+        // numbers; throws std::range_error otherwise
+        int64_t ToInt64() const;
+        const string_t& ToString() const;
         const array_t& ToArray() const;
+        // the elements of a number array, without a node per element
+        std::span<const double> ToNumberArray() const;
         const object_t& ToObject() const;
         object_t& ToObject();
 
         std::string Stringify() const;
+        void Stringify(std::string& out) const; //append to out
+        std::string Stringify(const StringifyCacheOptions&) const;
+        void Stringify(std::string& out, const StringifyCacheOptions&) const;
+        void ClearStringifyCache();
+
+        // Deep structural equality, stopping at the first difference.
+        // Numbers compare as doubles and object key order is irrelevant.
+        bool operator==(const JsonElem&) const;
+        bool operator!=(const JsonElem&) const;
+        // 64-bit hash consistent with operator==, stable across runs and
+        // platforms. Object hashes ignore key order. Containers cache it.
+        uint64_t Hash() const;
+        // Heap bytes held by the tree: nodes, strings, array storage, hash
+        // tables and cached Stringify text. A value shared by several
+        // places in the tree is counted once; allocator overhead is not
+        // included.
+        size_t MemoryUsage() const;
+        // An immutable copy laid out for reading, see frozen.h.
+        FrozenDocument Freeze() const;
         //size_t size() const;
 
         JsonElem& operator[](size_t i);
 
         const JsonElem& operator[](size_t i) const;
 
-        JsonElem& operator[](const std::string& key);
+        JsonElem& operator[](std::string_view key);
 
-        const JsonElem& operator[](const std::string& key) const;
+        const JsonElem& operator[](std::string_view key) const;
 
     private:
-        std::unique_ptr<JsonValue> value_;
-        std::string StringifyString() const;
-        std::string StringfyArray() const;
-        std::string StringfyObject() const;
+        friend class Parser; //ParseInto writes into nodes it owns alone
+
+        void BeginWrite(); //unshare and drop cached text before a write
+        std::pmr::memory_resource* Resource() const; //where value_ lives
+        void StringifyImpl(std::string& out,
+            const StringifyCacheOptions* options) const;
+        bool StringifyFromCache(std::string& out,
+            const StringifyCacheOptions* options, size_t* cached_total,
+            size_t* cached_done) const;
+
+        std::shared_ptr<JsonValue> value_;
     };
 
     class JsonValue
     {
     public:
+        // text kept by a cached Stringify, see StringifyCacheOptions
+        struct StringifyCache
+        {
+            std::string text;
+            size_t subtree_bytes; //text plus all cached text below it
+        };
+        using stringify_cache_ptr = std::shared_ptr<const StringifyCache>;
+
+        // Shared values may be written by concurrent readers, so the cache is
+        // only accessed with std::atomic_load and std::atomic_store. Those
+        // take a lock, which a slot that never held a cache skips.
+        class StringifyCacheSlot
+        {
+        public:
+            stringify_cache_ptr Load() const
+            {
+                if (!used_.load(std::memory_order_acquire))
+                    return nullptr;
+                return std::atomic_load(&cache_);
+            }
+
+            void Store(stringify_cache_ptr cache)
+            {
+                if (cache)
+                    used_.store(true, std::memory_order_release);
+                else if (!used_.load(std::memory_order_acquire))
+                    return;
+                std::atomic_store(&cache_, std::move(cache));
+            }
+
+        private:
+            std::atomic<bool> used_{ false }; //set by the first stored cache
+            stringify_cache_ptr cache_;
+        };
+
         virtual ~JsonValue() = default;
         virtual JsonType type() const = 0;
+        // where the node and the storage it owns were allocated
+        virtual std::pmr::memory_resource* Resource() const = 0;
+
+        // only containers cache their text
+        virtual StringifyCacheSlot* CacheSlot() const { return nullptr; }
+        // cached Hash() of a container, 0 when not computed yet
+        virtual std::atomic<uint64_t>* HashSlot() const { return nullptr; }
         
         virtual double ToNumber() const
         {
             throw std::runtime_error("Not a JsonNumber object");
         }
 
-        virtual const std::string& ToString() const
+        virtual int64_t ToInt64() const;
+
+        // source text of a raw number, nullptr for every other value
+        virtual const string_t* RawNumber() const { return nullptr; }
+
+        // storage of a JsonNumberArray, nullptr for every other value
+        virtual const std::pmr::vector<double>* NumberArray() const
+        {
+            return nullptr;
+        }
+
+        virtual const string_t& ToString() const
         {
             throw std::runtime_error("Not a JsonString object");
         }
@@ -141,12 +327,12 @@ namespace polojson
             throw std::runtime_error("Not a JsonArray object");
         }
 
-        virtual JsonElem& operator[](const std::string&)
+        virtual JsonElem& operator[](std::string_view)
         {
             throw std::runtime_error("Not a JsonObject object");
         }
 
-        virtual const JsonElem& operator[](const std::string&) const
+        virtual const JsonElem& operator[](std::string_view) const
         {
             throw std::runtime_error("Not a JsonObject object");
         }
@@ -159,53 +345,129 @@ namespace polojson
         T value_;
     public:
         JsonValueExt(const T& value) :value_(value) {}
-        JsonValueExt(T&& value) :value_(value) {} //move constructor
+        JsonValueExt(T&& value) :value_(std::move(value)) {} //move constructor
         JsonType type() const { return E; }
     };
 
-  
-    class JsonNull :public JsonValueExt<std::nullptr_t, JsonType::kNull>
+
+    // literals have no value to hold, they keep their resource instead
+    class JsonNull :public JsonValueExt<std::pmr::memory_resource*, JsonType::kNull>
     {
     public:
-        explicit JsonNull(std::nullptr_t) :JsonValueExt(nullptr) {};
+        explicit JsonNull(std::pmr::memory_resource* resource) :
+            JsonValueExt(resource) {}
+        std::pmr::memory_resource* Resource() const override { return value_; }
     };
 
-    class JsonTrue :public JsonValueExt<std::nullptr_t, JsonType::kTrue>
+    class JsonTrue :public JsonValueExt<std::pmr::memory_resource*, JsonType::kTrue>
     {
     public:
-        explicit JsonTrue(std::nullptr_t) :JsonValueExt(nullptr) {}
+        explicit JsonTrue(std::pmr::memory_resource* resource) :
+            JsonValueExt(resource) {}
+        std::pmr::memory_resource* Resource() const override { return value_; }
     };
 
-    class JsonFalse :public JsonValueExt<std::nullptr_t, JsonType::kFalse>
+    class JsonFalse :public JsonValueExt<std::pmr::memory_resource*, JsonType::kFalse>
     {
     public:
-        explicit JsonFalse(std::nullptr_t) :JsonValueExt(nullptr) {}
+        explicit JsonFalse(std::pmr::memory_resource* resource) :
+            JsonValueExt(resource) {}
+        std::pmr::memory_resource* Resource() const override { return value_; }
     };
 
     class JsonNumber :public JsonValueExt<double, JsonType::kNumber>
     {
     public:
-        explicit JsonNumber(double value) :JsonValueExt(value) {}
+        JsonNumber(double value, std::pmr::memory_resource* resource) :
+            JsonValueExt(value), resource_(resource) {}
         double ToNumber() const override { return value_; }
+        void SetNumber(double value) { value_ = value; }
+        std::pmr::memory_resource* Resource() const override
+        {
+            return resource_;
+        }
+
+    private:
+        std::pmr::memory_resource* resource_;
+    };
+
+    // Number parsed with ParseOptions::raw_numbers. The conversion is done
+    // at most once per value; concurrent first calls may both convert, which
+    // is harmless as they store the same result.
+    class JsonRawNumber :public JsonValueExt<string_t, JsonType::kNumber>
+    {
+    public:
+        explicit JsonRawNumber(string_t&& text) :
+            JsonValueExt(std::move(text)) {}
+        std::pmr::memory_resource* Resource() const override
+        {
+            return value_.get_allocator().resource();
+        }
+
+        double ToNumber() const override
+        {
+            if (!converted_.load(std::memory_order_acquire))
+            {
+                number_.store(strtod(value_.c_str(), nullptr),
+                    std::memory_order_relaxed);
+                converted_.store(true, std::memory_order_release);
+            }
+            return number_.load(std::memory_order_relaxed);
+        }
+
+        int64_t ToInt64() const override
+        {
+            int64_t result;
+            const char* end = value_.data() + value_.size();
+            auto parsed = std::from_chars(value_.data(), end, result);
+            if (parsed.ec == std::errc() && parsed.ptr == end)
+                return result;
+            return JsonValue::ToInt64(); //fraction or exponent
+        }
+
+        const string_t* RawNumber() const override { return &value_; }
+
+        void SetText(std::string_view text)
+        {
+            value_.assign(text.data(), text.size());
+            converted_.store(false, std::memory_order_relaxed);
+        }
+
+    private:
+        mutable std::atomic<bool> converted_{ false };
+        mutable std::atomic<double> number_{ 0 };
     };
 
-    class JsonString :public JsonValueExt<std::string, JsonType::kString>
+    class JsonString :public JsonValueExt<string_t, JsonType::kString>
     {
     public:
-        explicit JsonString(std::string value) :JsonValueExt(value) {}
-        explicit JsonString(std::string&& value) :
+        explicit JsonString(string_t&& value) :
             JsonValueExt(std::move(value)) {} //move constructor
-        const std::string& ToString() const override { return value_; }
+        const string_t& ToString() const override { return value_; }
+        string_t& ToString() { return value_; }
+        std::pmr::memory_resource* Resource() const override
+        {
+            return value_.get_allocator().resource();
+        }
     };
 
     class JsonArray :public JsonValueExt<array_t, JsonType::kArray>
     {
     public:
-        explicit JsonArray(const array_t& val) : JsonValueExt(val) {}
+        // copies stay in the resource of the original
+        explicit JsonArray(const array_t& val) :
+            JsonValueExt(array_t(val, val.get_allocator())) {}
         explicit JsonArray(array_t&& val) : JsonValueExt(std::move(val)) {}
 
         const array_t& ToArray() const override { return value_; }
-        
+        array_t& ToArray() { return value_; }
+        std::pmr::memory_resource* Resource() const override
+        {
+            return value_.get_allocator().resource();
+        }
+        StringifyCacheSlot* CacheSlot() const override { return &cache_; }
+        std::atomic<uint64_t>* HashSlot() const override { return &hash_; }
+
         JsonElem& operator[](size_t i) override
         {
             return value_.at(i);
@@ -215,27 +477,100 @@ namespace polojson
         {
             return value_.at(i);
         }
+
+    private:
+        mutable StringifyCacheSlot cache_;
+        mutable std::atomic<uint64_t> hash_{ 0 };
+    };
+
+    // Array whose elements are all numbers, stored as contiguous doubles
+    // instead of a node per element. Writes go through BeginWrite, which
+    // turns it into a JsonArray first. The const ToArray() and operator[]
+    // build the elements once, on the first call, and keep them next to
+    // the doubles; ToNumberArray() and the library's own walks (Stringify,
+    // operator==, Hash, MemoryUsage) never need them. Its text is written
+    // by one loop over the doubles, so it keeps no Stringify cache.
+    class JsonNumberArray :
+        public JsonValueExt<std::pmr::vector<double>, JsonType::kArray>
+    {
+    public:
+        explicit JsonNumberArray(std::pmr::vector<double>&& numbers) :
+            JsonValueExt(std::move(numbers)),
+            elements_(value_.get_allocator()) {}
+
+        const std::pmr::vector<double>* NumberArray() const override
+        {
+            return &value_;
+        }
+        std::pmr::memory_resource* Resource() const override
+        {
+            return value_.get_allocator().resource();
+        }
+
+        const array_t& ToArray() const override;
+        // the elements built by ToArray(), nullptr before the first call
+        const array_t* Elements() const;
+        std::atomic<uint64_t>* HashSlot() const override { return &hash_; }
+
+        const JsonElem& operator[](size_t i) const override
+        {
+            return ToArray().at(i);
+        }
+
+    private:
+        mutable std::once_flag once_;
+        mutable std::atomic<bool> built_{ false };
+        mutable array_t elements_;
+        mutable std::atomic<uint64_t> hash_{ 0 };
     };
     
     class JsonObject :public JsonValueExt<object_t, JsonType::kObject>
     {
     public:
-        explicit JsonObject(const object_t& val) : JsonValueExt(val) {}
+        explicit JsonObject(const object_t& val) :
+            JsonValueExt(object_t(val, val.get_allocator())) {}
         explicit JsonObject(object_t&& val) : JsonValueExt(std::move(val)) {}
 
         const object_t& ToObject() const override { return value_; }
         object_t& ToObject() override { return value_; }
+        std::pmr::memory_resource* Resource() const override
+        {
+            return value_.get_allocator().resource();
+        }
+        StringifyCacheSlot* CacheSlot() const override { return &cache_; }
+        std::atomic<uint64_t>* HashSlot() const override { return &hash_; }
 
         
-        JsonElem& operator[](const std::string& key) override
+        JsonElem& operator[](std::string_view key) override
         {
-            return value_.at(key);
+            auto found = value_.find(key);
+            if (found == value_.end())
+                throw std::out_of_range("Missing key");
+            return found->second;
         }
 
-        const JsonElem& operator[](const std::string& key) const override
+        const JsonElem& operator[](std::string_view key) const override
         {
-            return value_.at(key);
+            auto found = value_.find(key);
+            if (found == value_.end())
+                throw std::out_of_range("Missing key");
+            return found->second;
+        }
+
+    private:
+        mutable StringifyCacheSlot cache_;
+        mutable std::atomic<uint64_t> hash_{ 0 };
+    };
+}
+
+namespace std
+{
+    template<>
+    struct hash<polojson::JsonElem>
+    {
+        size_t operator()(const polojson::JsonElem& e) const
+        {
+            return static_cast<size_t>(e.Hash());
         }
-        
     };
-}
\ No newline at end of file
+}
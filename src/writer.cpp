@@ -0,0 +1,205 @@
+#include "writer.h"
+
+using namespace polojson;
+
+polojson::Writer::Writer(std::string& out, const WriterOptions& options) :
+    out_(&out), sink_(nullptr), options_(options), after_key_(false),
+    complete_(false)
+{
+}
+
+polojson::Writer::Writer(std::ostream& sink, const WriterOptions& options) :
+    out_(&buffer_), sink_(&sink), options_(options), after_key_(false),
+    complete_(false)
+{
+}
+
+void polojson::Writer::NewLine()
+{
+    if (options_.indent <= 0)
+        return;
+    *out_ += '\n';
+    out_->append(stack_.size() * options_.indent, ' ');
+}
+
+// separator and indentation in front of a value
+void polojson::Writer::BeginValue()
+{
+    if (stack_.empty())
+    {
+        assert(!complete_ && "one root value per document, see Reset()");
+        return;
+    }
+    Level& level = stack_.back();
+    if (level.is_object)
+    {
+        assert(after_key_ && "a value in an object needs a Key() first");
+        after_key_ = false;
+        return; //Key() wrote the separator
+    }
+    if (!level.empty)
+        *out_ += ',';
+    level.empty = false;
+    NewLine();
+}
+
+void polojson::Writer::EndValue()
+{
+    if (stack_.empty())
+    {
+        complete_ = true;
+        if (sink_ != nullptr)
+            Flush();
+    }
+    else if (sink_ != nullptr && buffer_.size() >= options_.flush_bytes)
+        Flush();
+}
+
+void polojson::Writer::StartObject()
+{
+    BeginValue();
+    *out_ += '{';
+    stack_.push_back(Level{ true, true });
+}
+
+void polojson::Writer::EndObject()
+{
+    assert(!stack_.empty() && stack_.back().is_object && !after_key_ &&
+        "EndObject() without an open object, or after a Key()");
+    bool empty = stack_.back().empty;
+    stack_.pop_back();
+    if (!empty)
+        NewLine();
+    *out_ += '}';
+    EndValue();
+}
+
+void polojson::Writer::StartArray()
+{
+    BeginValue();
+    *out_ += '[';
+    stack_.push_back(Level{ false, true });
+}
+
+void polojson::Writer::EndArray()
+{
+    assert(!stack_.empty() && !stack_.back().is_object &&
+        "EndArray() without an open array");
+    bool empty = stack_.back().empty;
+    stack_.pop_back();
+    if (!empty)
+        NewLine();
+    *out_ += ']';
+    EndValue();
+}
+
+void polojson::Writer::Key(std::string_view key)
+{
+    assert(!stack_.empty() && stack_.back().is_object && !after_key_ &&
+        "Key() outside an object, or twice in a row");
+    Level& level = stack_.back();
+    if (!level.empty)
+        *out_ += ',';
+    level.empty = false;
+    NewLine();
+    StringifyString(key, *out_);
+    *out_ += options_.indent > 0 ? ": " : ":";
+    after_key_ = true;
+}
+
+void polojson::Writer::Null()
+{
+    BeginValue();
+    *out_ += "null";
+    EndValue();
+}
+
+void polojson::Writer::Bool(bool value)
+{
+    BeginValue();
+    *out_ += value ? "true" : "false";
+    EndValue();
+}
+
+void polojson::Writer::Number(double value)
+{
+    BeginValue();
+    StringifyNumber(value, *out_);
+    EndValue();
+}
+
+void polojson::Writer::RawNumber(std::string_view text)
+{
+    BeginValue();
+    *out_ += text;
+    EndValue();
+}
+
+void polojson::Writer::String(std::string_view value)
+{
+    BeginValue();
+    StringifyString(value, *out_);
+    EndValue();
+}
+
+void polojson::Writer::Value(const JsonElem& elem)
+{
+    if (options_.indent > 0)
+    {
+        WriteTree(elem);
+        return;
+    }
+    BeginValue();
+    elem.Stringify(*out_);
+    EndValue();
+}
+
+// pretty printing walks the tree through the calls above
+void polojson::Writer::WriteTree(const JsonElem& elem)
+{
+    switch (elem.type())
+    {
+    case JsonType::kArray:
+        StartArray();
+        if (elem.IsNumberArray())
+        {
+            for (double number : elem.ToNumberArray())
+                Number(number);
+            EndArray();
+            break;
+        }
+        for (const JsonElem& e : elem.ToArray())
+            WriteTree(e);
+        EndArray();
+        break;
+    case JsonType::kObject:
+        StartObject();
+        for (const auto& member : elem.ToObject())
+        {
+            Key(member.first);
+            WriteTree(member.second);
+        }
+        EndObject();
+        break;
+    default: //scalars, raw numbers keep their text
+        BeginValue();
+        elem.Stringify(*out_);
+        EndValue();
+        break;
+    }
+}
+
+void polojson::Writer::Reset()
+{
+    stack_.clear();
+    after_key_ = false;
+    complete_ = false;
+}
+
+void polojson::Writer::Flush()
+{
+    if (sink_ == nullptr || buffer_.empty())
+        return;
+    sink_->write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    buffer_.clear();
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "util.h"
+
+namespace polojson
+{
+
+struct WriterOptions
+{
+    // spaces per nesting level; 0 writes compact text, byte for byte what
+    // Stringify writes for the same values in the same order
+    int indent = 0;
+    // with a stream sink, buffered text is handed over at this size
+    size_t flush_bytes = 64 << 10;
+};
+
+// Writes JSON text from a sequence of calls, without building a tree:
+//
+//   writer.StartObject();
+//   writer.Key("id");
+//   writer.Number(7);
+//   writer.EndObject();
+//
+// Misuse, such as a value in an object without a Key() or an EndArray()
+// closing an object, is caught by assertions in debug builds; release
+// builds do not check.
+class Writer
+{
+public:
+    // appends to out, which can be cleared and reused between documents
+    explicit Writer(std::string& out,
+        const WriterOptions& options = WriterOptions());
+    // buffers text and writes it to sink when the buffer reaches
+    // flush_bytes, when a document is complete and on Flush()
+    explicit Writer(std::ostream& sink,
+        const WriterOptions& options = WriterOptions());
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+
+    void StartObject();
+    void EndObject();
+    void StartArray();
+    void EndArray();
+    void Key(std::string_view key);
+
+    void Null();
+    void Bool(bool value);
+    void Number(double value);
+    // text of a valid JSON number, written as it is
+    void RawNumber(std::string_view text);
+    void String(std::string_view value);
+    // a whole tree, as Stringify writes it
+    void Value(const JsonElem& elem);
+
+    // a single root value has been written and closed
+    bool IsComplete() const { return complete_; }
+    // starts the next document after a complete one, e.g. for one JSON
+    // text per line
+    void Reset();
+    void Flush();
+
+private:
+    struct Level
+    {
+        bool is_object;
+        bool empty;
+    };
+
+    void BeginValue();
+    void EndValue();
+    void NewLine();
+    void WriteTree(const JsonElem& elem);
+
+    std::string* out_;
+    std::ostream* sink_;
+    std::string buffer_; //text not yet handed to sink_
+    WriterOptions options_;
+    std::vector<Level> stack_;
+    bool after_key_; //in an object, the next value belongs to a key
+    bool complete_;
+};
+}
@@ -0,0 +1,790 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "polojson.h"
+#include "alloc.h"
+#include "binary.h"
+#include "tape.h"
+#include "bind.h"
+#include "message.h"
+#include "batch.h"
+#include "frozen.h"
+#include "snapshot.h"
+#include "writer.h"
+#include "schema.h"
+#include "patch.h"
+
+using namespace polojson;
+
+POLOJSON_COUNTING_NEW
+
+struct Record
+{
+    int64_t id;
+    std::string name;
+    double score;
+    bool active;
+    std::vector<std::string> tags;
+    std::optional<std::string> parent;
+};
+POLOJSON_FIELDS(Record, id, name, score, active, tags, parent)
+
+// Synthetic corpora, generated so the benchmark needs no data files.
+static std::string make_records(size_t count)
+{
+    std::string json = "[";
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i > 0)
+            json += ",";
+        json += "{\"id\":" + std::to_string(i) +
+            ",\"name\":\"user_" + std::to_string(i) + "\"" +
+            ",\"score\":" + std::to_string(i * 0.25) +
+            ",\"active\":" + (i % 2 ? "true" : "false") +
+            ",\"tags\":[\"alpha\",\"beta\",\"gamma\"]" +
+            ",\"parent\":null}";
+    }
+    return json + "]";
+}
+
+static std::string make_numbers(size_t count)
+{
+    std::string json = "[";
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i > 0)
+            json += ",";
+        json += i % 3 ? std::to_string(i * 1.37) : std::to_string(i);
+    }
+    return json + "]";
+}
+
+static std::string make_strings(size_t count)
+{
+    std::string json = "[";
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (i > 0)
+            json += ",";
+        json += "\"The quick brown fox jumps over the lazy dog, line " +
+            std::to_string(i) + "\\n\"";
+    }
+    return json + "]";
+}
+
+// records with many fields of every kind, for projections
+static std::string make_wide_records(size_t count, size_t fields)
+{
+    std::string json = "[";
+    for (size_t i = 0; i < count; ++i)
+    {
+        json += i > 0 ? ",{" : "{";
+        for (size_t f = 0; f < fields; ++f)
+        {
+            if (f > 0)
+                json += ",";
+            json += "\"f" + std::to_string(f) + "\":";
+            switch (f % 4)
+            {
+            case 0: json += std::to_string(i * 1.5 + f); break;
+            case 1: json += "\"value " + std::to_string(f) + " of record\""; break;
+            case 2: json += "[1,2.5,\"x\",true]"; break;
+            default: json += "{\"a\":" + std::to_string(f) + ",\"b\":null}"; break;
+            }
+        }
+        json += "}";
+    }
+    return json + "]";
+}
+
+struct Corpus
+{
+    const char* name;
+    std::string json;
+};
+
+static std::vector<Corpus> make_corpora()
+{
+    return {
+        { "records", make_records(20000) },
+        { "numbers", make_numbers(200000) },
+        { "strings", make_strings(50000) },
+    };
+}
+
+// best of a few runs, in milliseconds
+template<typename F>
+static double time_ms(F&& f, int runs = 5)
+{
+    double best = 1e300;
+    for (int i = 0; i < runs; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        if (ms < best)
+            best = ms;
+    }
+    return best;
+}
+
+static void bench_parse(const std::vector<Corpus>& corpora)
+{
+    printf("== Parse: time, allocations per parse, DOM footprint ==\n");
+    printf("%-10s %10s %10s %10s %10s %10s %10s %12s\n", "corpus", "ms",
+        "MB/s", "allocs", "alloc MB", "DOM MB", "into ms", "into allocs");
+    for (const Corpus& c : corpora)
+    {
+        Parser parser;
+        double ms = time_ms([&] { parser.Parse(c.json); });
+        AllocationStats stats;
+        parser.SetAllocationStats(&stats);
+        JsonElem doc = parser.Parse(c.json);
+        AllocationStats parse_stats = stats;
+
+        // ParseInto the document of the previous run
+        parser.SetAllocationStats(nullptr);
+        double into = time_ms([&] { parser.ParseInto(doc, c.json); });
+        parser.SetAllocationStats(&stats);
+        parser.ParseInto(doc, c.json);
+        printf("%-10s %10.2f %10.1f %10zu %10.2f %10.2f %10.2f %12zu\n",
+            c.name, ms, c.json.size() / 1e3 / ms, parse_stats.count,
+            parse_stats.bytes / 1e6, doc.MemoryUsage() / 1e6, into,
+            stats.count);
+    }
+}
+
+static void bench_memory_resource(const std::vector<Corpus>& corpora)
+{
+    printf("== Parse + free, heap vs monotonic arena ==\n");
+    printf("%-10s %12s %12s\n", "corpus", "heap ms", "arena ms");
+    for (const Corpus& c : corpora)
+    {
+        Parser parser;
+        double heap = time_ms([&] { parser.Parse(c.json); });
+        std::pmr::monotonic_buffer_resource arena;
+        double pooled = time_ms([&]
+            {
+                parser.Parse(c.json, &arena);
+                arena.release();
+            });
+        printf("%-10s %12.2f %12.2f\n", c.name, heap, pooled);
+    }
+}
+
+static void bench_binary(const std::vector<Corpus>& corpora)
+{
+    printf("== binary codecs vs Stringify + Parse ==\n");
+    printf("%-10s %-8s %12s %12s %12s\n", "corpus", "format", "bytes", "encode ms", "decode ms");
+    for (const auto& corpus : corpora)
+    {
+        Json json;
+        JsonElem doc = json.Parse(corpus.json);
+
+        std::string text;
+        double text_encode = time_ms([&] { text.clear(); doc.Stringify(text); });
+        double text_decode = time_ms([&] { Json j; j.Parse(text); });
+        printf("%-10s %-8s %12zu %12.2f %12.2f\n", corpus.name, "json",
+            text.size(), text_encode, text_decode);
+
+        std::string msgpack;
+        double mp_encode = time_ms([&] { msgpack.clear(); EncodeMsgPack(doc, msgpack); });
+        double mp_decode = time_ms([&] { BinaryDecoder d; d.DecodeMsgPack(msgpack); });
+        printf("%-10s %-8s %12zu %12.2f %12.2f\n", corpus.name, "msgpack",
+            msgpack.size(), mp_encode, mp_decode);
+
+        std::string cbor;
+        double cbor_encode = time_ms([&] { cbor.clear(); EncodeCbor(doc, cbor); });
+        double cbor_decode = time_ms([&] { BinaryDecoder d; d.DecodeCbor(cbor); });
+        printf("%-10s %-8s %12zu %12.2f %12.2f\n", corpus.name, "cbor",
+            cbor.size(), cbor_encode, cbor_decode);
+    }
+}
+
+static void bench_tape(const std::vector<Corpus>& corpora)
+{
+    printf("== tape snapshot vs Parse ==\n");
+    printf("%-10s %12s %12s %12s %12s\n", "corpus", "tape bytes", "parse ms", "open ms", "verify ms");
+    for (const auto& corpus : corpora)
+    {
+        Json json;
+        JsonElem doc = json.Parse(corpus.json);
+        std::string tape;
+        WriteTape(doc, tape);
+        const char* path = "polojson_bench.tape";
+        FILE* f = fopen(path, "wb");
+        fwrite(tape.data(), 1, tape.size(), f);
+        fclose(f);
+
+        double parse = time_ms([&] { Json j; j.Parse(corpus.json); });
+        double open = time_ms([&] { TapeDocument t; t.Open(path); });
+        double verify = time_ms([&] { TapeDocument t; t.Open(path); t.Verify(); });
+        printf("%-10s %12zu %12.2f %12.4f %12.2f\n", corpus.name, tape.size(),
+            parse, open, verify);
+        remove(path);
+    }
+}
+
+static void bench_bind(const std::vector<Corpus>& corpora)
+{
+    printf("== struct binding vs Parse + copy ==\n");
+    const std::string& json = corpora[0].json;
+    std::vector<Record> records;
+    double bound = time_ms([&] { StructParser p; p.Parse(json, records); });
+    double dom = time_ms([&]
+        {
+            Json j;
+            JsonElem doc = j.Parse(json);
+            std::vector<Record> copied;
+            for (const auto& e : doc.ToArray())
+            {
+                Record r;
+                r.id = static_cast<int64_t>(e["id"].ToNumber());
+                r.name = e["name"].ToString();
+                r.score = e["score"].ToNumber();
+                r.active = e["active"].ToBoolean();
+                for (const auto& t : e["tags"].ToArray())
+                    r.tags.emplace_back(t.ToString());
+                if (e["parent"].IsString())
+                    r.parent = e["parent"].ToString();
+                copied.push_back(std::move(r));
+            }
+        });
+    printf("%-10s %12s %12s\n", "corpus", "bind ms", "dom ms");
+    printf("%-10s %12.2f %12.2f\n", corpora[0].name, bound, dom);
+
+    printf("== struct Stringify vs building a JsonElem tree ==\n");
+    std::string out;
+    double direct = time_ms([&] { out.clear(); Stringify(records, out); });
+    double tree = time_ms([&]
+        {
+            array_t arr;
+            for (const auto& r : records)
+            {
+                object_t obj;
+                obj.emplace("id", JsonElem{ static_cast<double>(r.id) });
+                obj.emplace("name", JsonElem{ r.name });
+                obj.emplace("score", JsonElem{ r.score });
+                obj.emplace("active", JsonElem{ r.active });
+                array_t tags;
+                for (const auto& t : r.tags)
+                    tags.emplace_back(t);
+                obj.emplace("tags", JsonElem{ std::move(tags) });
+                obj.emplace("parent", r.parent ? JsonElem{ *r.parent } : JsonElem{ nullptr });
+                arr.emplace_back(std::move(obj));
+            }
+            std::string text = JsonElem{ std::move(arr) }.Stringify();
+        });
+    printf("%-10s %12s %12s\n", "corpus", "direct ms", "tree ms");
+    printf("%-10s %12.2f %12.2f\n", corpora[0].name, direct, tree);
+}
+
+static void bench_message(const std::vector<Corpus>& corpora)
+{
+    printf("== schema message parser vs generic Parse ==\n");
+    // one message per record of the records corpus
+    std::vector<std::string> messages;
+    Json json;
+    JsonElem doc = json.Parse(corpora[0].json);
+    for (const auto& e : doc.ToArray())
+        messages.push_back(e.Stringify());
+
+    MessageSchema schema({
+        { "id", JsonType::kNumber }, { "name", JsonType::kString },
+        { "score", JsonType::kNumber }, { "active", JsonType::kTrue },
+        { "tags", JsonType::kArray }, { "parent", JsonType::kNull } });
+    double specialized = time_ms([&]
+        {
+            MessageParser p;
+            Message msg;
+            for (const auto& m : messages)
+                p.Parse(m, schema, &msg);
+        });
+    double generic = time_ms([&]
+        {
+            Parser p;
+            for (const auto& m : messages)
+                p.Parse(m);
+        });
+    printf("%-10s %12s %12s %12s\n", "corpus", "messages", "schema ms", "generic ms");
+    printf("%-10s %12zu %12.2f %12.2f\n", corpora[0].name, messages.size(),
+        specialized, generic);
+}
+
+static void bench_stringify_cache(const std::vector<Corpus>& corpora)
+{
+    printf("== Stringify after one leaf change, cached vs plain ==\n");
+    Json json;
+    JsonElem doc = json.Parse(corpora[0].json);
+    StringifyCacheOptions options;
+    doc.Stringify(options);
+    size_t round = 0;
+    double cached = time_ms([&]
+        {
+            ++round;
+            doc[round % 1000]["score"].SetNumber(static_cast<double>(round));
+            doc.Stringify(options);
+        }, 20);
+    doc.ClearStringifyCache();
+    double plain = time_ms([&]
+        {
+            ++round;
+            doc[round % 1000]["score"].SetNumber(static_cast<double>(round));
+            doc.Stringify();
+        }, 20);
+    printf("%-10s %12s %12s\n", "corpus", "cached ms", "plain ms");
+    printf("%-10s %12.2f %12.2f\n", corpora[0].name, cached, plain);
+}
+
+static void bench_stringify(const std::vector<Corpus>& corpora)
+{
+    printf("== Stringify ==\n");
+    printf("%-10s %12s %12s\n", "corpus", "ms", "MB/s");
+    for (const Corpus& c : corpora)
+    {
+        Json json;
+        JsonElem doc = json.Parse(c.json);
+        size_t bytes = 0;
+        double ms = time_ms([&] { bytes = doc.Stringify().size(); });
+        printf("%-10s %12.2f %12.1f\n", c.name, ms, bytes / 1e3 / ms);
+    }
+}
+
+static void bench_raw_numbers(const std::vector<Corpus>& corpora)
+{
+    printf("== Parse + Stringify round trip, raw vs converted numbers ==\n");
+    printf("%-10s %12s %12s\n", "corpus", "raw ms", "double ms");
+    ParseOptions options;
+    options.raw_numbers = true;
+    for (const Corpus& c : corpora)
+    {
+        double raw = time_ms([&]
+            {
+                Json json(options);
+                json.Parse(c.json).Stringify();
+            });
+        double converted = time_ms([&]
+            {
+                Json json;
+                json.Parse(c.json).Stringify();
+            });
+        printf("%-10s %12.2f %12.2f\n", c.name, raw, converted);
+    }
+}
+
+// metric series: objects holding long arrays of samples
+static std::string make_metrics(size_t series, size_t samples)
+{
+    std::string json = "[";
+    for (size_t i = 0; i < series; ++i)
+    {
+        json += i > 0 ? ",{" : "{";
+        json += "\"name\":\"metric_" + std::to_string(i) + "\",\"samples\":[";
+        for (size_t k = 0; k < samples; ++k)
+        {
+            if (k > 0)
+                json += ",";
+            json += std::to_string((i * samples + k) % 9973 * 0.125);
+        }
+        json += "]}";
+    }
+    return json + "]";
+}
+
+static void bench_number_arrays(const std::vector<Corpus>& corpora)
+{
+    printf("== Number arrays, node per number vs contiguous doubles ==\n");
+    std::vector<Corpus> dense;
+    dense.push_back({ "numbers", corpora[1].json });
+    dense.push_back({ "metrics", make_metrics(10, 100000) });
+    ParseOptions options;
+    options.number_arrays = true;
+    printf("%-10s %10s %10s %10s %10s %10s %10s\n", "corpus", "nodes MB",
+        "doubles MB", "nodes ms", "doubles ms", "elem sum", "span sum");
+    for (const Corpus& c : dense)
+    {
+        Json nodes;
+        Json doubles(options);
+        JsonElem tree = nodes.Parse(c.json);
+        JsonElem flat = doubles.Parse(c.json);
+        double nodes_ms = time_ms([&] { nodes.Parse(c.json); });
+        double doubles_ms = time_ms([&] { doubles.Parse(c.json); });
+        // a reduction over every sample, through ToArray and the span
+        double total = 0;
+        auto sum_tree = [&](const JsonElem& arr)
+        {
+            for (const JsonElem& e : arr.ToArray())
+                total += e.ToNumber();
+        };
+        auto sum_flat = [&](const JsonElem& arr)
+        {
+            for (double x : arr.ToNumberArray())
+                total += x;
+        };
+        auto each_array = [](const JsonElem& doc, auto&& f)
+        {
+            if (doc.IsNumberArray() || doc.ToArray()[0].IsNumber())
+                f(doc);
+            else
+                for (const JsonElem& e : doc.ToArray())
+                    f(e["samples"]);
+        };
+        double tree_sum_ms = time_ms([&] { each_array(tree, sum_tree); });
+        double flat_sum_ms = time_ms([&] { each_array(flat, sum_flat); });
+        printf("%-10s %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n", c.name,
+            tree.MemoryUsage() / 1e6, flat.MemoryUsage() / 1e6, nodes_ms,
+            doubles_ms, tree_sum_ms, flat_sum_ms);
+        if (total == 0.5)
+            printf("\n"); //keeps the sums
+    }
+}
+
+static void bench_schema(const std::vector<Corpus>& corpora)
+{
+    printf("== Schema check, parse then Validate vs during parsing ==\n");
+    Parser parser;
+    Schema schema;
+    schema.Compile(parser.Parse(
+        "{\"type\":\"array\",\"items\":{\"type\":\"object\","
+        "\"required\":[\"id\",\"name\",\"score\",\"active\"],"
+        "\"properties\":{"
+        "\"id\":{\"type\":\"integer\",\"minimum\":0},"
+        "\"name\":{\"type\":\"string\",\"maxLength\":64},"
+        "\"score\":{\"type\":\"number\",\"minimum\":0,\"maximum\":1e9},"
+        "\"active\":{\"type\":\"boolean\"},"
+        "\"tags\":{\"type\":\"array\",\"items\":"
+        "{\"enum\":[\"alpha\",\"beta\",\"gamma\"]}},"
+        "\"parent\":{\"type\":[\"string\",\"null\"]}},"
+        "\"additionalProperties\":false}}"));
+    // the same records with a violation in the first one
+    std::string invalid = corpora[0].json;
+    invalid.replace(invalid.find("\"id\":0"), 6, "\"id\":-1");
+    printf("%-10s %12s %12s\n", "input", "separate ms", "fused ms");
+    for (const Corpus& c : { Corpus{ "valid", corpora[0].json },
+        Corpus{ "invalid", invalid } })
+    {
+        double separate = time_ms([&]
+            {
+                JsonElem doc = parser.Parse(c.json);
+                schema.Validate(doc);
+            });
+        double fused = time_ms([&] { parser.Parse(c.json, schema); });
+        printf("%-10s %12.2f %12.2f\n", c.name, separate, fused);
+    }
+}
+
+static void bench_patch(const std::vector<Corpus>& corpora)
+{
+    printf("== Rewrite two fields, Parse + Stringify vs TextPatcher ==\n");
+    std::string body = "{\"ts\":1699999999,\"trace\":\"0000\",\"records\":" +
+        corpora[0].json + "}";
+    std::vector<TextEdit> edits = {
+        TextEdit{ "/ts", JsonElem(1700000000.0) },
+        TextEdit{ "/trace", JsonElem(std::string_view("4bf92f3577b34da6")) } };
+    std::string out;
+    Parser parser;
+    auto tree = [&]
+    {
+        JsonElem doc = parser.Parse(body);
+        doc["ts"].SetNumber(1700000000.0);
+        doc["trace"].SetString("4bf92f3577b34da6");
+        out.clear();
+        doc.Stringify(out);
+    };
+    TextPatcher patcher;
+    auto patch = [&] { patcher.Patch(body, edits, out); };
+    auto report = [](const char* name, auto&& f)
+    {
+        double ms = time_ms(f);
+        AllocationStats stats;
+        {
+            AllocationScope scope(&stats);
+            f();
+        }
+        printf("%-10s %10.2f %10zu %10.2f\n", name, ms, stats.count,
+            stats.bytes / 1e6);
+    };
+    printf("%-10s %10s %10s %10s\n", "method", "ms", "allocs", "alloc MB");
+    report("tree", tree);
+    report("patch", patch);
+}
+
+static void bench_batch()
+{
+    printf("== ParseBatch vs one Parser, message sizes varying 1000x ==\n");
+    std::vector<std::string> texts;
+    for (size_t i = 0; i < 5000; ++i)
+        texts.push_back(make_records(i % 500 == 0 ? 1000 : 1));
+    std::vector<std::string_view> documents(texts.begin(), texts.end());
+    Parser parser;
+    double sequential = time_ms([&]
+        {
+            for (std::string_view d : documents)
+                parser.Parse(d);
+        });
+    printf("%-10s %12s\n", "threads", "ms");
+    printf("%-10s %12.2f\n", "serial", sequential);
+    size_t max_threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        BatchParser batch(threads);
+        double ms = time_ms([&] { batch.ParseBatch(documents); });
+        printf("%-10zu %12.2f\n", threads, ms);
+    }
+}
+
+static void bench_projection()
+{
+    printf("== Parse with a projection, 200-field records ==\n");
+    const size_t kFields = 200;
+    std::string json = make_wide_records(500, kFields);
+    Parser parser;
+    double full = time_ms([&] { parser.Parse(json); });
+    printf("%-10s %10s %10s %10s %10s\n", "kept", "ms", "MB/s", "speedup",
+        "allocs");
+    for (size_t kept : { kFields, kFields / 2, kFields / 10, size_t(10), size_t(2) })
+    {
+        Projection projection;
+        for (size_t f = 0; f < kFields; f += kFields / kept)
+            projection.Add("f" + std::to_string(f));
+        double ms = time_ms([&] { parser.Parse(json, projection); });
+        AllocationStats stats;
+        parser.SetAllocationStats(&stats);
+        parser.Parse(json, projection);
+        parser.SetAllocationStats(nullptr);
+        printf("%-10zu %10.2f %10.1f %9.1fx %10zu\n", kept, ms,
+            json.size() / 1e3 / ms, full / ms, stats.count);
+    }
+}
+
+static void bench_frozen()
+{
+    printf("== Repeated key lookups: JsonElem, tape, frozen ==\n");
+    // a configuration of 40 sections with 60 settings each
+    std::string json = "{";
+    for (int section = 0; section < 40; ++section)
+    {
+        json += (section > 0 ? ",\"section_" : "\"section_") +
+            std::to_string(section) + "\":{";
+        for (int key = 0; key < 60; ++key)
+            json += (key > 0 ? ",\"setting_" : "\"setting_") +
+                std::to_string(key) + "\":" + std::to_string(section * key);
+        json += "}";
+    }
+    json += "}";
+    Parser parser;
+    JsonElem doc = parser.Parse(json);
+    FrozenDocument frozen = doc.Freeze();
+    std::string tape_bytes;
+    WriteTape(doc, tape_bytes);
+    TapeDocument tape;
+    tape.Load(tape_bytes);
+
+    std::vector<std::pair<std::string, std::string>> paths;
+    for (int i = 0; i < 1000; ++i)
+        paths.emplace_back("section_" + std::to_string(i * 7 % 40),
+            "setting_" + std::to_string(i * 13 % 60));
+    const int kRounds = 200;
+    double sum = 0;
+    auto lookup = [&](auto root)
+    {
+        return time_ms([&]
+            {
+                for (int round = 0; round < kRounds; ++round)
+                    for (const auto& path : paths)
+                        sum += root[path.first][path.second].ToNumber();
+            });
+    };
+    const JsonElem& const_doc = doc;
+    double elem_ms = lookup(std::cref(const_doc).get());
+    double tape_ms = lookup(tape.Root());
+    double frozen_ms = lookup(frozen.Root());
+    double lookups = double(kRounds) * paths.size();
+    printf("%-10s %10s %12s\n", "layout", "ms", "ns/path");
+    printf("%-10s %10.2f %12.1f\n", "JsonElem", elem_ms, elem_ms * 1e6 / lookups);
+    printf("%-10s %10.2f %12.1f\n", "tape", tape_ms, tape_ms * 1e6 / lookups);
+    printf("%-10s %10.2f %12.1f\n", "frozen", frozen_ms, frozen_ms * 1e6 / lookups);
+    printf("(DOM %.1f KB, frozen %.1f KB, checksum %g)\n",
+        doc.MemoryUsage() / 1e3, frozen.size() / 1e3, sum);
+}
+
+// reads per second of reader threads looking up one setting while a
+// writer publishes a new document every millisecond
+template<typename Read, typename Write>
+static double reads_per_second(size_t readers, Read read, Write write)
+{
+    std::atomic<bool> stop{ false };
+    std::atomic<uint64_t> total{ 0 };
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < readers; ++i)
+    {
+        threads.emplace_back([&]
+            {
+                auto reader = read();
+                uint64_t count = 0;
+                double sum = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    for (int j = 0; j < 64; ++j)
+                        sum += reader();
+                    count += 64;
+                }
+                total += count + (sum < 0 ? 1 : 0);
+            });
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < 200; ++n)
+    {
+        write(n);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    stop = true;
+    for (auto& t : threads)
+        t.join();
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    return total / seconds;
+}
+
+static void bench_snapshot()
+{
+    printf("== Shared config, N readers and one writer: SnapshotHolder vs mutex ==\n");
+    Parser parser;
+    auto make_doc = [&](int n)
+    {
+        return parser.Parse("{\"limits\":{\"rate\":" + std::to_string(n) +
+            ",\"burst\":10},\"name\":\"service\"}");
+    };
+
+    printf("%-10s %14s %14s\n", "readers", "holder M/s", "mutex M/s");
+    size_t max_readers = std::max<size_t>(std::thread::hardware_concurrency(), 2) * 2;
+    for (size_t readers = 1; readers <= max_readers; readers *= 2)
+    {
+        SnapshotHolder holder(make_doc(0));
+        double holder_rate = reads_per_second(readers,
+            [&]
+            {
+                return [reader = SnapshotHolder::Reader(holder)]() mutable
+                {
+                    return reader.Get()["limits"]["rate"].ToNumber();
+                };
+            },
+            [&](int n) { holder.Publish(make_doc(n)); });
+
+        std::mutex mutex;
+        JsonElem shared = make_doc(0);
+        double mutex_rate = reads_per_second(readers,
+            [&]
+            {
+                return [&]
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    const JsonElem& doc = shared;
+                    return doc["limits"]["rate"].ToNumber();
+                };
+            },
+            [&](int n)
+            {
+                JsonElem doc = make_doc(n);
+                std::lock_guard<std::mutex> lock(mutex);
+                shared = std::move(doc);
+            });
+        printf("%-10zu %14.1f %14.1f\n", readers, holder_rate / 1e6,
+            mutex_rate / 1e6);
+    }
+}
+
+static void bench_writer()
+{
+    printf("== Response of 100k records: build a tree + Stringify vs Writer ==\n");
+    const size_t kCount = 100000;
+    std::string out;
+    auto build = [&]
+    {
+        array_t records;
+        for (size_t i = 0; i < kCount; ++i)
+        {
+            object_t record;
+            record.emplace(string_t("id"), JsonElem(double(i)));
+            record.emplace(string_t("name"), JsonElem("user_" + std::to_string(i)));
+            record.emplace(string_t("score"), JsonElem(i * 0.25));
+            record.emplace(string_t("active"), JsonElem(i % 2 == 1));
+            array_t tags;
+            tags.emplace_back(std::string_view("alpha"));
+            tags.emplace_back(std::string_view("beta"));
+            record.emplace(string_t("tags"), JsonElem(std::move(tags)));
+            records.emplace_back(std::move(record));
+        }
+        out.clear();
+        JsonElem(std::move(records)).Stringify(out);
+    };
+    auto write = [&]
+    {
+        out.clear();
+        Writer writer(out);
+        writer.StartArray();
+        for (size_t i = 0; i < kCount; ++i)
+        {
+            writer.StartObject();
+            writer.Key("id");
+            writer.Number(double(i));
+            writer.Key("name");
+            writer.String("user_" + std::to_string(i));
+            writer.Key("score");
+            writer.Number(i * 0.25);
+            writer.Key("active");
+            writer.Bool(i % 2 == 1);
+            writer.Key("tags");
+            writer.StartArray();
+            writer.String("alpha");
+            writer.String("beta");
+            writer.EndArray();
+            writer.EndObject();
+        }
+        writer.EndArray();
+    };
+    auto report = [](const char* name, auto&& f)
+    {
+        double ms = time_ms(f);
+        AllocationStats stats;
+        {
+            AllocationScope scope(&stats);
+            f();
+        }
+        printf("%-10s %10.2f %10zu %10.2f\n", name, ms, stats.count,
+            stats.bytes / 1e6);
+    };
+    printf("%-10s %10s %10s %10s\n", "method", "ms", "allocs", "alloc MB");
+    report("tree", build);
+    report("writer", write);
+}
+
+int main()
+{
+    std::vector<Corpus> corpora = make_corpora();
+    bench_parse(corpora);
+    bench_memory_resource(corpora);
+    bench_binary(corpora);
+    bench_tape(corpora);
+    bench_bind(corpora);
+    bench_message(corpora);
+    bench_stringify(corpora);
+    bench_stringify_cache(corpora);
+    bench_raw_numbers(corpora);
+    bench_number_arrays(corpora);
+    bench_schema(corpora);
+    bench_patch(corpora);
+    bench_batch();
+    bench_projection();
+    bench_frozen();
+    bench_snapshot();
+    bench_writer();
+    return 0;
+}
@@ -5,10 +5,31 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <memory_resource>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 #include "polojson.h"
+#include "alloc.h"
+#include "binary.h"
+#include "tape.h"
+#include "bind.h"
+#include "message.h"
+#include "stream.h"
+#include "batch.h"
+#include "path.h"
+#include "static.h"
+#include "frozen.h"
+#include "snapshot.h"
+#include "writer.h"
+#include "schema.h"
+#include "patch.h"
 
 using namespace polojson;
 
+POLOJSON_COUNTING_NEW
+
 static int main_ret = 0;
 static int test_count = 0;
 static int test_pass = 0;
@@ -155,6 +176,8 @@ static void test_parse_invalid_value()
 	TEST_ERROR(ParseErrorCode::kInvalidValue, "inf");
 	TEST_ERROR(ParseErrorCode::kInvalidValue, "NAN");
 	TEST_ERROR(ParseErrorCode::kInvalidValue, "nan");
+	TEST_ERROR(ParseErrorCode::kInvalidValue, "1e");  /* at least one digit in the exponent */
+	TEST_ERROR(ParseErrorCode::kInvalidValue, "1e+");
 #endif
 }
 
@@ -350,7 +373,7 @@ static void test_parse_object()
     EXPECT_EQ_INT(JsonType::kObject, result.ToObject()["o"].type());
     for (size_t i = 0; i < 3; i++)
     {
-        JsonElem ov = result.ToObject()["o"].ToObject()[(std::to_string(i+1))];
+        JsonElem ov = result.ToObject()["o"].ToObject()[string_t(std::to_string(i+1))];
         EXPECT_EQ_INT(JsonType::kNumber, ov.type());
         EXPECT_EQ_DOUBLE(i + 1.0, ov.ToNumber());
     }
@@ -392,6 +415,369 @@ static void test_access_string()
 	EXPECT_EQ_STRING("Hello", e.ToString().c_str(), e.ToString().length());
 }
 
+static void test_parse_raw_number()
+{
+    ParseOptions options;
+    options.raw_numbers = true;
+    Json test(options);
+    // numbers keep their text, even where %.17g would rewrite it
+    std::string json = "[0.1,1E2,-0,12345678901234567890,9007199254740993,1e999]";
+    JsonElem e = test.Parse(json);
+    EXPECT_EQ_INT(ParseErrorCode::kOK, test.GetErrorCode());
+    std::string out = e.Stringify();
+    EXPECT_EQ_STRING("[0.1,1E2,-0,12345678901234567890,9007199254740993,1e999]",
+        out.c_str(), out.size());
+    EXPECT_EQ_DOUBLE(0.1, e[0].ToNumber());
+    EXPECT_EQ_DOUBLE(0.1, e[0].ToNumber());
+    EXPECT_EQ_DOUBLE(100.0, e[1].ToNumber());
+    EXPECT_TRUE(e[1].ToInt64() == 100);
+    EXPECT_TRUE(e[4].ToInt64() == 9007199254740993LL);
+    EXPECT_TRUE(e[1] == JsonElem{ 100.0 });
+    EXPECT_TRUE(e[1].Hash() == JsonElem{ 100.0 }.Hash());
+    EXPECT_TRUE(e[2] == JsonElem{ 0.0 });
+
+    bool threw = false;
+    try { e[3].ToInt64(); } catch (const std::range_error&) { threw = true; }
+    EXPECT_TRUE(threw);
+    threw = false;
+    try { e[0].ToInt64(); } catch (const std::range_error&) { threw = true; }
+    EXPECT_TRUE(threw);
+    EXPECT_TRUE(JsonElem{ -42.0 }.ToInt64() == -42);
+
+    // syntax is still checked
+    test.Parse("[1.]");
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidValue, test.GetErrorCode());
+}
+
+static void test_parse_number_arrays()
+{
+    ParseOptions options;
+    options.number_arrays = true;
+    Json test(options);
+    std::string json = "{\"a\":[1, 2.5 ,-3e2,0],\"b\":[1,\"x\",2],\"c\":[],\"d\":[[1,2],[3]]}";
+    JsonElem e = test.Parse(json);
+    EXPECT_EQ_INT(ParseErrorCode::kOK, test.GetErrorCode());
+    EXPECT_TRUE(e["a"].IsArray());
+    EXPECT_TRUE(e["a"].IsNumberArray());
+    EXPECT_TRUE(!e["b"].IsNumberArray());
+    EXPECT_TRUE(!e["c"].IsNumberArray());
+    EXPECT_TRUE(!e["d"].IsNumberArray());
+    EXPECT_TRUE(e["d"][0].IsNumberArray());
+    std::span<const double> numbers = e["a"].ToNumberArray();
+    EXPECT_EQ_SIZE_T(4, numbers.size());
+    EXPECT_EQ_DOUBLE(2.5, numbers[1]);
+    EXPECT_EQ_DOUBLE(-300.0, numbers[2]);
+    EXPECT_EQ_DOUBLE(1.0, e["b"][0].ToNumber());
+    EXPECT_EQ_DOUBLE(2.0, e["b"][2].ToNumber());
+
+    // the same text, equality and hash as the ordinary tree
+    Json plain;
+    JsonElem p = plain.Parse(json);
+    std::string out = e.Stringify();
+    std::string expected = p.Stringify();
+    EXPECT_TRUE(out == expected);
+    EXPECT_TRUE(e == p);
+    EXPECT_TRUE(p == e);
+    EXPECT_TRUE(e.Hash() == p.Hash());
+    EXPECT_TRUE(e["a"] != JsonElem::FromNumbers(std::vector<double>{ 1, 2.5, -300 }));
+    EXPECT_TRUE(e["a"] == JsonElem::FromNumbers(std::vector<double>{ 1, 2.5, -300, -0.0 }));
+    EXPECT_TRUE(e["a"] != p["b"]);
+    std::string pretty;
+    Writer writer(pretty, WriterOptions{ 2 });
+    writer.Value(e["d"]);
+    EXPECT_TRUE(pretty == "[\n  [\n    1,\n    2\n  ],\n  [\n    3\n  ]\n]");
+
+    // element access builds the elements once, writes convert to an array
+    size_t before = e.MemoryUsage();
+    const JsonElem& a = e["a"];
+    EXPECT_EQ_DOUBLE(2.5, a[1].ToNumber());
+    EXPECT_TRUE(&a[1] == &a[1]);
+    EXPECT_EQ_SIZE_T(4, a.ToArray().size());
+    EXPECT_TRUE(e.MemoryUsage() > before);
+    JsonElem copy = e;
+    copy["a"][0].SetNumber(7);
+    EXPECT_TRUE(!copy["a"].IsNumberArray());
+    EXPECT_EQ_DOUBLE(7.0, copy["a"][0].ToNumber());
+    EXPECT_EQ_DOUBLE(1.0, e["a"].ToNumberArray()[0]);
+
+    // contiguous storage is much smaller than a node per number
+    std::string many = "[";
+    for (int i = 0; i < 1000; ++i)
+        many += (i > 0 ? "," : "") + std::to_string(i * 0.5);
+    many += "]";
+    size_t contiguous = test.Parse(many).MemoryUsage();
+    size_t nodes = plain.Parse(many).MemoryUsage();
+    EXPECT_TRUE(contiguous < 1000 * sizeof(double) + 200);
+    EXPECT_TRUE(contiguous * 4 < nodes);
+
+    // ParseInto replaces number arrays rather than reusing them
+    JsonElem target;
+    Parser parser(options);
+    EXPECT_TRUE(parser.ParseInto(target, "[1,2,3]"));
+    EXPECT_TRUE(target.IsNumberArray());
+    EXPECT_TRUE(parser.ParseInto(target, "[4,5]"));
+    EXPECT_TRUE(target.IsNumberArray());
+    EXPECT_EQ_DOUBLE(5.0, target.ToNumberArray()[1]);
+
+    // errors inside the numbers, and raw_numbers wins
+    test.Parse("[1,2.]");
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidValue, test.GetErrorCode());
+    test.Parse("[1,2 3]");
+    EXPECT_EQ_INT(ParseErrorCode::kMissCommaOrSquareBracket, test.GetErrorCode());
+    test.Parse("[1,1e999]");
+    EXPECT_EQ_INT(ParseErrorCode::kNumberTooBig, test.GetErrorCode());
+    test.Parse("[1,]");
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidValue, test.GetErrorCode());
+    options.raw_numbers = true;
+    Json raw(options);
+    EXPECT_TRUE(!raw.Parse("[1,2]").IsNumberArray());
+}
+
+static void test_parse_allocation_stats()
+{
+    Parser parser;
+    AllocationStats stats;
+    parser.SetAllocationStats(&stats);
+    std::string long_string(1000, 'x');
+    parser.Parse("[1,2,\"" + long_string + "\"]");
+    EXPECT_EQ_INT(ParseErrorCode::kOK, parser.GetErrorCode());
+    EXPECT_TRUE(stats.count >= 4); // array, two numbers and the string
+    EXPECT_TRUE(stats.bytes >= long_string.size());
+    size_t array_count = stats.count;
+
+    parser.Parse("null");
+    EXPECT_TRUE(stats.count > 0 && stats.count < array_count);
+
+    // nothing is counted once the stats are removed
+    AllocationStats before = stats;
+    parser.SetAllocationStats(nullptr);
+    parser.Parse("[1,2,3]");
+    EXPECT_EQ_SIZE_T(before.count, stats.count);
+
+    AllocationStats outer;
+    {
+        AllocationScope scope(&outer);
+        std::string counted(1000, 'z');
+    }
+    EXPECT_EQ_SIZE_T(1, outer.count);
+}
+
+// counts what a document takes from its resource
+class CountingResource :public std::pmr::memory_resource
+{
+public:
+    size_t allocations = 0;
+    size_t live_bytes = 0;
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        ++allocations;
+        live_bytes += bytes;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override
+    {
+        live_bytes -= bytes;
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+};
+
+static void test_parse_memory_resource()
+{
+    const std::string json = "{\"list\":[1,true,null,\"a string that is too long to be inline\"],"
+        "\"a key that is too long to be inline\":{\"n\":-1}}";
+    CountingResource resource;
+    Parser parser;
+    {
+        JsonElem doc = parser.Parse(json, &resource);
+        EXPECT_EQ_INT(ParseErrorCode::kOK, parser.GetErrorCode());
+        EXPECT_TRUE(resource.allocations >= 10);
+        EXPECT_TRUE(doc["list"][3].ToString() == "a string that is too long to be inline");
+        EXPECT_EQ_DOUBLE(-1.0, doc["a key that is too long to be inline"]["n"].ToNumber());
+        EXPECT_TRUE(doc == Json().Parse(json));
+
+        // copy-on-write duplicates stay in the document's resource
+        JsonElem copy = doc;
+        size_t before = resource.allocations;
+        copy["list"][0].SetNumber(2.0);
+        EXPECT_TRUE(resource.allocations > before);
+        EXPECT_EQ_DOUBLE(1.0, doc["list"][0].ToNumber());
+
+        // so do the values setters put in place of others
+        CountingResource other;
+        std::pmr::memory_resource* previous =
+            std::pmr::set_default_resource(&other);
+        doc["list"][0].SetBoolean(false);
+        doc["list"][1].SetNumber(3.0);
+        doc["list"][2].SetString("a string that is too long to be inline");
+        doc["list"][3].SetNull();
+        std::pmr::set_default_resource(previous);
+        EXPECT_EQ_SIZE_T(0, other.allocations);
+        EXPECT_TRUE(doc["list"] == Json().Parse(
+            "[false,3,\"a string that is too long to be inline\",null]"));
+    }
+    EXPECT_EQ_SIZE_T(0, resource.live_bytes);
+
+    // an arena that cannot fall back to the heap holds every node, string
+    // and container of the document
+    char buffer[4096];
+    std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer),
+        std::pmr::null_memory_resource());
+    {
+        JsonElem doc = parser.Parse(json, &arena);
+        EXPECT_EQ_INT(ParseErrorCode::kOK, parser.GetErrorCode());
+        EXPECT_TRUE(doc["list"][1].ToBoolean());
+    }
+    arena.release();
+}
+
+static void test_parse_into()
+{
+    Parser parser;
+    JsonElem doc;
+    // shape changes on every step: types, missing and new keys, shorter and
+    // longer arrays
+    const char* documents[] = {
+        "{\"id\":1,\"name\":\"first\",\"tags\":[\"a\",\"b\",\"c\"],\"ok\":true,\"sub\":{\"x\":1}}",
+        "{\"id\":2,\"name\":\"second\",\"tags\":[\"d\"],\"ok\":false,\"sub\":{\"y\":[1,2]}}",
+        "{\"id\":\"three\",\"tags\":[],\"ok\":null,\"extra\":{}}",
+        "[1,\"two\",[3],{\"four\":4}]",
+        "[null,2,[3,4,5]]",
+        "\"text\"",
+        "{\"id\":4,\"id\":5}",
+        "{\"id\":6,\"id\":7}", // the first of duplicate keys wins
+    };
+    for (const char* json : documents)
+    {
+        EXPECT_TRUE(parser.ParseInto(doc, json));
+        EXPECT_EQ_INT(ParseErrorCode::kOK, parser.GetErrorCode());
+        JsonElem expect = Json().Parse(json);
+        EXPECT_TRUE(doc == expect);
+        std::string out = doc.Stringify();
+        EXPECT_TRUE(out == expect.Stringify());
+    }
+
+    // steady state: the same shape with other values allocates nothing
+    const std::string first = "{\"id\":17,\"name\":\"a name longer than the inline buffer\","
+        "\"tags\":[\"t1\",\"t2\"],\"ok\":true,\"none\":null,\"pos\":{\"x\":1.5,\"y\":-2}}";
+    const std::string second = "{\"id\":18,\"name\":\"another name, still longer than inline\","
+        "\"tags\":[\"t3\",\"t4\"],\"ok\":false,\"none\":null,\"pos\":{\"x\":3.25,\"y\":7}}";
+    EXPECT_TRUE(parser.ParseInto(doc, first));
+    EXPECT_TRUE(parser.ParseInto(doc, second));
+    AllocationStats stats;
+    parser.SetAllocationStats(&stats);
+    EXPECT_TRUE(parser.ParseInto(doc, first));
+    EXPECT_EQ_SIZE_T(0, stats.count);
+    EXPECT_TRUE(doc == Json().Parse(first));
+    EXPECT_TRUE(parser.ParseInto(doc, second));
+    EXPECT_EQ_SIZE_T(0, stats.count);
+    EXPECT_TRUE(doc == Json().Parse(second));
+    parser.SetAllocationStats(nullptr);
+
+    // shared nodes are replaced, not written
+    JsonElem copy = doc;
+    EXPECT_TRUE(parser.ParseInto(doc, first));
+    EXPECT_TRUE(copy == Json().Parse(second));
+    EXPECT_TRUE(doc == Json().Parse(first));
+
+    // cached text and hashes of reused containers are dropped
+    doc.Stringify(StringifyCacheOptions());
+    uint64_t hash = doc.Hash();
+    EXPECT_TRUE(parser.ParseInto(doc, second));
+    EXPECT_TRUE(doc.Stringify(StringifyCacheOptions()) == Json().Parse(second).Stringify());
+    EXPECT_TRUE(doc.Hash() != hash);
+
+    EXPECT_FALSE(parser.ParseInto(doc, "{\"id\":1,\"name\"}"));
+    EXPECT_EQ_INT(ParseErrorCode::kMissColon, parser.GetErrorCode());
+    EXPECT_FALSE(parser.ParseInto(doc, "[1,2] x"));
+    EXPECT_EQ_INT(ParseErrorCode::kRootNotSingular, parser.GetErrorCode());
+
+    // the partial document left by a failure can still be used
+    EXPECT_TRUE(parser.ParseInto(doc, "[1,2]"));
+    EXPECT_FALSE(parser.ParseInto(doc, "[1,2,3,tru]"));
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidValue, parser.GetErrorCode());
+    EXPECT_TRUE(doc.Stringify() == "[1,2,3,null]");
+    EXPECT_TRUE(parser.ParseInto(doc, "{\"a\":{\"b\":[1]}}"));
+    EXPECT_FALSE(parser.ParseInto(doc, "{\"a\":{\"b\":[1,nul]}}"));
+    EXPECT_TRUE(doc.Stringify() == "{\"a\":{\"b\":[1,null]}}");
+    EXPECT_TRUE(doc.Hash() != 0 && doc == doc);
+    JsonElem fresh;
+    EXPECT_FALSE(parser.ParseInto(fresh, "fals"));
+    EXPECT_TRUE(fresh.IsNull());
+    EXPECT_TRUE(parser.ParseInto(doc, first));
+    EXPECT_TRUE(doc == Json().Parse(first));
+}
+
+static void test_parse_projection()
+{
+    const char* json = "{\"id\":7,\"user\":{\"name\":\"ann\",\"age\":31,"
+        "\"address\":{\"city\":\"Oslo\",\"zip\":\"0150\"}},"
+        "\"items\":[{\"sku\":\"a\",\"qty\":1},{\"sku\":\"b\",\"qty\":2},3],"
+        "\"blob\":[\"\\u00e9\",{\"deep\":[1e300,true,null]}],"
+        "\"meta\":null,\"id\":8}";
+    Parser parser;
+    Projection projection;
+    projection.Add("id");
+    projection.Add("user.address.city");
+    projection.Add("items.sku");
+    projection.Add("meta.owner");
+    projection.Add("missing.field");
+    JsonElem doc = parser.Parse(json, projection);
+    EXPECT_EQ_INT(ParseErrorCode::kOK, parser.GetErrorCode());
+    EXPECT_TRUE(doc == Json().Parse("{\"id\":7,\"user\":{\"address\":"
+        "{\"city\":\"Oslo\"}},\"items\":[{\"sku\":\"a\"},{\"sku\":\"b\"},3],"
+        "\"meta\":null}"));
+
+    // a path that is a prefix of another keeps the value whole
+    std::string_view keys[] = { "user" };
+    projection.Add(keys);
+    projection.Add("user.address.zip");
+    doc = parser.Parse(json, projection);
+    EXPECT_TRUE(doc["user"] == Json().Parse(json)["user"]);
+
+    Projection everything;
+    everything.Add("");
+    EXPECT_TRUE(parser.Parse(json, everything) == Json().Parse(json));
+    Projection nothing;
+    EXPECT_TRUE(parser.Parse(json, nothing) == Json().Parse("{}"));
+    EXPECT_TRUE(parser.Parse("[{\"a\":1},{}]", nothing) ==
+        Json().Parse("[{},{}]"));
+
+    // skipped values are still validated
+    Projection id;
+    id.Add("id");
+    parser.Parse("{\"id\":1,\"x\":[1,2}", id);
+    EXPECT_EQ_INT(ParseErrorCode::kMissCommaOrSquareBracket, parser.GetErrorCode());
+    parser.Parse("{\"id\":1,\"x\":\"\\q\"}", id);
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidStringEscape, parser.GetErrorCode());
+    parser.Parse("{\"id\":1,\"x\":\"\\uD800\"}", id);
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidUnicodeSurrogate, parser.GetErrorCode());
+    parser.Parse("{\"id\":1,\"x\":\"\\uD800\\u0041\"}", id);
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidUnicodeSurrogate, parser.GetErrorCode());
+    parser.Parse("{\"id\":1,\"x\":tru}", id);
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidValue, parser.GetErrorCode());
+    parser.Parse("{\"id\":1} {}", id);
+    EXPECT_EQ_INT(ParseErrorCode::kRootNotSingular, parser.GetErrorCode());
+    parser.Parse("", id);
+    EXPECT_EQ_INT(ParseErrorCode::kExpectValue, parser.GetErrorCode());
+
+    // skipped values cost no allocations, once the parser's buffers have
+    // grown to the document
+    AllocationStats small_stats, large_stats;
+    parser.Parse(json, id);
+    parser.SetAllocationStats(&small_stats);
+    parser.Parse("{\"id\":7,\"id\":8}", id); //the same kept fields
+    parser.SetAllocationStats(&large_stats);
+    parser.Parse(json, id);
+    parser.SetAllocationStats(nullptr);
+    EXPECT_EQ_SIZE_T(small_stats.count, large_stats.count);
+}
+
 static void test_parse()
 {
 	test_parse_null();
@@ -414,7 +800,13 @@ static void test_parse()
     test_parse_miss_key();
     test_parse_miss_colon();
     test_parse_miss_comma_or_curly_bracket();
-    
+    test_parse_raw_number();
+    test_parse_number_arrays();
+    test_parse_allocation_stats();
+    test_parse_memory_resource();
+    test_parse_into();
+    test_parse_projection();
+
 }
 
 size_t hash_string_piece(std::string string_piece)
@@ -512,6 +904,101 @@ static void test_stringify_object()
     test_roundtrip("{\"n\":null,\"f\":false,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,2,3],\"o\":{\"1\":1,\"2\":2,\"3\":3}}");
 }
 
+static void test_stringify_nested()
+{
+    const size_t depth = 1000;
+    JsonElem e{ 1.0 };
+    for (size_t i = 0; i < depth; ++i)
+    {
+        array_t a;
+        a.push_back(e);
+        e = JsonElem{ a };
+    }
+    std::string expect = std::string(depth, '[') + "1" + std::string(depth, ']');
+    std::string actual = e.Stringify();
+    EXPECT_EQ_SIZE_T(expect.size(), actual.size());
+    EXPECT_TRUE(expect == actual);
+
+    object_t o;
+    o.emplace("k", e);
+    std::string out = "prefix:";
+    JsonElem{ o }.Stringify(out);
+    EXPECT_TRUE(out == "prefix:{\"k\":" + expect + "}");
+}
+
+static void test_stringify_cached()
+{
+    Json test;
+    JsonElem doc = test.Parse("{\"a\":[1,2,3],\"b\":{\"c\":\"long enough to be cached\",\"d\":[true]}}");
+    StringifyCacheOptions options;
+    options.min_bytes = 0;
+    std::string first = doc.Stringify(options);
+    EXPECT_TRUE(first == doc.Stringify());
+    EXPECT_TRUE(first == doc.Stringify(options));
+
+    doc["b"]["d"][0].SetBoolean(false);
+    std::string second = doc.Stringify(options);
+    EXPECT_TRUE(second != first);
+    EXPECT_TRUE(second.find("\"d\":[false]") != std::string::npos);
+    EXPECT_TRUE(second.find("\"a\":[1,2,3]") != std::string::npos);
+
+    doc.ToObject().erase("a");
+    std::string third = doc.Stringify(options);
+    EXPECT_TRUE(third.find("\"a\"") == std::string::npos);
+
+    /* a copy shares the cache but a write to it only drops its own path */
+    JsonElem copy = doc;
+    copy["b"]["c"].SetString("x");
+    EXPECT_TRUE(doc.Stringify(options) == third);
+    EXPECT_TRUE(copy.Stringify(options).find("\"c\":\"x\"") != std::string::npos);
+
+    /* a tiny cap keeps only small subtrees */
+    options.max_bytes = 8;
+    JsonElem fresh = test.Parse("[[1],[2],[3,4,5,6,7,8]]");
+    std::string expect = fresh.Stringify();
+    EXPECT_TRUE(fresh.Stringify(options) == expect);
+    EXPECT_TRUE(fresh.Stringify(options) == expect);
+    fresh[0][0].SetNumber(9);
+    EXPECT_TRUE(fresh.Stringify(options) == "[[9],[2],[3,4,5,6,7,8]]");
+
+    doc.ClearStringifyCache();
+    EXPECT_TRUE(doc.Stringify() == third);
+}
+
+static void test_stringify_escape()
+{
+    // every escape at every offset of a long string, so it is found both
+    // inside a 16 byte block and in the tail
+    const char specials[] = { '"', '\\', '\b', '\f', '\n', '\r', '\t', '\x01', '\x1f' };
+    const char* escaped[] = { "\\\"", "\\\\", "\\b", "\\f", "\\n", "\\r", "\\t",
+        "\\u0001", "\\u001F" };
+    for (size_t k = 0; k < sizeof(specials); ++k)
+    {
+        for (size_t i = 0; i < 40; ++i)
+        {
+            std::string value(40, 'a');
+            value[39 - i] = '\x7f'; // DEL and bytes >= 0x80 are copied as is
+            value[(i + 7) % 40] = '\xc3';
+            value[i] = specials[k];
+            std::string expect = "\"" + value.substr(0, i) + escaped[k] +
+                value.substr(i + 1) + "\"";
+            std::string out;
+            StringifyString(value, out);
+            EXPECT_TRUE(out == expect);
+        }
+    }
+
+    // object keys are escaped like values
+    object_t obj;
+    obj["a\"b\n"] = JsonElem{ 1.0 };
+    std::string out = JsonElem{ obj }.Stringify();
+    EXPECT_EQ_STRING("{\"a\\\"b\\n\":1}", out.c_str(), out.size());
+    Json json;
+    JsonElem e = json.Parse(out);
+    EXPECT_EQ_INT(ParseErrorCode::kOK, json.GetErrorCode());
+    EXPECT_EQ_DOUBLE(1.0, e["a\"b\n"].ToNumber());
+}
+
 static void test_stringify()
 {
     test_roundtrip("null");
@@ -521,6 +1008,630 @@ static void test_stringify()
     test_stringify_string();
     test_stringify_array();
     test_stringify_object();
+    test_stringify_nested();
+    test_stringify_cached();
+    test_stringify_escape();
+}
+
+#define TEST_BINARY_BYTES(expect, elem)\
+    do {\
+        std::string msgpack;\
+        EncodeMsgPack(elem, msgpack);\
+        EXPECT_EQ_STRING(expect, msgpack.c_str(), msgpack.size());\
+    } while(0)
+
+static void test_binary_msgpack_bytes()
+{
+    TEST_BINARY_BYTES("\xC0", JsonElem{ nullptr });
+    TEST_BINARY_BYTES("\xC3", JsonElem{ true });
+    TEST_BINARY_BYTES("\x7F", JsonElem{ 127.0 });
+    TEST_BINARY_BYTES("\xCD\x01\x2C", JsonElem{ 300.0 });
+    TEST_BINARY_BYTES("\xFF", JsonElem{ -1.0 });
+    TEST_BINARY_BYTES("\xD1\xFF\x00", JsonElem{ -256.0 });
+    TEST_BINARY_BYTES("\xCA\x3F\xC0\x00\x00", JsonElem{ 1.5 });
+    TEST_BINARY_BYTES("\xCB\x3F\xB9\x99\x99\x99\x99\x99\x9A", JsonElem{ 0.1 });
+    TEST_BINARY_BYTES("\xA3" "abc", JsonElem{ std::string("abc") });
+}
+
+static void test_binary_cbor_bytes()
+{
+    std::string out;
+    EncodeCbor(JsonElem{ -1.0 }, out);
+    EncodeCbor(JsonElem{ 500.0 }, out);
+    EncodeCbor(JsonElem{ false }, out);
+    EncodeCbor(JsonElem{ std::string("a") }, out);
+    EXPECT_EQ_STRING("\x20\x19\x01\xF4\xF4\x61" "a", out.c_str(), out.size());
+
+    BinaryDecoder decoder;
+    JsonElem e = decoder.DecodeCbor(std::string("\xF9\x3E\x00", 3)); /* half 1.5 */
+    EXPECT_EQ_INT(ParseErrorCode::kOK, decoder.GetErrorCode());
+    EXPECT_EQ_DOUBLE(1.5, e.ToNumber());
+    e = decoder.DecodeCbor(std::string("\x9F\x01\x7F\x61x\x61y\xFF\xFF", 9));
+    EXPECT_EQ_INT(ParseErrorCode::kOK, decoder.GetErrorCode());
+    EXPECT_EQ_SIZE_T(2, e.ToArray().size());
+    EXPECT_TRUE(e[1].ToString() == "xy");
+}
+
+static void test_binary_error()
+{
+    /* NaN and infinities would stringify to text Parse rejects */
+    const std::string msgpack[] = {
+        std::string("\xCB\x7F\xF8\x00\x00\x00\x00\x00\x00", 9),
+        std::string("\xCB\xFF\xF0\x00\x00\x00\x00\x00\x00", 9),
+        std::string("\xCA\x7F\x80\x00\x00", 5),
+        std::string("\x91\xCA\x7F\xC0\x00\x00", 6) };
+    const std::string cbor[] = {
+        std::string("\xF9\x7C\x00", 3),
+        std::string("\xF9\x7E\x00", 3),
+        std::string("\xFA\xFF\x80\x00\x00", 5),
+        std::string("\xFB\x7F\xF8\x00\x00\x00\x00\x00\x00", 9),
+        std::string("\xA1\x61k\xF9\x7C\x00", 6) };
+    BinaryDecoder decoder;
+    for (const std::string& data : msgpack)
+    {
+        decoder.DecodeMsgPack(data);
+        EXPECT_EQ_INT(ParseErrorCode::kInvalidValue, decoder.GetErrorCode());
+    }
+    for (const std::string& data : cbor)
+    {
+        decoder.DecodeCbor(data);
+        EXPECT_EQ_INT(ParseErrorCode::kInvalidValue, decoder.GetErrorCode());
+    }
+}
+
+static void test_binary_depth()
+{
+    BinaryDecoder decoder;
+    JsonElem e = decoder.DecodeCbor(std::string(2000000, '\xC6') + '\x00');
+    EXPECT_EQ_INT(ParseErrorCode::kNestingTooDeep, decoder.GetErrorCode());
+    e = decoder.DecodeCbor(std::string(100000, '\x81') + '\x00');
+    EXPECT_EQ_INT(ParseErrorCode::kNestingTooDeep, decoder.GetErrorCode());
+    e = decoder.DecodeMsgPack(std::string(100000, '\x91') + '\xC0');
+    EXPECT_EQ_INT(ParseErrorCode::kNestingTooDeep, decoder.GetErrorCode());
+    std::string maps;
+    for (int i = 0; i < 100000; ++i)
+        maps += "\x81\xA1k"; /* {"k": {"k": ... */
+    e = decoder.DecodeMsgPack(maps + '\xC0');
+    EXPECT_EQ_INT(ParseErrorCode::kNestingTooDeep, decoder.GetErrorCode());
+
+    /* the limit itself still decodes */
+    e = decoder.DecodeMsgPack(std::string(BinaryDecoder::kMaxDepth, '\x91') + '\x01');
+    EXPECT_EQ_INT(ParseErrorCode::kOK, decoder.GetErrorCode());
+    EXPECT_TRUE(e.IsArray());
+    e = decoder.DecodeCbor(std::string(BinaryDecoder::kMaxDepth, '\xC6') + '\x01');
+    EXPECT_EQ_INT(ParseErrorCode::kOK, decoder.GetErrorCode());
+    EXPECT_EQ_DOUBLE(1.0, e.ToNumber());
+}
+
+static void test_binary_roundtrip()
+{
+    Json test;
+    JsonElem doc = test.Parse(
+        "{\"n\":null,\"f\":false,\"t\":true,\"i\":-70000,\"u\":4294967296,"
+        "\"d\":3.1416,\"s\":\"Hello\\u0000World\",\"a\":[1,2,[]],\"o\":{\"k\":{}}}");
+    EXPECT_EQ_INT(ParseErrorCode::kOK, test.GetErrorCode());
+
+    std::string encoded[2];
+    EncodeMsgPack(doc, encoded[0]);
+    EncodeCbor(doc, encoded[1]);
+    for (int i = 0; i < 2; ++i)
+    {
+        BinaryDecoder decoder;
+        JsonElem e = i == 0 ? decoder.DecodeMsgPack(encoded[i]) : decoder.DecodeCbor(encoded[i]);
+        EXPECT_EQ_INT(ParseErrorCode::kOK, decoder.GetErrorCode());
+        EXPECT_EQ_SIZE_T(9, e.ToObject().size());
+        EXPECT_EQ_INT(JsonType::kNull, e["n"].type());
+        EXPECT_EQ_INT(JsonType::kFalse, e["f"].type());
+        EXPECT_EQ_INT(JsonType::kTrue, e["t"].type());
+        EXPECT_EQ_DOUBLE(-70000.0, e["i"].ToNumber());
+        EXPECT_EQ_DOUBLE(4294967296.0, e["u"].ToNumber());
+        EXPECT_EQ_DOUBLE(3.1416, e["d"].ToNumber());
+        EXPECT_EQ_STRING("Hello\0World", e["s"].ToString().c_str(), e["s"].ToString().size());
+        EXPECT_EQ_SIZE_T(3, e["a"].ToArray().size());
+        EXPECT_EQ_SIZE_T(0, e["a"][2].ToArray().size());
+        EXPECT_EQ_SIZE_T(0, e["o"]["k"].ToObject().size());
+
+        decoder.DecodeMsgPack(encoded[0].substr(0, encoded[0].size() - 1));
+        EXPECT_EQ_INT(ParseErrorCode::kExpectValue, decoder.GetErrorCode());
+    }
+
+    BinaryDecoder decoder;
+    decoder.DecodeMsgPack(std::string("\xC0\xC0"));
+    EXPECT_EQ_INT(ParseErrorCode::kRootNotSingular, decoder.GetErrorCode());
+    decoder.DecodeMsgPack(std::string("\xC1"));
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidValue, decoder.GetErrorCode());
+    decoder.DecodeCbor(std::string("\xA1\x01\x01"));
+    EXPECT_EQ_INT(ParseErrorCode::kMissKey, decoder.GetErrorCode());
+}
+
+static void test_binary()
+{
+    test_binary_msgpack_bytes();
+    test_binary_cbor_bytes();
+    test_binary_error();
+    test_binary_depth();
+    test_binary_roundtrip();
+}
+
+static void test_tape_query()
+{
+    Json test;
+    JsonElem doc = test.Parse(
+        "{\"n\":null,\"t\":true,\"i\":123,\"s\":\"abc\",\"a\":[1,\"x\",[]],"
+        "\"o\":{\"s\":\"nested\",\"n\":null},\"\":0}");
+    std::string tape;
+    WriteTape(doc, tape);
+
+    TapeDocument tdoc;
+    EXPECT_TRUE(tdoc.Load(tape));
+    EXPECT_TRUE(tdoc.Verify());
+    TapeElem root = tdoc.Root();
+    EXPECT_EQ_INT(JsonType::kObject, root.type());
+    EXPECT_EQ_SIZE_T(7, root.size());
+    EXPECT_EQ_INT(JsonType::kNull, root["n"].type());
+    EXPECT_TRUE(root["t"].ToBoolean());
+    EXPECT_EQ_DOUBLE(123.0, root["i"].ToNumber());
+    EXPECT_TRUE(root["s"].ToString() == "abc");
+    EXPECT_EQ_SIZE_T(3, root["a"].size());
+    EXPECT_EQ_DOUBLE(1.0, root["a"][0].ToNumber());
+    EXPECT_TRUE(root["a"][1].ToString() == "x");
+    EXPECT_EQ_SIZE_T(0, root["a"][2].size());
+    EXPECT_TRUE(root["o"]["s"].ToString() == "nested");
+    EXPECT_EQ_DOUBLE(0.0, root[""].ToNumber());
+    EXPECT_TRUE(root.KeyAt(0) == "" && root.KeyAt(6) == "t");
+
+    TapeElem missing = root;
+    EXPECT_FALSE(root.Find("missing", &missing));
+    bool thrown = false;
+    try { root["a"][3]; }
+    catch (const std::out_of_range&) { thrown = true; }
+    EXPECT_TRUE(thrown);
+}
+
+// rewrites the checksum after tape was edited, as a forger would
+static void reseal_tape(std::string& tape)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = kTapeHeaderSize; i < tape.size(); ++i)
+    {
+        hash ^= static_cast<unsigned char>(tape[i]);
+        hash *= 1099511628211ULL;
+    }
+    memcpy(&tape[24], &hash, sizeof(hash));
+}
+
+static void test_tape_malformed()
+{
+    std::string tape;
+    WriteTape(Json().Parse("[\"x\",{\"a\":1,\"b\":2}]"), tape);
+    TapeDocument tdoc;
+    EXPECT_TRUE(tdoc.Load(tape));
+    EXPECT_TRUE(tdoc.Verify());
+
+    uint32_t root;
+    memcpy(&root, &tape[8], sizeof(root));
+    auto patched = [&](size_t at, uint32_t word)
+    {
+        std::string bad = tape;
+        memcpy(&bad[at], &word, sizeof(word));
+        reseal_tape(bad);
+        return bad;
+    };
+    const std::string bad[] = {
+        patched(root + 8, 1u << 30),            // element past the end
+        patched(root + 8, root),                // element that is the array
+        patched(root + 8, kTapeHeaderSize + 4), // misaligned element
+        patched(root + 4, 1000),                // count past the end
+        patched(kTapeHeaderSize + 4, 1000),     // string past the end
+        patched(kTapeHeaderSize, 9),            // unknown type
+    };
+    for (const std::string& tape_bad : bad)
+    {
+        EXPECT_TRUE(tdoc.Load(tape_bad));
+        EXPECT_FALSE(tdoc.Verify());
+        EXPECT_EQ_INT(TapeErrorCode::kMalformed, tdoc.GetErrorCode());
+    }
+
+    // keys out of order would break the binary search of Find
+    uint32_t object;
+    memcpy(&object, &tape[root + 12], sizeof(object));
+    std::string swapped = tape;
+    memcpy(&swapped[object + 8], &tape[object + 16], 8);
+    memcpy(&swapped[object + 16], &tape[object + 8], 8);
+    reseal_tape(swapped);
+    EXPECT_TRUE(tdoc.Load(swapped));
+    EXPECT_FALSE(tdoc.Verify());
+    EXPECT_EQ_INT(TapeErrorCode::kMalformed, tdoc.GetErrorCode());
+}
+
+static void test_tape_file()
+{
+    std::string tape;
+    WriteTape(JsonElem{ std::string("mapped") }, tape);
+    const char* path = "polojson_test.tape";
+    FILE* f = fopen(path, "wb");
+    fwrite(tape.data(), 1, tape.size(), f);
+    fclose(f);
+
+    TapeDocument tdoc;
+    EXPECT_TRUE(tdoc.Open(path));
+    EXPECT_TRUE(tdoc.Root().ToString() == "mapped");
+    tdoc.Close();
+    remove(path);
+    EXPECT_FALSE(tdoc.Open(path));
+    EXPECT_EQ_INT(TapeErrorCode::kOpenFailed, tdoc.GetErrorCode());
+
+    std::string corrupt = tape;
+    corrupt[kTapeHeaderSize + 8] ^= 1;
+    EXPECT_TRUE(tdoc.Load(corrupt));
+    EXPECT_FALSE(tdoc.Verify());
+    EXPECT_EQ_INT(TapeErrorCode::kBadChecksum, tdoc.GetErrorCode());
+    corrupt = tape;
+    corrupt[0] = 'X';
+    EXPECT_FALSE(tdoc.Load(corrupt));
+    EXPECT_EQ_INT(TapeErrorCode::kBadMagic, tdoc.GetErrorCode());
+    corrupt = tape;
+    std::reverse(corrupt.begin(), corrupt.begin() + 4);
+    EXPECT_FALSE(tdoc.Load(corrupt));
+    EXPECT_EQ_INT(TapeErrorCode::kForeignByteOrder, tdoc.GetErrorCode());
+    EXPECT_FALSE(tdoc.Load(tape.substr(0, tape.size() - 8)));
+    EXPECT_EQ_INT(TapeErrorCode::kTruncated, tdoc.GetErrorCode());
+}
+
+static void test_tape()
+{
+    test_tape_query();
+    test_tape_malformed();
+    test_tape_file();
+}
+
+struct BindPoint
+{
+    double x;
+    double y;
+};
+POLOJSON_FIELDS(BindPoint, x, y)
+
+struct BindShape
+{
+    std::string name;
+    int sides;
+    bool filled;
+    std::vector<BindPoint> points;
+    std::optional<std::string> color;
+    std::map<std::string, int> tags;
+    JsonElem extra;
+};
+POLOJSON_FIELDS(BindShape, name, sides, filled, points, color, tags, extra)
+
+static void test_bind_parse()
+{
+    StructParser parser;
+    BindShape shape;
+    EXPECT_TRUE(parser.Parse(
+        " { \"name\" : \"tri\", \"unknown\" : [ { \"a\" : \"\\u0041\" }, 1e5, null ],"
+        " \"sides\" : 3, \"filled\" : true, \"points\" : [ {\"x\":0,\"y\":0}, {\"y\":1.5,\"x\":-2} ],"
+        " \"tags\" : { \"a\" : 1, \"b\" : 2 }, \"extra\" : [ true ] } ", shape));
+    EXPECT_EQ_INT(ParseErrorCode::kOK, parser.GetErrorCode());
+    EXPECT_TRUE(shape.name == "tri");
+    EXPECT_EQ_INT(3, shape.sides);
+    EXPECT_TRUE(shape.filled);
+    EXPECT_EQ_SIZE_T(2, shape.points.size());
+    EXPECT_EQ_DOUBLE(-2.0, shape.points[1].x);
+    EXPECT_EQ_DOUBLE(1.5, shape.points[1].y);
+    EXPECT_FALSE(shape.color.has_value());
+    EXPECT_EQ_SIZE_T(2, shape.tags.size());
+    EXPECT_EQ_INT(2, shape.tags["b"]);
+    EXPECT_TRUE(shape.extra[0].ToBoolean());
+
+    std::vector<BindPoint> points;
+    EXPECT_TRUE(parser.Parse("[{\"x\":1,\"y\":2}]", points));
+    EXPECT_EQ_DOUBLE(2.0, points[0].y);
+    std::optional<std::string> color;
+    EXPECT_TRUE(parser.Parse("\"red\"", color));
+    EXPECT_TRUE(*color == "red");
+}
+
+#define TEST_BIND_ERROR(error, path, json)\
+    do {\
+        StructParser parser;\
+        BindShape shape;\
+        EXPECT_FALSE(parser.Parse(json, shape));\
+        EXPECT_EQ_INT(error, parser.GetErrorCode());\
+        EXPECT_EQ_STRING(path, parser.GetErrorPath().c_str(), parser.GetErrorPath().size());\
+    } while(0)
+
+static void test_bind_error()
+{
+    const char* tail = ",\"tags\":{},\"extra\":null}";
+    TEST_BIND_ERROR(ParseErrorCode::kMissField, "points",
+        (std::string("{\"name\":\"a\",\"sides\":1,\"filled\":false") + tail));
+    TEST_BIND_ERROR(ParseErrorCode::kTypeMismatch, "sides",
+        (std::string("{\"name\":\"a\",\"sides\":1.5,\"filled\":false,\"points\":[]") + tail));
+    TEST_BIND_ERROR(ParseErrorCode::kTypeMismatch, "points[1].y",
+        (std::string("{\"name\":\"a\",\"sides\":1,\"filled\":false,\"points\":[{\"x\":0,\"y\":0},{\"x\":0,\"y\":\"0\"}]") + tail));
+    TEST_BIND_ERROR(ParseErrorCode::kTypeMismatch, "color",
+        (std::string("{\"color\":1") + tail));
+    TEST_BIND_ERROR(ParseErrorCode::kTypeMismatch, "", "[]");
+    TEST_BIND_ERROR(ParseErrorCode::kMissColon, "", "{\"name\" \"a\"}");
+    TEST_BIND_ERROR(ParseErrorCode::kMissCommaOrSquareBracket, "", "{\"skipped\":[1 2]}");
+    TEST_BIND_ERROR(ParseErrorCode::kRootNotSingular, "", "{\"name\":\"a\",\"sides\":1,\"filled\":false,\"points\":[],\"tags\":{},\"extra\":0} x");
+}
+
+struct BindCounts
+{
+    int64_t total;
+    uint64_t bytes;
+    uint8_t level;
+};
+POLOJSON_FIELDS(BindCounts, total, bytes, level)
+
+#define TEST_BIND_COUNTS(expect, json)\
+    do {\
+        StructParser parser;\
+        BindCounts counts;\
+        EXPECT_EQ_INT(expect, parser.Parse(json, counts));\
+    } while(0)
+
+static void test_bind_duplicate()
+{
+    // the first of duplicate keys wins, as with Parser
+    const std::string json = "{\"name\":\"first\",\"sides\":3,\"filled\":true,"
+        "\"points\":[],\"tags\":{\"a\":1,\"a\":2},\"extra\":null,"
+        "\"name\":\"second\",\"sides\":\"not checked against the type\"}";
+    StructParser parser;
+    BindShape shape;
+    EXPECT_TRUE(parser.Parse(json, shape));
+    EXPECT_TRUE(shape.name == "first");
+    EXPECT_EQ_INT(3, shape.sides);
+    EXPECT_EQ_INT(1, shape.tags["a"]);
+    JsonElem doc = Json().Parse(json);
+    EXPECT_TRUE(doc["name"].ToString() == "first");
+    EXPECT_EQ_DOUBLE(1.0, doc["tags"]["a"].ToNumber());
+
+    // repeats are still validated
+    EXPECT_FALSE(parser.Parse("{\"name\":\"a\",\"name\":[1,}", shape));
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidValue, parser.GetErrorCode());
+}
+
+struct BindOptional
+{
+    std::optional<int> a;
+};
+POLOJSON_FIELDS(BindOptional, a)
+
+static void test_bind_reuse()
+{
+    // a parse after a failed one reports its own result
+    StructParser parser;
+    std::vector<int> values;
+    EXPECT_FALSE(parser.Parse("[1,", values));
+    EXPECT_TRUE(parser.Parse("[]", values));
+    EXPECT_EQ_INT(ParseErrorCode::kOK, parser.GetErrorCode());
+    BindOptional optional;
+    EXPECT_FALSE(parser.Parse("{\"a\":\"x\"}", optional));
+    EXPECT_TRUE(parser.Parse("{}", optional));
+    EXPECT_EQ_INT(ParseErrorCode::kOK, parser.GetErrorCode());
+    EXPECT_TRUE(parser.GetErrorPath().empty());
+}
+
+static void test_bind_integer()
+{
+    StructParser parser;
+    BindCounts counts;
+    EXPECT_TRUE(parser.Parse("{\"total\":-9223372036854775808,"
+        "\"bytes\":18446744073709551615,\"level\":255}", counts));
+    EXPECT_TRUE(counts.total == INT64_MIN);
+    EXPECT_TRUE(counts.bytes == UINT64_MAX);
+    EXPECT_EQ_INT(255, counts.level);
+    EXPECT_TRUE(parser.Parse("{\"total\":9007199254740993,"
+        "\"bytes\":2.5e1,\"level\":-0}", counts));
+    EXPECT_TRUE(counts.total == 9007199254740993LL);
+    EXPECT_TRUE(counts.bytes == 25);
+    EXPECT_EQ_INT(0, counts.level);
+
+    TEST_BIND_COUNTS(true, "{\"total\":1,\"bytes\":1,\"level\":1e2}");
+    TEST_BIND_COUNTS(false, "{\"total\":9223372036854775808,\"bytes\":1,\"level\":1}");
+    TEST_BIND_COUNTS(false, "{\"total\":9.223372036854775808e18,\"bytes\":1,\"level\":1}");
+    TEST_BIND_COUNTS(false, "{\"total\":1,\"bytes\":18446744073709551616,\"level\":1}");
+    TEST_BIND_COUNTS(false, "{\"total\":1,\"bytes\":1.8446744073709551616e19,\"level\":1}");
+    TEST_BIND_COUNTS(false, "{\"total\":1,\"bytes\":-1,\"level\":1}");
+    TEST_BIND_COUNTS(false, "{\"total\":1,\"bytes\":1,\"level\":256}");
+    /* beyond 2^53 a fraction or exponent no longer pins down the integer */
+    TEST_BIND_COUNTS(false, "{\"total\":9007199254740993.0,\"bytes\":1,\"level\":1}");
+    TEST_BIND_COUNTS(false, "{\"total\":1e17,\"bytes\":1,\"level\":1}");
+}
+
+static void test_bind_stringify()
+{
+    BindShape shape;
+    shape.name = "q\"uad";
+    shape.sides = 4;
+    shape.filled = false;
+    shape.points = { { 0.5, -1 }, { 3, 4 } };
+    shape.tags["k"] = -7;
+    shape.extra = JsonElem{ nullptr };
+    std::string out = Stringify(shape);
+    const char expect[] = "{\"name\":\"q\\\"uad\",\"sides\":4,\"filled\":false,"
+        "\"points\":[{\"x\":0.5,\"y\":-1},{\"x\":3,\"y\":4}],\"color\":null,"
+        "\"tags\":{\"k\":-7},\"extra\":null}";
+    EXPECT_EQ_STRING(expect, out.c_str(), out.size());
+
+    shape.color = "red";
+    StructParser parser;
+    BindShape parsed;
+    EXPECT_TRUE(parser.Parse(Stringify(shape), parsed));
+    EXPECT_TRUE(parsed.name == shape.name);
+    EXPECT_TRUE(*parsed.color == "red");
+    EXPECT_EQ_DOUBLE(-1.0, parsed.points[0].y);
+
+    Json test;
+    JsonElem e = test.Parse(out);
+    EXPECT_EQ_INT(ParseErrorCode::kOK, test.GetErrorCode());
+    out.clear();
+    Stringify(std::vector<std::optional<int64_t>>{ 9007199254740993LL, std::nullopt }, out);
+    EXPECT_EQ_STRING("[9007199254740993,null]", out.c_str(), out.size());
+}
+
+static void test_bind()
+{
+    test_bind_parse();
+    test_bind_error();
+    test_bind_integer();
+    test_bind_reuse();
+    test_bind_duplicate();
+    test_bind_stringify();
+}
+
+static void test_message()
+{
+    std::vector<MessageField> fields;
+    for (int i = 0; i < 40; ++i)
+        fields.push_back({ "field" + std::to_string(i), JsonType::kNumber });
+    fields.push_back({ "name", JsonType::kString });
+    fields.push_back({ "ok", JsonType::kTrue });
+    MessageSchema schema(fields);
+    for (size_t i = 0; i < fields.size(); ++i)
+        EXPECT_EQ_SIZE_T(i, schema.Find(fields[i].key));
+    EXPECT_TRUE(schema.Find("field40") == MessageSchema::npos);
+
+    MessageParser parser;
+    Message msg;
+    EXPECT_TRUE(parser.Parse(
+        "{ \"field7\" : 7, \"name\" : \"n\", \"other\" : [1], \"ok\" : false }", schema, &msg));
+    EXPECT_EQ_INT(ParseErrorCode::kOK, parser.GetErrorCode());
+    EXPECT_TRUE(msg.Has(7));
+    EXPECT_FALSE(msg.Has(8));
+    EXPECT_EQ_DOUBLE(7.0, msg[7].ToNumber());
+    EXPECT_TRUE(msg[40].ToString() == "n");
+    EXPECT_FALSE(msg[41].ToBoolean());
+    EXPECT_EQ_SIZE_T(1, msg.extra().size());
+    EXPECT_EQ_SIZE_T(1, msg.Get("other")->ToArray().size());
+    EXPECT_TRUE(msg.Get("field8") == nullptr);
+    EXPECT_TRUE(msg.Get("field7") == &msg[7]);
+
+    EXPECT_FALSE(parser.Parse("{\"field1\":1,\"name\":2}", schema, &msg));
+    EXPECT_EQ_INT(ParseErrorCode::kTypeMismatch, parser.GetErrorCode());
+    EXPECT_TRUE(parser.GetErrorKey() == "name");
+    EXPECT_FALSE(parser.Parse("[]", schema, &msg));
+    EXPECT_EQ_INT(ParseErrorCode::kTypeMismatch, parser.GetErrorCode());
+    EXPECT_FALSE(parser.Parse("{\"name\":\"a\" \"ok\":true}", schema, &msg));
+    EXPECT_EQ_INT(ParseErrorCode::kMissCommaOrCurlyBracket, parser.GetErrorCode());
+
+    // the first of duplicate keys wins, as with Parser
+    const char* json = "{\"name\":\"first\",\"other\":1,\"name\":\"second\","
+        "\"other\":2,\"field3\":3,\"field3\":\"later, unchecked\"}";
+    EXPECT_TRUE(parser.Parse(json, schema, &msg));
+    EXPECT_TRUE(msg[40].ToString() == "first");
+    EXPECT_EQ_DOUBLE(1.0, msg.Get("other")->ToNumber());
+    EXPECT_EQ_DOUBLE(3.0, msg[3].ToNumber());
+    JsonElem doc = Json().Parse(json);
+    EXPECT_TRUE(doc["name"].ToString() == "first");
+    EXPECT_EQ_DOUBLE(1.0, doc["other"].ToNumber());
+    EXPECT_FALSE(parser.Parse("{\"ok\":true,\"ok\":[}", schema, &msg));
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidValue, parser.GetErrorCode());
+}
+
+static void test_access_copy_on_write()
+{
+    Json test;
+    JsonElem a = test.Parse("{\"x\":{\"y\":[1,2]},\"z\":{\"w\":0}}");
+    JsonElem b = a;
+    const JsonElem& ca = a;
+    const JsonElem& cb = b;
+    EXPECT_TRUE(&ca["x"] == &cb["x"]); /* shared until written */
+
+    b["x"]["y"][0].SetNumber(10.0);
+    EXPECT_EQ_DOUBLE(1.0, ca["x"]["y"][0].ToNumber());
+    EXPECT_EQ_DOUBLE(10.0, cb["x"]["y"][0].ToNumber());
+    EXPECT_TRUE(&ca["x"] != &cb["x"]);
+    EXPECT_TRUE(&ca["z"]["w"] == &cb["z"]["w"]); /* untouched siblings stay shared */
+
+    b.ToObject().erase("z");
+    EXPECT_EQ_SIZE_T(2, a.ToObject().size());
+    EXPECT_EQ_SIZE_T(1, b.ToObject().size());
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([a]()
+            {
+                for (int i = 0; i < 10000; ++i)
+                {
+                    JsonElem copy = a;
+                    copy["z"]["w"].SetNumber(i);
+                }
+            });
+    }
+    for (auto& t : threads)
+        t.join();
+    EXPECT_EQ_DOUBLE(0.0, ca["z"]["w"].ToNumber());
+
+    // a reference taken before a copy still points into the shared value,
+    // so writes index again from the root
+    JsonElem c = test.Parse("{\"x\":{\"y\":0}}");
+    JsonElem& stale = c["x"];
+    JsonElem d = c;
+    const JsonElem& cd = d;
+    EXPECT_TRUE(&stale == &cd["x"]);
+    c["x"]["y"].SetNumber(1);
+    EXPECT_EQ_DOUBLE(1.0, c["x"]["y"].ToNumber());
+    EXPECT_EQ_DOUBLE(0.0, cd["x"]["y"].ToNumber());
+    EXPECT_TRUE(d.Stringify() == "{\"x\":{\"y\":0}}");
+}
+
+static void test_access_equality()
+{
+    Json test;
+    JsonElem a = test.Parse("{\"x\":[1,{\"y\":null}],\"s\":\"abc\",\"z\":-0}");
+    JsonElem b = test.Parse("{ \"z\" : 0, \"s\" : \"abc\", \"x\" : [ 1.0, { \"y\" : null } ] }");
+    EXPECT_TRUE(a == b);
+    EXPECT_TRUE(a.Hash() == b.Hash());
+    EXPECT_TRUE(a.Hash() == a.Hash());
+
+    b["x"][1]["y"].SetBoolean(false);
+    EXPECT_TRUE(a != b);
+    EXPECT_TRUE(a.Hash() != b.Hash()); /* cached hash was dropped by the write */
+    b["x"][1]["y"].SetNull();
+    EXPECT_TRUE(a == b);
+    EXPECT_TRUE(a.Hash() == b.Hash());
+
+    EXPECT_TRUE(test.Parse("[1,2]") != test.Parse("[2,1]"));
+    EXPECT_TRUE(test.Parse("[1,2]").Hash() != test.Parse("[2,1]").Hash());
+    EXPECT_TRUE(test.Parse("{\"a\":1}") != test.Parse("{\"a\":1,\"b\":1}"));
+    EXPECT_TRUE(test.Parse("\"1\"") != test.Parse("1"));
+    EXPECT_TRUE(test.Parse("{\"a\":\"b\"}").Hash() != test.Parse("{\"b\":\"a\"}").Hash());
+
+    std::unordered_map<JsonElem, int> seen;
+    seen[a] = 1;
+    seen[test.Parse("[]")] = 2;
+    EXPECT_EQ_SIZE_T(2, seen.size());
+    EXPECT_EQ_INT(1, seen[b]);
+}
+
+static void test_access_memory_usage()
+{
+    JsonElem s{ std::string(1000, 'x') };
+    EXPECT_TRUE(s.MemoryUsage() >= 1000 + sizeof(JsonString));
+    EXPECT_TRUE(JsonElem{ 1.0 }.MemoryUsage() >= sizeof(JsonNumber));
+
+    // a value shared within the tree is counted once
+    JsonElem shared{ array_t{ s, s } };
+    JsonElem distinct{ array_t{ s, JsonElem{ std::string(1000, 'x') } } };
+    EXPECT_EQ_SIZE_T(s.MemoryUsage(), distinct.MemoryUsage() - shared.MemoryUsage());
+
+    object_t obj;
+    obj["key"] = s;
+    JsonElem o{ obj };
+    EXPECT_TRUE(o.MemoryUsage() > s.MemoryUsage() + sizeof(JsonObject));
+
+    // cached text is part of the footprint until it is cleared
+    JsonElem a{ array_t(100, JsonElem{ 12345.0 }) };
+    size_t plain = a.MemoryUsage();
+    a.Stringify(StringifyCacheOptions());
+    EXPECT_TRUE(a.MemoryUsage() > plain + 500);
+    a.ClearStringifyCache();
+    EXPECT_EQ_SIZE_T(plain, a.MemoryUsage());
 }
 
 static void test_access()
@@ -529,6 +1640,1035 @@ static void test_access()
 	test_access_boolean();
 	test_access_number();
 	test_access_string();
+    test_access_copy_on_write();
+    test_access_equality();
+    test_access_memory_usage();
+}
+
+static const char* kStreamJson =
+    " [ {\"a\":\"x,]\\\"}\",\"b\":[1,[2]]} , -1.5e3,\"s\\\\\" ,true,null,[],\n{} ] \n";
+
+static void check_stream_elements(const std::vector<JsonElem>& elems)
+{
+    EXPECT_EQ_SIZE_T(7, elems.size());
+    if (elems.size() != 7)
+        return;
+    EXPECT_TRUE(elems[0]["a"].ToString() == "x,]\"}");
+    EXPECT_EQ_DOUBLE(2.0, elems[0]["b"][1][0].ToNumber());
+    EXPECT_EQ_DOUBLE(-1500.0, elems[1].ToNumber());
+    EXPECT_TRUE(elems[2].ToString() == "s\\");
+    EXPECT_TRUE(elems[3].ToBoolean());
+    EXPECT_TRUE(elems[4].IsNull());
+    EXPECT_TRUE(elems[5].IsArray());
+    EXPECT_TRUE(elems[6].IsObject());
+}
+
+static void test_stream_iterate()
+{
+    // tiny buffers make every token straddle a refill
+    for (size_t buffer_size : { 1, 2, 3, 7, 4096 })
+    {
+        std::istringstream in(kStreamJson);
+        ArrayStreamReader reader(in, buffer_size);
+        std::vector<JsonElem> elems;
+        for (const JsonElem& elem : reader)
+            elems.push_back(elem);
+        check_stream_elements(elems);
+        EXPECT_EQ_INT(ParseErrorCode::kOK, reader.GetErrorCode());
+    }
+
+    std::istringstream empty(" [ ] ");
+    ArrayStreamReader reader(empty);
+    JsonElem elem;
+    EXPECT_FALSE(reader.Next(&elem));
+    EXPECT_EQ_INT(ParseErrorCode::kOK, reader.GetErrorCode());
+}
+
+static void test_stream_generator()
+{
+#if defined(__cpp_impl_coroutine)
+    std::istringstream in(kStreamJson);
+    ArrayStreamReader reader(in, 5);
+    std::vector<JsonElem> elems;
+    for (JsonElem& elem : reader.Elements())
+        elems.push_back(std::move(elem));
+    check_stream_elements(elems);
+    EXPECT_EQ_INT(ParseErrorCode::kOK, reader.GetErrorCode());
+#endif
+}
+
+static void test_stream_fd()
+{
+#ifndef _WIN32
+    FILE* f = tmpfile();
+    fputs(kStreamJson, f);
+    fflush(f);
+    rewind(f);
+    ArrayStreamReader reader(fileno(f), 16);
+    std::vector<JsonElem> elems(reader.begin(), reader.end());
+    check_stream_elements(elems);
+    EXPECT_EQ_INT(ParseErrorCode::kOK, reader.GetErrorCode());
+    fclose(f);
+#endif
+}
+
+#define TEST_STREAM_ERROR(error, json, count)\
+    do {\
+        std::istringstream in(json);\
+        ArrayStreamReader reader(in, 2);\
+        JsonElem elem;\
+        size_t n = 0;\
+        while (reader.Next(&elem))\
+            ++n;\
+        EXPECT_EQ_SIZE_T(count, n);\
+        EXPECT_EQ_INT(error, reader.GetErrorCode());\
+    } while(0)
+
+static void test_stream_error()
+{
+    TEST_STREAM_ERROR(ParseErrorCode::kExpectValue, "  ", 0);
+    TEST_STREAM_ERROR(ParseErrorCode::kTypeMismatch, "{\"a\":1}", 0);
+    TEST_STREAM_ERROR(ParseErrorCode::kMissCommaOrSquareBracket, "[1 2]", 1);
+    TEST_STREAM_ERROR(ParseErrorCode::kMissCommaOrSquareBracket, "[1,2", 2);
+    TEST_STREAM_ERROR(ParseErrorCode::kExpectValue, "[1,]", 1);
+    TEST_STREAM_ERROR(ParseErrorCode::kMissCommaOrCurlyBracket, "[1,{\"a\":1]", 1);
+    TEST_STREAM_ERROR(ParseErrorCode::kMissQuotationMark, "[\"ab", 0);
+    TEST_STREAM_ERROR(ParseErrorCode::kInvalidValue, "[tru]", 0);
+    TEST_STREAM_ERROR(ParseErrorCode::kRootNotSingular, "[1] 2", 1);
+}
+
+static void test_stream()
+{
+    test_stream_iterate();
+    test_stream_generator();
+    test_stream_fd();
+    test_stream_error();
+}
+
+static void test_batch()
+{
+    // sizes vary by about 1000x, with errors mixed in
+    std::vector<std::string> texts;
+    for (int i = 0; i < 300; ++i)
+    {
+        if (i % 50 == 7)
+            texts.push_back("[1,2");
+        else if (i % 50 == 8)
+            texts.push_back("{\"a\":1} x");
+        else if (i % 40 == 0)
+        {
+            std::string big = "[";
+            for (int j = 0; j < 2000; ++j)
+                big += std::to_string(i + j) + ",";
+            texts.push_back(big + "{\"last\":true}]");
+        }
+        else
+            texts.push_back("{\"id\":" + std::to_string(i) + "}");
+    }
+    std::vector<std::string_view> documents(texts.begin(), texts.end());
+
+    for (size_t threads : { 1, 2, 4, 7 })
+    {
+        BatchParser batch(threads);
+        EXPECT_EQ_SIZE_T(threads, batch.threads());
+        for (int round = 0; round < 3; ++round)
+        {
+            std::vector<BatchResult> results = batch.ParseBatch(documents);
+            EXPECT_EQ_SIZE_T(texts.size(), results.size());
+            bool all_match = results.size() == texts.size();
+            for (size_t i = 0; all_match && i < texts.size(); ++i)
+            {
+                Parser parser;
+                JsonElem expect = parser.Parse(texts[i]);
+                all_match = results[i].error_code == parser.GetErrorCode() &&
+                    (parser.GetErrorCode() != ParseErrorCode::kOK ||
+                        results[i].value == expect);
+            }
+            EXPECT_TRUE(all_match);
+        }
+        EXPECT_EQ_INT(ParseErrorCode::kMissCommaOrSquareBracket,
+            batch.ParseBatch(documents)[7].error_code);
+        EXPECT_EQ_INT(ParseErrorCode::kRootNotSingular,
+            batch.ParseBatch(documents)[8].error_code);
+        EXPECT_EQ_SIZE_T(0, batch.ParseBatch({}).size());
+    }
+}
+
+// the Stringify of every match, sorted when sorted is set as object
+// members come in no particular order
+static std::string path_query(const JsonElem& root, const char* expression,
+    bool sorted = false)
+{
+    JsonPath path;
+    if (!path.Compile(expression))
+        return "error";
+    std::vector<std::string> texts;
+    for (const JsonElem* e : path.Evaluate(root))
+        texts.push_back(e->Stringify());
+    if (sorted)
+        std::sort(texts.begin(), texts.end());
+    std::string joined;
+    for (const std::string& text : texts)
+        joined += (joined.empty() ? "" : " ") + text;
+    return joined;
+}
+
+#define TEST_PATH(expect, root, expression)\
+    do {\
+        std::string actual = path_query(root, expression);\
+        EXPECT_EQ_STRING(expect, actual.c_str(), actual.size());\
+    } while(0)
+
+#define TEST_PATH_SORTED(expect, root, expression)\
+    do {\
+        std::string actual = path_query(root, expression, true);\
+        EXPECT_EQ_STRING(expect, actual.c_str(), actual.size());\
+    } while(0)
+
+static void test_path_select()
+{
+    Parser parser;
+    JsonElem doc = parser.Parse(
+        "{\"store\":{\"items\":["
+        "{\"sku\":\"a1\",\"price\":8,\"tags\":[\"x\"]},"
+        "{\"sku\":\"b2\",\"price\":12.5},"
+        "{\"sku\":\"c3\",\"price\":30,\"sale\":true},"
+        "{\"sku\":\"d4\",\"price\":\"n/a\"}],"
+        "\"owner\":{\"name\":\"z\"},\"odd key\":[0,1,2,3,4,5]}}");
+    EXPECT_EQ_INT(ParseErrorCode::kOK, parser.GetErrorCode());
+
+    TEST_PATH("\"b2\"", doc, "$.store.items[1].sku");
+    TEST_PATH("\"b2\"", doc, "$['store'][\"items\"][1]['sku']");
+    TEST_PATH("\"d4\"", doc, "$.store.items[-1].sku");
+    TEST_PATH("", doc, "$.store.items[4].sku");
+    TEST_PATH("", doc, "$.store.missing.sku");
+    TEST_PATH("\"a1\" \"b2\" \"c3\" \"d4\"", doc, "$.store.items[*].sku");
+    TEST_PATH("\"a1\" \"b2\" \"c3\" \"d4\"", doc, "$.store.items.*.sku");
+    TEST_PATH_SORTED("\"z\"", doc, "$.store.owner.*");
+    TEST_PATH("5", doc, "$.store.*[5]");
+    TEST_PATH("\"a1\" \"b2\" \"c3\" \"d4\"", doc, "$..sku");
+    TEST_PATH_SORTED("\"z\"", doc, "$..name");
+    TEST_PATH("\"x\"", doc, "$..tags[0]");
+    EXPECT_TRUE(path_query(doc, "$") == doc.Stringify());
+
+    const JsonElem& odd = doc["store"]["odd key"];
+    TEST_PATH("1 2", odd, "$[1:3]");
+    TEST_PATH("0 2 4", odd, "$[::2]");
+    TEST_PATH("4 5", odd, "$[-2:]");
+    TEST_PATH("5 4 3 2 1 0", odd, "$[::-1]");
+    TEST_PATH("5 3", odd, "$[5:1:-2]");
+    TEST_PATH("", odd, "$[3:1]");
+    TEST_PATH("", odd, "$[::0]");
+    TEST_PATH("0 1 2 3 4 5", odd, "$[-100:100]");
+
+    // results point into the document
+    JsonPath path;
+    EXPECT_TRUE(path.Compile("$.store.owner"));
+    std::vector<const JsonElem*> found = path.Evaluate(doc);
+    EXPECT_EQ_SIZE_T(1, found.size());
+    EXPECT_TRUE(found.size() == 1 && found[0] == &doc["store"]["owner"]);
+}
+
+static void test_path_filter()
+{
+    Parser parser;
+    JsonElem doc = parser.Parse(
+        "{\"items\":["
+        "{\"sku\":\"a1\",\"price\":8,\"tags\":[\"x\"]},"
+        "{\"sku\":\"b2\",\"price\":12.5},"
+        "{\"sku\":\"c3\",\"price\":30,\"sale\":true},"
+        "{\"sku\":\"d4\",\"price\":\"n/a\",\"sale\":null}]}");
+
+    TEST_PATH("\"b2\" \"c3\"", doc, "$.items[?(@.price > 10)].sku");
+    TEST_PATH("\"b2\" \"c3\"", doc, "$.items[?@.price>10].sku");
+    TEST_PATH("\"a1\"", doc, "$.items[?(@.price <= 8)].sku");
+    TEST_PATH("\"a1\" \"b2\"", doc, "$.items[?(@.price < 30)].sku");
+    TEST_PATH("\"c3\"", doc, "$.items[?(@.price >= 30)].sku");
+    TEST_PATH("\"b2\"", doc, "$.items[?(@.price == 12.5)].sku");
+    TEST_PATH("\"a1\" \"c3\" \"d4\"", doc, "$.items[?(@.price != 12.5)].sku");
+    TEST_PATH("\"d4\"", doc, "$.items[?(@.price == 'n/a')].sku");
+    TEST_PATH("\"c3\"", doc, "$.items[?(@.sale == true)].sku");
+    TEST_PATH("\"d4\"", doc, "$.items[?(@.sale == null)].sku");
+    TEST_PATH("\"c3\" \"d4\"", doc, "$.items[?(@.sale)].sku");
+    TEST_PATH("\"a1\" \"b2\"", doc, "$.items[?(!@.sale)].sku");
+    TEST_PATH("\"a1\"", doc, "$.items[?(@.tags[0] == \"x\")].sku");
+    TEST_PATH("\"a1\"", doc, "$.items[?(@['tags'][-1] == \"x\")].sku");
+    TEST_PATH("\"b2\" \"c3\"",
+        doc, "$.items[?(@.price > 10 && @.price < 100)].sku");
+    TEST_PATH("\"a1\" \"c3\"", doc,
+        "$.items[?(@.price < 10 || @.sale == true)].sku");
+    TEST_PATH("\"a1\" \"c3\"", doc,
+        "$.items[?((@.price < 10 || @.sale) && @.sku != 'd4')].sku");
+    TEST_PATH("", doc, "$.items[?(@.price > 'z')].sku");
+    TEST_PATH("", doc, "$.items[*].sku[?(@ == 'c3')]"); //scalars have no children
+
+    JsonElem numbers = parser.Parse("[3,-1,7,10]");
+    TEST_PATH("7 10", numbers, "$[?(@ > 5)]");
+    TEST_PATH("-1", numbers, "$[?(@ < -0.5e0)]");
+}
+
+#define TEST_PATH_ERROR(error, offset, expression)\
+    do {\
+        JsonPath path;\
+        EXPECT_FALSE(path.Compile(expression));\
+        EXPECT_EQ_INT(error, path.GetErrorCode());\
+        EXPECT_EQ_SIZE_T(offset, path.GetErrorOffset());\
+        EXPECT_EQ_SIZE_T(0, path.Evaluate(JsonElem(1.0)).size());\
+    } while(0)
+
+static void test_path_error()
+{
+    TEST_PATH_ERROR(PathErrorCode::kMissRoot, 0, "");
+    TEST_PATH_ERROR(PathErrorCode::kMissRoot, 0, "store.items");
+    TEST_PATH_ERROR(PathErrorCode::kInvalidName, 2, "$.");
+    TEST_PATH_ERROR(PathErrorCode::kInvalidName, 2, "$.1a");
+    TEST_PATH_ERROR(PathErrorCode::kInvalidSelector, 1, "$x");
+    TEST_PATH_ERROR(PathErrorCode::kInvalidSelector, 2, "$[]");
+    TEST_PATH_ERROR(PathErrorCode::kInvalidSelector, 3, "$[1.5]");
+    TEST_PATH_ERROR(PathErrorCode::kInvalidSelector, 6, "$['a\\q']");
+    TEST_PATH_ERROR(PathErrorCode::kMissBracket, 3, "$[1");
+    TEST_PATH_ERROR(PathErrorCode::kMissBracket, 12, "$[?(@.a == 1");
+    TEST_PATH_ERROR(PathErrorCode::kInvalidFilter, 4, "$[?(a == 1)]");
+    TEST_PATH_ERROR(PathErrorCode::kInvalidFilter, 11, "$[?(@.a == x)]");
+    TEST_PATH_ERROR(PathErrorCode::kInvalidFilter, 15, "$[?(@.a == 1 &&)]");
+
+    // a failed compile drops the previous expression
+    JsonPath path;
+    EXPECT_TRUE(path.Compile("$"));
+    EXPECT_EQ_SIZE_T(1, path.Evaluate(JsonElem(1.0)).size());
+    EXPECT_FALSE(path.Compile("$["));
+    EXPECT_EQ_SIZE_T(0, path.Evaluate(JsonElem(1.0)).size());
+}
+
+static void test_path_batch()
+{
+    Parser parser;
+    std::vector<JsonElem> documents;
+    for (int i = 0; i < 20; ++i)
+        documents.push_back(parser.Parse("{\"items\":[{\"sku\":" +
+            std::to_string(i) + ",\"price\":" + std::to_string(i % 5) + "}," +
+            "{\"sku\":-1,\"price\":0}]}"));
+    JsonPath path;
+    EXPECT_TRUE(path.Compile("$.items[?(@.price >= 3)].sku"));
+    std::vector<std::vector<const JsonElem*>> results =
+        path.EvaluateBatch(documents);
+    EXPECT_EQ_SIZE_T(documents.size(), results.size());
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        EXPECT_EQ_SIZE_T(static_cast<size_t>(i % 5 >= 3 ? 1 : 0),
+            results[i].size());
+        if (!results[i].empty())
+            EXPECT_TRUE(results[i][0] == &documents[i]["items"][0]["sku"]);
+    }
+}
+
+// parsed by the compiler and queried at compile time
+static constexpr auto kStaticTable = ParseStatic<R"({
+    "name": "table", "version": 3, "enabled": true, "parent": null,
+    "limits": {"max": 1.5e3, "min": -0.25, "empty": {}},
+    "codes": [404, "not found", [], [false]],
+    "escaped": "tab\there \u00e9\ud834\udd1e \"q\"",
+    "b": 1, "a": 2, "b": 3
+})">();
+static_assert(kStaticTable.Root()["version"].ToInt64() == 3);
+static_assert(kStaticTable.Root()["limits"]["max"].ToNumber() == 1500);
+static_assert(kStaticTable.Root()["codes"][1].ToString() == "not found");
+static_assert(kStaticTable.Root()["b"].ToNumber() == 1); //the first one wins
+static_assert(kStaticTable.Root().size() == 9);
+
+// the value Parser::Parse gives for the same text, numbers bit for bit
+static bool static_matches(StaticElem s, const JsonElem& e)
+{
+    if (s.type() != e.type())
+        return false;
+    switch (s.type())
+    {
+    case JsonType::kNumber:
+    {
+        double a = s.ToNumber(), b = e.ToNumber();
+        return memcmp(&a, &b, sizeof(a)) == 0;
+    }
+    case JsonType::kString:
+        return s.ToString() == std::string_view(e.ToString());
+    case JsonType::kArray:
+        if (s.size() != e.ToArray().size())
+            return false;
+        for (size_t i = 0; i < s.size(); ++i)
+            if (!static_matches(s[i], e[i]))
+                return false;
+        return true;
+    case JsonType::kObject:
+        if (s.size() != e.ToObject().size())
+            return false;
+        for (size_t i = 0; i < s.size(); ++i)
+        {
+            if (i > 0 && !(s.KeyAt(i - 1) < s.KeyAt(i)))
+                return false;
+            auto found = e.ToObject().find(s.KeyAt(i));
+            if (found == e.ToObject().end() ||
+                !static_matches(s.ValueAt(i), found->second))
+                return false;
+        }
+        return true;
+    default:
+        return true;
+    }
+}
+
+#define TEST_STATIC(json)\
+    do {\
+        static constexpr auto doc = ParseStatic<json>();\
+        Json parser;\
+        JsonElem expect = parser.Parse(json);\
+        EXPECT_EQ_INT(ParseErrorCode::kOK, parser.GetErrorCode());\
+        EXPECT_TRUE(static_matches(doc.Root(), expect));\
+    } while(0)
+
+#define TEST_STATIC_ERROR(error, json)\
+    do {\
+        Json parser;\
+        parser.Parse(json);\
+        EXPECT_EQ_INT(error, parser.GetErrorCode());\
+        EXPECT_EQ_INT(error, StaticErrorCode<json>());\
+    } while(0)
+
+static void test_static()
+{
+    StaticElem root = kStaticTable.Root();
+    EXPECT_TRUE(root["enabled"].ToBoolean());
+    EXPECT_TRUE(root["parent"].IsNull());
+    EXPECT_TRUE(root["escaped"].ToString() == "tab\there \xC3\xA9\xF0\x9D\x84\x9E \"q\"");
+    EXPECT_EQ_SIZE_T(0, root["limits"]["empty"].size());
+    StaticElem value = root;
+    EXPECT_FALSE(root.Find("missing", &value));
+    bool thrown = false;
+    try { root["codes"][4]; } catch (const std::out_of_range&) { thrown = true; }
+    EXPECT_TRUE(thrown);
+
+    TEST_STATIC("null");
+    TEST_STATIC(" [ ] ");
+    TEST_STATIC("{}");
+    TEST_STATIC("\"\"");
+    TEST_STATIC("[1, -0, 0.5, [true, false, null], {\"k\": {\"k\": \"v\"}}]");
+    TEST_STATIC("{\"z\":1,\"a\":2,\"m\":[3],\"\":4,\"a\":5}");
+    TEST_STATIC("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\\u0024\\u20AC\\uD834\\uDD1E\"");
+
+    // numbers round like strtod, including the slow, subnormal and
+    // halfway cases
+    TEST_STATIC("[0.1, 1e23, 123456789012345678901234567890, 3.14159265358979323846]");
+    TEST_STATIC("[1.7976931348623157e308, 2.2250738585072014e-308, 2.2250738585072011e-308]");
+    TEST_STATIC("[4.9406564584124654e-324, 2.4703282292062328e-324, 2.4703282292062327e-324]");
+    TEST_STATIC("[1e-400, -1e-400, 9007199254740993, 9007199254740995, 1.00000000000000011102230246251565404236316680908203125]");
+    TEST_STATIC("[0.000001, 1E+2, 1e-2, 1.5E-10, 0e10, -0.0e-5]");
+
+    TEST_STATIC_ERROR(ParseErrorCode::kExpectValue, "");
+    TEST_STATIC_ERROR(ParseErrorCode::kExpectValue, "[1,");
+    TEST_STATIC_ERROR(ParseErrorCode::kInvalidValue, "nul");
+    TEST_STATIC_ERROR(ParseErrorCode::kInvalidValue, "[1,]");
+    TEST_STATIC_ERROR(ParseErrorCode::kInvalidValue, "1.e3");
+    TEST_STATIC_ERROR(ParseErrorCode::kRootNotSingular, "0123");
+    TEST_STATIC_ERROR(ParseErrorCode::kRootNotSingular, "{} x");
+    TEST_STATIC_ERROR(ParseErrorCode::kNumberTooBig, "1e309");
+    TEST_STATIC_ERROR(ParseErrorCode::kNumberTooBig, "-1.8e308");
+    TEST_STATIC_ERROR(ParseErrorCode::kMissQuotationMark, "\"abc");
+    TEST_STATIC_ERROR(ParseErrorCode::kInvalidStringEscape, "\"\\v\"");
+    TEST_STATIC_ERROR(ParseErrorCode::kInvalidStringChar, "\"\x01\"");
+    TEST_STATIC_ERROR(ParseErrorCode::kInvalidUnicodeHex, "\"\\u12G4\"");
+    TEST_STATIC_ERROR(ParseErrorCode::kInvalidUnicodeSurrogate, "\"\\uD800\"");
+    TEST_STATIC_ERROR(ParseErrorCode::kInvalidUnicodeSurrogate, "\"\\uD800\\u0041\"");
+    TEST_STATIC_ERROR(ParseErrorCode::kMissCommaOrSquareBracket, "[1 2]");
+    TEST_STATIC_ERROR(ParseErrorCode::kMissKey, "{1:2}");
+    TEST_STATIC_ERROR(ParseErrorCode::kMissColon, "{\"a\" 2}");
+    TEST_STATIC_ERROR(ParseErrorCode::kMissCommaOrCurlyBracket, "{\"a\":2 \"b\":3}");
+}
+
+static bool frozen_matches(FrozenElem f, const JsonElem& e)
+{
+    if (f.type() != e.type())
+        return false;
+    switch (f.type())
+    {
+    case JsonType::kNumber:
+        return f.ToNumber() == e.ToNumber();
+    case JsonType::kString:
+        return f.ToString() == std::string_view(e.ToString());
+    case JsonType::kArray:
+        if (f.size() != e.ToArray().size())
+            return false;
+        for (size_t i = 0; i < f.size(); ++i)
+            if (!frozen_matches(f[i], e[i]))
+                return false;
+        return true;
+    case JsonType::kObject:
+        if (f.size() != e.ToObject().size())
+            return false;
+        for (size_t i = 0; i < f.size(); ++i)
+        {
+            if (i > 0 && !(f.KeyAt(i - 1) < f.KeyAt(i)))
+                return false;
+            FrozenElem value = f;
+            if (!f.Find(f.KeyAt(i), &value) ||
+                !frozen_matches(value, e[f.KeyAt(i)]))
+                return false;
+        }
+        return true;
+    default:
+        return true;
+    }
+}
+
+static void test_frozen()
+{
+    Json json;
+    JsonElem doc = json.Parse("{\"name\":\"config\",\"version\":7,\"on\":true,"
+        "\"off\":false,\"none\":null,\"ratio\":-0.125,\"\":\"empty key\","
+        "\"list\":[1,\"two\",[3,[4]],{\"five\":5}],\"nested\":{\"a\":{\"b\":"
+        "{\"c\":\"deep\"}},\"empty\":{},\"none\":[]}}");
+    FrozenDocument frozen = doc.Freeze();
+    EXPECT_EQ_SIZE_T(0, frozen.size() % 8);
+    FrozenElem root = frozen.Root();
+    EXPECT_TRUE(frozen_matches(root, doc));
+    EXPECT_TRUE(root["nested"]["a"]["b"]["c"].ToString() == "deep");
+    EXPECT_TRUE(root[""].ToString() == "empty key");
+    EXPECT_EQ_INT(7, static_cast<int>(root["version"].ToInt64()));
+    EXPECT_TRUE(root["on"].ToBoolean());
+    EXPECT_FALSE(root["off"].ToBoolean());
+    EXPECT_TRUE(root["none"].IsNull());
+    EXPECT_EQ_DOUBLE(5.0, root["list"][3]["five"].ToNumber());
+
+    FrozenElem value = root;
+    EXPECT_FALSE(root.Find("missing", &value));
+    bool thrown = false;
+    try { root["missing"]; } catch (const std::out_of_range&) { thrown = true; }
+    EXPECT_TRUE(thrown);
+    thrown = false;
+    try { root["list"][4]; } catch (const std::out_of_range&) { thrown = true; }
+    EXPECT_TRUE(thrown);
+    thrown = false;
+    try { root["name"]["x"]; } catch (const std::runtime_error&) { thrown = true; }
+    EXPECT_TRUE(thrown);
+
+    // the frozen copy is independent of the tree, and its copies share it
+    doc["name"].SetString("changed");
+    EXPECT_TRUE(frozen.Root()["name"].ToString() == "config");
+    FrozenDocument copy = frozen;
+    frozen = FrozenDocument();
+    EXPECT_TRUE(frozen.Root().IsNull());
+    EXPECT_TRUE(root["name"].ToString() == "config");
+    EXPECT_TRUE(copy.Root()["name"].ToString() == "config");
+
+    // many keys
+    object_t wide;
+    for (int i = 0; i < 2000; ++i)
+        wide.emplace(string_t("key" + std::to_string(i)), JsonElem(double(i)));
+    FrozenDocument frozen_wide = JsonElem(wide).Freeze();
+    bool all_found = true;
+    for (int i = 0; i < 2000; ++i)
+    {
+        std::string key = "key" + std::to_string(i);
+        all_found = all_found && frozen_wide.Root()[key].ToNumber() == i;
+    }
+    EXPECT_TRUE(all_found);
+    EXPECT_FALSE(frozen_wide.Root().Find("key2000", &value));
+    EXPECT_TRUE(frozen_matches(frozen_wide.Root(), JsonElem(wide)));
+
+    EXPECT_TRUE(JsonElem(std::string_view("scalar")).Freeze().Root().ToString() == "scalar");
+}
+
+static JsonElem snapshot_doc(int n)
+{
+    object_t object;
+    object.emplace(string_t("n"), JsonElem(double(n)));
+    object.emplace(string_t("twice"), JsonElem(double(n * 2)));
+    return JsonElem(std::move(object));
+}
+
+static void test_snapshot()
+{
+    SnapshotHolder holder;
+    SnapshotHolder::Reader reader(holder);
+    EXPECT_TRUE(reader.Get().IsNull());
+    uint64_t version = holder.version();
+
+    Parser parser;
+    EXPECT_TRUE(holder.Reload(parser, "{\"n\":1}"));
+    EXPECT_TRUE(holder.version() > version);
+    EXPECT_EQ_DOUBLE(1.0, reader.Get()["n"].ToNumber());
+    // a failed reload keeps the snapshot
+    EXPECT_FALSE(holder.Reload(parser, "{\"n\":"));
+    EXPECT_EQ_INT(ParseErrorCode::kExpectValue, parser.GetErrorCode());
+    EXPECT_EQ_DOUBLE(1.0, reader.Get()["n"].ToNumber());
+
+    // an old snapshot stays alive while it is held
+    std::shared_ptr<const JsonElem> old = holder.Acquire();
+    holder.Publish(snapshot_doc(2));
+    EXPECT_EQ_DOUBLE(1.0, (*old)["n"].ToNumber());
+    EXPECT_EQ_DOUBLE(2.0, reader.Get()["n"].ToNumber());
+    std::weak_ptr<const JsonElem> retired = holder.Acquire();
+    holder.Publish(snapshot_doc(3));
+    EXPECT_FALSE(retired.expired()); //the reader still holds it
+    reader.Release();
+    EXPECT_TRUE(retired.expired());
+    EXPECT_EQ_DOUBLE(3.0, reader.Get()["n"].ToNumber());
+
+    // readers see whole documents, never going back, while a writer
+    // publishes
+    const int kVersions = 2000;
+    std::atomic<bool> consistent{ true };
+    std::atomic<bool> done{ false };
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t)
+    {
+        readers.emplace_back([&]
+            {
+                SnapshotHolder::Reader r(holder);
+                double last = 0;
+                for (bool finished = false; !finished;)
+                {
+                    finished = done.load();
+                    const JsonElem& doc = r.Get();
+                    double n = doc["n"].ToNumber();
+                    if (doc["twice"].ToNumber() != n * 2 || n < last)
+                        consistent = false;
+                    last = n;
+                }
+                if (last != kVersions)
+                    consistent = false;
+            });
+    }
+    for (int n = 4; n <= kVersions; ++n)
+        holder.Publish(snapshot_doc(n));
+    done = true;
+    for (auto& t : readers)
+        t.join();
+    EXPECT_TRUE(consistent.load());
+}
+
+// the calls that write elem, members in the object's iteration order
+static void write_calls(Writer& writer, const JsonElem& elem)
+{
+    switch (elem.type())
+    {
+    case JsonType::kNull: writer.Null(); break;
+    case JsonType::kTrue: writer.Bool(true); break;
+    case JsonType::kFalse: writer.Bool(false); break;
+    case JsonType::kNumber: writer.Number(elem.ToNumber()); break;
+    case JsonType::kString: writer.String(elem.ToString()); break;
+    case JsonType::kArray:
+        writer.StartArray();
+        for (const JsonElem& e : elem.ToArray())
+            write_calls(writer, e);
+        writer.EndArray();
+        break;
+    case JsonType::kObject:
+        writer.StartObject();
+        for (const auto& member : elem.ToObject())
+        {
+            writer.Key(member.first);
+            write_calls(writer, member.second);
+        }
+        writer.EndObject();
+        break;
+    }
+}
+
+static void test_writer_compact()
+{
+    const char* documents[] = {
+        "null", "true", "false", "0", "-1.5e-300", "3.14159", "\"\"",
+        "\"esc \\\" \\\\ \\/ \\b \\f \\n \\r \\t \\u0001 \\u00e9\"",
+        "[]", "{}", "[[],{},[[]],{\"\":{}}]",
+        "{\"id\":7,\"name\":\"x\",\"tags\":[\"a\",\"b\"],\"pos\":{\"x\":0.1,\"y\":-2}}",
+        "[1,[2,[3,[4,[5,{\"six\":[null,true,false]}]]]]]",
+    };
+    std::string out;
+    for (const char* json : documents)
+    {
+        JsonElem elem = Json().Parse(json);
+        out.clear();
+        Writer writer(out);
+        EXPECT_FALSE(writer.IsComplete());
+        write_calls(writer, elem);
+        EXPECT_TRUE(writer.IsComplete());
+        EXPECT_TRUE(out == elem.Stringify());
+
+        out.clear();
+        Writer whole(out);
+        whole.Value(elem);
+        EXPECT_TRUE(out == elem.Stringify());
+    }
+
+    // a subtree in the middle of written text, raw numbers as they are
+    ParseOptions options;
+    options.raw_numbers = true;
+    JsonElem raw = Json(options).Parse("[1.50,{\"big\":12345678901234567890}]");
+    out.clear();
+    Writer writer(out);
+    writer.StartObject();
+    writer.Key("raw");
+    writer.Value(raw);
+    writer.Key("n");
+    writer.RawNumber("1.0e2");
+    writer.EndObject();
+    EXPECT_TRUE(out == "{\"raw\":[1.50,{\"big\":12345678901234567890}],\"n\":1.0e2}");
+
+    // one document per line
+    out.clear();
+    Writer lines(out);
+    for (int i = 0; i < 3; ++i)
+    {
+        lines.StartArray();
+        lines.Number(i);
+        lines.EndArray();
+        EXPECT_TRUE(lines.IsComplete());
+        out += '\n';
+        lines.Reset();
+    }
+    EXPECT_TRUE(out == "[0]\n[1]\n[2]\n");
+}
+
+static void test_writer_pretty()
+{
+    WriterOptions options;
+    options.indent = 2;
+    std::string out;
+    Writer writer(out, options);
+    writer.StartObject();
+    writer.Key("name");
+    writer.String("x");
+    writer.Key("list");
+    writer.StartArray();
+    writer.Number(1);
+    writer.StartObject();
+    writer.EndObject();
+    writer.StartArray();
+    writer.EndArray();
+    writer.EndArray();
+    writer.Key("nested");
+    writer.Value(Json().Parse("{\"a\":[true]}"));
+    writer.EndObject();
+    const char* expect =
+        "{\n"
+        "  \"name\": \"x\",\n"
+        "  \"list\": [\n"
+        "    1,\n"
+        "    {},\n"
+        "    []\n"
+        "  ],\n"
+        "  \"nested\": {\n"
+        "    \"a\": [\n"
+        "      true\n"
+        "    ]\n"
+        "  }\n"
+        "}";
+    EXPECT_TRUE(out == expect);
+    // pretty text parses back to the same tree
+    JsonElem elem = Json().Parse("{\"id\":7,\"tags\":[\"a\",[]],\"pos\":{\"x\":0.5}}");
+    out.clear();
+    Writer pretty(out, options);
+    pretty.Value(elem);
+    EXPECT_TRUE(Json().Parse(out) == elem);
+}
+
+static void test_writer_stream()
+{
+    WriterOptions options;
+    options.flush_bytes = 16;
+    std::ostringstream sink;
+    Writer writer(sink, options);
+    writer.StartArray();
+    for (int i = 0; i < 100; ++i)
+        writer.String("item " + std::to_string(i));
+    // all but the last few bytes are out before the end
+    EXPECT_TRUE(sink.str().size() > 950);
+    writer.EndArray();
+    JsonElem expect = Json().Parse(sink.str());
+    EXPECT_EQ_SIZE_T(100, expect.ToArray().size());
+    std::string out;
+    Writer direct(out);
+    write_calls(direct, expect);
+    EXPECT_TRUE(out == sink.str());
+}
+
+static void test_writer()
+{
+    test_writer_compact();
+    test_writer_pretty();
+    test_writer_stream();
+}
+
+static void test_path()
+{
+    test_path_select();
+    test_path_filter();
+    test_path_error();
+    test_path_batch();
+}
+
+// "ok", or the keyword and pointer of the first violation; checking
+// while parsing and Validate on the parsed tree have to agree
+static std::string schema_check(const char* schema_text, const char* json)
+{
+    Parser parser;
+    Schema schema;
+    if (!schema.Compile(parser.Parse(schema_text)))
+        return "bad schema";
+    JsonElem fused = parser.Parse(json, schema);
+    std::string result = "ok";
+    if (parser.GetErrorCode() == ParseErrorCode::kSchemaViolation)
+        result = std::string(parser.GetSchemaViolation().keyword) + " at " +
+            parser.GetSchemaViolation().path;
+    else if (parser.GetErrorCode() != ParseErrorCode::kOK)
+        return "parse error";
+    JsonElem tree = parser.Parse(json);
+    if (result == "ok" && fused != tree)
+        return "tree differs";
+    SchemaViolation violation;
+    std::string separate = "ok";
+    if (!schema.Validate(tree, &violation))
+        separate = std::string(violation.keyword) + " at " + violation.path;
+    return result == separate ? result : result + " / " + separate;
+}
+
+#define TEST_SCHEMA(expect, schema, json)\
+    do {\
+        std::string actual = schema_check(schema, json);\
+        EXPECT_EQ_STRING(expect, actual.c_str(), actual.size());\
+    } while(0)
+
+static void test_schema_keywords()
+{
+    TEST_SCHEMA("ok", "true", "[1,{\"a\":null}]");
+    TEST_SCHEMA("ok", "{}", "\"x\"");
+    TEST_SCHEMA("false at ", "false", "1");
+    TEST_SCHEMA("false at ", "false", "{}");
+
+    TEST_SCHEMA("ok", "{\"type\":\"string\"}", "\"x\"");
+    TEST_SCHEMA("type at ", "{\"type\":\"string\"}", "1");
+    TEST_SCHEMA("type at ", "{\"type\":\"object\"}", "[1,2]");
+    TEST_SCHEMA("ok", "{\"type\":[\"null\",\"boolean\"]}", "false");
+    TEST_SCHEMA("type at ", "{\"type\":[\"null\",\"boolean\"]}", "0");
+    TEST_SCHEMA("ok", "{\"type\":\"integer\"}", "3.0");
+    TEST_SCHEMA("type at ", "{\"type\":\"integer\"}", "3.5");
+    TEST_SCHEMA("ok", "{\"type\":\"number\"}", "3.5");
+
+    TEST_SCHEMA("ok", "{\"minimum\":1,\"maximum\":3}", "3");
+    TEST_SCHEMA("minimum at ", "{\"minimum\":1,\"maximum\":3}", "0.5");
+    TEST_SCHEMA("maximum at ", "{\"minimum\":1,\"maximum\":3}", "3.01");
+    TEST_SCHEMA("ok", "{\"minimum\":1}", "\"not a number\"");
+    // code points, not bytes
+    TEST_SCHEMA("ok", "{\"maxLength\":3}", "\"\\u00e9\\u00e9\\u00e9\"");
+    TEST_SCHEMA("maxLength at ", "{\"maxLength\":3}", "\"abcd\"");
+    TEST_SCHEMA("minLength at ", "{\"minLength\":2}", "\"\\ud834\\udd1e\"");
+    TEST_SCHEMA("ok", "{\"enum\":[1,\"a\",[true]]}", "[true]");
+    TEST_SCHEMA("ok", "{\"enum\":[1,\"a\",[true]]}", "1.0");
+    TEST_SCHEMA("enum at ", "{\"enum\":[1,\"a\",[true]]}", "\"b\"");
+    TEST_SCHEMA("ok", "{\"title\":\"t\",\"description\":\"d\",\"default\":1}", "[]");
+}
+
+static void test_schema_structure()
+{
+    const char* order =
+        "{\"type\":\"object\",\"required\":[\"id\",\"lines\"],"
+        "\"properties\":{"
+        "\"id\":{\"type\":\"integer\",\"minimum\":1},"
+        "\"note\":{\"type\":\"string\",\"maxLength\":5},"
+        "\"lines\":{\"type\":\"array\",\"items\":{"
+        "\"type\":\"object\",\"required\":[\"sku\"],"
+        "\"properties\":{\"sku\":{\"type\":\"string\"},"
+        "\"qty\":{\"type\":\"integer\",\"minimum\":1}},"
+        "\"additionalProperties\":false}}},"
+        "\"additionalProperties\":{\"type\":\"string\"}}";
+    TEST_SCHEMA("ok", order,
+        "{\"id\":7,\"lines\":[{\"sku\":\"a\",\"qty\":2},{\"sku\":\"b\"}]}");
+    TEST_SCHEMA("ok", order, "{\"id\":7,\"lines\":[],\"extra\":\"text\"}");
+    TEST_SCHEMA("required at ", order, "{\"id\":7}");
+    TEST_SCHEMA("required at ", order, "{}");
+    TEST_SCHEMA("minimum at /id", order, "{\"id\":0,\"lines\":[]}");
+    TEST_SCHEMA("maxLength at /note", order,
+        "{\"id\":1,\"note\":\"too long\",\"lines\":[]}");
+    TEST_SCHEMA("type at /extra", order, "{\"id\":1,\"lines\":[],\"extra\":1}");
+    TEST_SCHEMA("minimum at /lines/1/qty", order,
+        "{\"id\":1,\"lines\":[{\"sku\":\"a\"},{\"sku\":\"b\",\"qty\":0}]}");
+    TEST_SCHEMA("required at /lines/0", order,
+        "{\"id\":1,\"lines\":[{\"qty\":1}]}");
+    TEST_SCHEMA("additionalProperties at /lines/0/price", order,
+        "{\"id\":1,\"lines\":[{\"sku\":\"a\",\"price\":1}]}");
+    TEST_SCHEMA("type at /lines", order, "{\"id\":1,\"lines\":{}}");
+
+    // names in the pointer are escaped
+    TEST_SCHEMA("type at /a~1b/~0", "{\"properties\":{\"a/b\":{"
+        "\"properties\":{\"~\":{\"type\":\"null\"}}}}}",
+        "{\"a/b\":{\"~\":1}}");
+    // a required name without a schema is still additional
+    TEST_SCHEMA("additionalProperties at /x",
+        "{\"required\":[\"x\"],\"additionalProperties\":false}", "{\"x\":1}");
+    // number arrays and items
+    TEST_SCHEMA("maximum at /2", "{\"items\":{\"maximum\":5}}", "[1,5,6,2]");
+
+    // checking stops at the first violation in document order, before the
+    // rest is parsed
+    Parser parser;
+    Schema schema;
+    EXPECT_TRUE(schema.Compile(parser.Parse(order)));
+    parser.Parse("{\"id\":0,\"lines\":[1,", schema);
+    EXPECT_EQ_INT(ParseErrorCode::kSchemaViolation, parser.GetErrorCode());
+    EXPECT_TRUE(parser.GetSchemaViolation().path == "/id");
+    parser.Parse("{\"id\":1,\"lines\":[{\"sku\":\"a\"}", schema);
+    EXPECT_EQ_INT(ParseErrorCode::kMissCommaOrSquareBracket, parser.GetErrorCode());
+    parser.Parse("{\"id\":1,\"lines\":[]} 1", schema);
+    EXPECT_EQ_INT(ParseErrorCode::kRootNotSingular, parser.GetErrorCode());
+    parser.Parse("{\"id\":1,\"lines\":[]}", schema);
+    EXPECT_EQ_INT(ParseErrorCode::kOK, parser.GetErrorCode());
+    EXPECT_TRUE(parser.GetSchemaViolation().path.empty());
+}
+
+#define TEST_SCHEMA_ERROR(error, path, schema_text)\
+    do {\
+        Parser parser;\
+        Schema schema;\
+        EXPECT_FALSE(schema.Compile(parser.Parse(schema_text)));\
+        EXPECT_EQ_INT(error, schema.GetErrorCode());\
+        EXPECT_EQ_STRING(path, schema.GetErrorPath().c_str(),\
+            schema.GetErrorPath().size());\
+        EXPECT_TRUE(schema.Validate(JsonElem(1.0)));\
+    } while(0)
+
+static void test_schema_error()
+{
+    TEST_SCHEMA_ERROR(SchemaErrorCode::kNotSchema, "", "1");
+    TEST_SCHEMA_ERROR(SchemaErrorCode::kInvalidKeyword, "/type",
+        "{\"type\":\"text\"}");
+    TEST_SCHEMA_ERROR(SchemaErrorCode::kInvalidKeyword, "/type",
+        "{\"type\":[]}");
+    TEST_SCHEMA_ERROR(SchemaErrorCode::kInvalidKeyword, "/maxLength",
+        "{\"maxLength\":-1}");
+    TEST_SCHEMA_ERROR(SchemaErrorCode::kInvalidKeyword, "/required",
+        "{\"required\":[1]}");
+    TEST_SCHEMA_ERROR(SchemaErrorCode::kNotSchema, "/properties/a~1b",
+        "{\"properties\":{\"a/b\":3}}");
+    TEST_SCHEMA_ERROR(SchemaErrorCode::kUnsupportedKeyword,
+        "/items/properties/x/pattern",
+        "{\"items\":{\"properties\":{\"x\":{\"pattern\":\"^a\"}}}}");
+    TEST_SCHEMA_ERROR(SchemaErrorCode::kUnsupportedKeyword, "/items",
+        "{\"items\":[{}]}");
+    TEST_SCHEMA_ERROR(SchemaErrorCode::kUnsupportedKeyword, "/$ref",
+        "{\"$ref\":\"#\"}");
+}
+
+static void test_schema()
+{
+    test_schema_keywords();
+    test_schema_structure();
+    test_schema_error();
+}
+
+// the patched text, or "error" when Patch fails
+static std::string patch_text(const char* json, std::vector<TextEdit> edits)
+{
+    TextPatcher patcher;
+    std::string out = "unchanged";
+    if (!patcher.Patch(json, edits, out))
+        return out == "unchanged" ? "error" : "error, out written";
+    return out;
+}
+
+#define TEST_PATCH(expect, json, ...)\
+    do {\
+        std::string actual = patch_text(json, { __VA_ARGS__ });\
+        EXPECT_EQ_STRING(expect, actual.c_str(), actual.size());\
+    } while(0)
+
+static void test_patch_replace()
+{
+    // untouched text, whitespace and escapes included, is kept as it is
+    const char* body = "{ \"ts\" : 1, \"tr\\u0061ce\":\"old\",\n"
+        "  \"data\": [1.50, {\"x\": null}, \"\\/\"] }";
+    TEST_PATCH("{ \"ts\" : 1, \"tr\\u0061ce\":\"new\",\n"
+        "  \"data\": [1.50, {\"x\": null}, \"\\/\"] }", body,
+        TextEdit{ "/trace", JsonElem(std::string_view("new")) });
+    TEST_PATCH("{ \"ts\" : 1700000000, \"tr\\u0061ce\":\"old\",\n"
+        "  \"data\": [1.50, {\"x\": [true]}, \"\\/\"] }", body,
+        TextEdit{ "/data/1/x", Parser().Parse("[true]") },
+        TextEdit{ "/ts", JsonElem(1700000000.0) });
+    TEST_PATCH("{ \"ts\" : 1, \"tr\\u0061ce\":\"old\",\n"
+        "  \"data\": \"a\\\"b\" }", body,
+        TextEdit{ "/data", JsonElem(std::string_view("a\"b")) });
+    TEST_PATCH(" 2 ", " 1 ", TextEdit{ "", JsonElem(2.0) });
+    TEST_PATCH("{\"a\":1}", "{\"a\":1}");
+    // keys with / and ~, and the first of duplicate keys as well
+    TEST_PATCH("{\"a/b\":{\"~\":0,\"~\":0}}", "{\"a/b\":{\"~\":1,\"~\":2}}",
+        TextEdit{ "/a~1b/~0", JsonElem(0.0) });
+    TEST_PATCH("[[0,1],[2,null]]", "[[0,1],[2,3]]",
+        TextEdit{ "/1/1", JsonElem(nullptr) });
+}
+
+static void test_patch_add()
+{
+    TEST_PATCH("{\"a\":1,\"trace\":\"t\"}", "{\"a\":1}",
+        TextEdit{ "/trace", JsonElem(std::string_view("t")) });
+    TEST_PATCH("{\"x\":{\"k\\\"\":true} }", "{\"x\":{} }",
+        TextEdit{ "/x/k\"", JsonElem(true) });
+    TEST_PATCH("[1,2]", "[1]", TextEdit{ "/-", JsonElem(2.0) });
+    TEST_PATCH("[ 5]", "[ ]", TextEdit{ "/-", JsonElem(5.0) });
+    TEST_PATCH("{\"b\":2,\"c\":3,\"a\":1}", "{\"b\":2}",
+        TextEdit{ "/c", JsonElem(3.0) }, TextEdit{ "/a", JsonElem(1.0) });
+}
+
+static void test_patch_error()
+{
+    TextPatcher patcher;
+    std::string out = "unchanged";
+    std::vector<TextEdit> edits = { TextEdit{ "/a", JsonElem(1.0) },
+        TextEdit{ "/b/c", JsonElem(1.0) } };
+    EXPECT_FALSE(patcher.Patch("{\"a\":0}", edits, out));
+    EXPECT_EQ_INT(ParseErrorCode::kMissTarget, patcher.GetErrorCode());
+    EXPECT_EQ_SIZE_T(1, patcher.GetErrorEdit());
+    EXPECT_TRUE(out == "unchanged");
+
+    edits = { TextEdit{ "a", JsonElem(1.0) } };
+    EXPECT_FALSE(patcher.Patch("{}", edits, out));
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidPointer, patcher.GetErrorCode());
+    EXPECT_EQ_SIZE_T(0, patcher.GetErrorEdit());
+    edits = { TextEdit{ "/a~2", JsonElem(1.0) } };
+    EXPECT_FALSE(patcher.Patch("{}", edits, out));
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidPointer, patcher.GetErrorCode());
+    edits = { TextEdit{ "/a", JsonElem(1.0) }, TextEdit{ "/a/b", JsonElem(1.0) } };
+    EXPECT_FALSE(patcher.Patch("{\"a\":{}}", edits, out));
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidPointer, patcher.GetErrorCode());
+    EXPECT_EQ_SIZE_T(1, patcher.GetErrorEdit());
+    edits = { TextEdit{ "/a/b", JsonElem(1.0) }, TextEdit{ "/a", JsonElem(1.0) } };
+    EXPECT_FALSE(patcher.Patch("{\"a\":{}}", edits, out));
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidPointer, patcher.GetErrorCode());
+
+    TEST_PATCH("error", "[1,2]", TextEdit{ "/2", JsonElem(1.0) });
+    TEST_PATCH("error", "[1,2]", TextEdit{ "/01", JsonElem(1.0) });
+    TEST_PATCH("error", "{\"a\":1}", TextEdit{ "/a/b", JsonElem(1.0) });
+    TEST_PATCH("error", "[1]", TextEdit{ "/-/a", JsonElem(1.0) });
+    // the whole text is still checked
+    edits = { TextEdit{ "/0", JsonElem(1.0) } };
+    EXPECT_FALSE(patcher.Patch("[0,{\"a\" 1}]", edits, out));
+    EXPECT_EQ_INT(ParseErrorCode::kMissColon, patcher.GetErrorCode());
+    EXPECT_FALSE(patcher.Patch("[0] x", edits, out));
+    EXPECT_EQ_INT(ParseErrorCode::kRootNotSingular, patcher.GetErrorCode());
+    EXPECT_FALSE(patcher.Patch("[0,\"\\x\"]", edits, out));
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidStringEscape, patcher.GetErrorCode());
+    EXPECT_FALSE(patcher.Patch("[0,\"\\uD800\"]", edits, out));
+    EXPECT_EQ_INT(ParseErrorCode::kInvalidUnicodeSurrogate, patcher.GetErrorCode());
+    EXPECT_TRUE(out == "unchanged");
+
+    // out may be the input
+    std::string text = "{\"a\":1}";
+    edits = { TextEdit{ "/a", JsonElem(std::string_view("x")) } };
+    EXPECT_TRUE(patcher.Patch(text, edits, text));
+    EXPECT_TRUE(text == "{\"a\":\"x\"}");
+}
+
+static void test_patch()
+{
+    test_patch_replace();
+    test_patch_add();
+    test_patch_error();
 }
 
 int main()
@@ -539,6 +2679,19 @@ int main()
 	test_parse();
     test_stringify();
 	test_access();
+    test_binary();
+    test_tape();
+    test_bind();
+    test_message();
+    test_stream();
+    test_batch();
+    test_path();
+    test_static();
+    test_frozen();
+    test_snapshot();
+    test_writer();
+    test_schema();
+    test_patch();
 	printf("%d/%d (%3.2f%%) passed\n", test_pass, test_count, test_pass * 100.0 / test_count);
 	return main_ret;
 }